@@ -106,6 +106,48 @@ int csp_queue_dequeue(csp_queue_handle_t handle, void *buf, uint32_t timeout);
 */
 int csp_queue_dequeue_isr(csp_queue_handle_t handle, void * buf, CSP_BASE_TYPE * pxTaskWoken);
 
+/**
+   Enqueue (back) a number of values in one operation, without waiting for free space.
+   @note The batch functions only support queues of pointers, i.e. created with item_size = sizeof(void *).
+   @note The batch is not atomic with respect to other tasks on all platforms (e.g. FreeRTOS).
+   @param[in] handle queue.
+   @param[in] values array of \a count values to add (by copy)
+   @param[in] count number of values.
+   @return number of values enqueued, less than \a count if the queue became full.
+*/
+int csp_queue_enqueue_n(csp_queue_handle_t handle, void * const * values, int count);
+
+/**
+   Enqueue (back) a number of values from ISR, see csp_queue_enqueue_n().
+   @param[in] handle queue.
+   @param[in] values array of \a count values to add (by copy)
+   @param[in] count number of values.
+   @param[out] pxTaskWoken Valid reference if called from ISR, otherwise NULL!
+   @return number of values enqueued.
+*/
+int csp_queue_enqueue_n_isr(csp_queue_handle_t handle, void * const * values, int count, CSP_BASE_TYPE * pxTaskWoken);
+
+/**
+   Dequeue up to \a count values (front) in one operation.
+   Waits up to \a timeout for the first value, the remaining values are only taken if immediately available.
+   @param[in] handle queue.
+   @param[out] buf array for up to \a count extracted elements (by copy).
+   @param[in] count max number of values to extract.
+   @param[in] timeout timeout, time to wait for the first element in queue.
+   @return number of values extracted, 0 on timeout.
+*/
+int csp_queue_dequeue_n(csp_queue_handle_t handle, void ** buf, int count, uint32_t timeout);
+
+/**
+   Dequeue up to \a count values (front) from ISR, see csp_queue_dequeue_n().
+   @param[in] handle queue.
+   @param[out] buf array for up to \a count extracted elements (by copy).
+   @param[in] count max number of values to extract.
+   @param[out] pxTaskWoken Valid reference if called from ISR, otherwise NULL!
+   @return number of values extracted.
+*/
+int csp_queue_dequeue_n_isr(csp_queue_handle_t handle, void ** buf, int count, CSP_BASE_TYPE * pxTaskWoken);
+
 /**
    Queue size.
    @param[in] handle queue.
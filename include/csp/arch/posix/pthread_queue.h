@@ -103,6 +103,18 @@ int pthread_queue_enqueue(pthread_queue_t * queue, const void * value, uint32_t
 */
 int pthread_queue_dequeue(pthread_queue_t * queue, void * buf, uint32_t timeout);
 
+/**
+   Enqueue/insert a number of elements without waiting.
+   @return number of elements inserted.
+*/
+int pthread_queue_enqueue_n(pthread_queue_t * queue, const void * values, int count);
+
+/**
+   Dequeue/extract up to \a count elements, waiting up to \a timeout for the first.
+   @return number of elements extracted.
+*/
+int pthread_queue_dequeue_n(pthread_queue_t * queue, void * buf, int count, uint32_t timeout);
+
 /**
    Return number of elements in the queue.
 */
@@ -34,11 +34,47 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
 #include <csp/csp_iflist.h>
 #include <csp/csp_sfp.h>
 #include <csp/csp_promisc.h>
+#include <csp/csp_shaper.h>
+#include <csp/csp_poll.h>
+#include <csp/csp_async.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+#ifndef CSP_ROUTE_WORKERS_MAX
+/**
+   Max number of router workers, see csp_conf_t.route_workers.
+*/
+#define CSP_ROUTE_WORKERS_MAX	4
+#endif
+
+#ifndef CSP_QOS_DRR_QUANTUM
+/**
+   Bytes per weight unit for the deficit round-robin scheduler, see #CSP_QOS_SCHED_DRR.
+*/
+#define CSP_QOS_DRR_QUANTUM	256
+#endif
+
+/**
+   Router input scheduler, used with QoS (compile option) to select between the priority fifos.
+   @see csp_conf_t.qos_scheduler
+*/
+typedef enum {
+	CSP_QOS_SCHED_STRICT = 0,	/**< Strict priority, sustained high priority traffic starves lower priorities. */
+	CSP_QOS_SCHED_WRR = 1,		/**< Weighted round-robin, a priority is served csp_conf_t.qos_weight packets per round. */
+	CSP_QOS_SCHED_DRR = 2,		/**< Deficit round-robin, a priority is served csp_conf_t.qos_weight * #CSP_QOS_DRR_QUANTUM bytes per round. */
+} csp_qos_sched_t;
+
+/**
+   Buffer size class.
+   @see csp_conf_t.buffer_classes
+*/
+typedef struct {
+	uint16_t data_size;		/**< Data size of buffers in this class. */
+	uint16_t count;			/**< Number of buffers in this class. */
+} csp_buffer_class_t;
+
 /**
    CSP configuration.
    @see csp_init()
@@ -51,13 +87,24 @@ typedef struct csp_conf_s {
 	const char *model;		/**< Model, returned by the #CSP_CMP_IDENT request */
 	const char *revision;		/**< Revision, returned by the #CSP_CMP_IDENT request */
 
-	uint8_t conn_max;		/**< Max number of connections. A fixed connection array is allocated by csp_init() */
-	uint8_t conn_queue_length;	/**< Max queue length (max queued Rx messages). */
-	uint8_t fifo_length;		/**< Length of incoming message queue, used for handover to router task. */
+	uint16_t conn_max;		/**< Max number of connections. A fixed connection array is allocated by csp_init() */
+	uint16_t conn_prealloc;		/**< Number of connections with queues created by csp_init(), queues for the remaining connections are created on first use. */
+	uint16_t conn_queue_length;	/**< Max queue length (max queued Rx messages). */
+	uint16_t conn_cache_size;	/**< Max number of idle connections kept for reuse by csp_transaction_w_opts(), 0 disables the cache. */
+	uint32_t conn_cache_idle_ms;	/**< Idle connections in the cache are closed after this time (mS). */
+	uint16_t fifo_length;		/**< Length of incoming message queue, used for handover to router task. */
+	uint8_t route_workers;		/**< Number of router tasks started by csp_route_start_task(), max #CSP_ROUTE_WORKERS_MAX. Each worker has its own incoming message queue(s). */
+	uint8_t qos_scheduler;		/**< Router input scheduler, see #csp_qos_sched_t. Only used with QoS. */
+	uint8_t qos_weight[CSP_PRIORITIES]; /**< Scheduler weight per priority (WRR and DRR), 0 is treated as 1. */
 	uint8_t port_max_bind;		/**< Max/highest port for use with csp_bind() */
 	uint8_t rdp_max_window;		/**< Max RDP window size */
+	bool rdp_congestion_control;	/**< Limit the RDP send window by a congestion window (slow start, AIMD and fast retransmit on EACK). */
 	uint16_t buffers;		/**< Number of CSP buffers */
 	uint16_t buffer_data_size;	/**< Data size of a CSP buffer. Total size will be sizeof(#csp_packet_t) + data_size. */
+	const csp_buffer_class_t * buffer_classes; /**< Optional buffer size classes, replaces buffers/buffer_data_size. Only used by csp_init(). */
+	uint8_t buffer_class_count;	/**< Number of entries in buffer_classes, 0 uses a single class of buffers/buffer_data_size. */
+	uint16_t buffer_headroom;	/**< Extra headroom in front of #csp_packet_t for link-layer headers, see csp_buffer_push(). The padding and length field is always available as headroom. */
+	uint16_t buffer_tailroom;	/**< Tailroom reserved after the data part of all buffers for trailers, see csp_buffer_put(). */
 	uint32_t conn_dfl_so;		/**< Default connection options. Options will always be or'ed onto new connections, see csp_connect() */
 } csp_conf_t;
 
@@ -70,12 +117,26 @@ static inline void csp_conf_get_defaults(csp_conf_t * conf) {
 	conf->model = "model";
 	conf->revision = "resvision";
 	conf->conn_max = 10;
+	conf->conn_prealloc = 10;
 	conf->conn_queue_length = 10;
+	conf->conn_cache_size = 0;
+	conf->conn_cache_idle_ms = 5000;
 	conf->fifo_length = 25;
+	conf->route_workers = 1;
+	conf->qos_scheduler = CSP_QOS_SCHED_STRICT;
+	conf->qos_weight[CSP_PRIO_CRITICAL] = 8;
+	conf->qos_weight[CSP_PRIO_HIGH] = 4;
+	conf->qos_weight[CSP_PRIO_NORM] = 2;
+	conf->qos_weight[CSP_PRIO_LOW] = 1;
 	conf->port_max_bind = 24;
 	conf->rdp_max_window = 20;
+	conf->rdp_congestion_control = false;
 	conf->buffers = 10;
 	conf->buffer_data_size = 256;
+	conf->buffer_classes = NULL;
+	conf->buffer_class_count = 0;
+	conf->buffer_headroom = 0;
+	conf->buffer_tailroom = 0;
 	conf->conn_dfl_so = CSP_O_NONE;
 }
 
@@ -129,6 +190,18 @@ csp_conn_t *csp_accept(csp_socket_t *socket, uint32_t timeout);
 */
 csp_packet_t *csp_read(csp_conn_t *conn, uint32_t timeout);
 
+/**
+   Read a number of packets from a connection in one operation.
+   Waits up to \a timeout for the first packet, the remaining packets are only read if immediately available.
+   With QoS, packets are read in priority order.
+   @param[in] conn connection
+   @param[out] packets array for up to \a max packets, free with csp_buffer_free_n().
+   @param[in] max max number of packets to read.
+   @param[in] timeout timeout in mS to wait for the first packet, use #CSP_MAX_TIMEOUT for infinite timeout.
+   @return number of packets read, 0 in case of failure or timeout.
+*/
+int csp_read_many(csp_conn_t *conn, csp_packet_t **packets, unsigned int max, uint32_t timeout);
+
 /**
    Send packet on a connection.
    @param[in] conn connection
@@ -138,6 +211,17 @@ csp_packet_t *csp_read(csp_conn_t *conn, uint32_t timeout);
 */
 int csp_send(csp_conn_t *conn, csp_packet_t *packet, uint32_t timeout);
 
+/**
+   Send a number of packets on a connection.
+   The route is looked up once for all packets. Packets are sent in order, and sending stops at the first failure.
+   @param[in] conn connection
+   @param[in] packets packets to send.
+   @param[in] count number of packets.
+   @param[in] timeout unused as of CSP version 1.6
+   @return number of packets sent (taken from the start of \a packets), the remaining packets must be freed by calling csp_buffer_free().
+*/
+int csp_send_many(csp_conn_t *conn, csp_packet_t **packets, unsigned int count, uint32_t timeout);
+
 /**
    Change the default priority of the connection and send a packet.
    @note The priority of the connection will be changed. If you need to change it back, call csp_send_prio() again.
@@ -153,6 +237,9 @@ int csp_send_prio(uint8_t prio, csp_conn_t *conn, csp_packet_t *packet, uint32_t
 /**
    Perform an entire request & reply transaction.
    Creates a connection, send \a outbuf, wait for reply, copy reply to \a inbuf and close the connection.
+   If the connection cache is enabled (csp_conf_t.conn_cache_size), an idle connection to the same destination, port and options
+   is reused, and the connection is returned to the cache after a successful transaction (instead of being closed).
+   @note With deduplication enabled, identical non-RDP requests repeated within the dedup window on a cached connection are dropped as duplicates.
    @param[in] prio priority, see #csp_prio_t
    @param[in] dst destination address
    @param[in] dst_port destination port
@@ -166,6 +253,11 @@ int csp_send_prio(uint8_t prio, csp_conn_t *conn, csp_packet_t *packet, uint32_t
 */
 int csp_transaction_w_opts(uint8_t prio, uint8_t dst, uint8_t dst_port, uint32_t timeout, void *outbuf, int outlen, void *inbuf, int inlen, uint32_t opts);
 
+/**
+   Close all idle connections in the connection cache, see csp_conf_t.conn_cache_size.
+*/
+void csp_conn_cache_flush(void);
+
 /**
    Perform an entire request & reply transaction.
    Creates a connection, send \a outbuf, wait for reply, copy reply to \a inbuf and close the connection.
@@ -204,6 +296,17 @@ int csp_transaction_persistent(csp_conn_t *conn, uint32_t timeout, void *outbuf,
 */
 csp_packet_t *csp_recvfrom(csp_socket_t *socket, uint32_t timeout);
 
+/**
+   Read a number of packets from a connection-less server socket in one operation.
+   Waits up to \a timeout for the first packet, the remaining packets are only read if immediately available.
+   @param[in] socket connection-less socket.
+   @param[out] packets array for up to \a max packets, free with csp_buffer_free_n().
+   @param[in] max max number of packets to read.
+   @param[in] timeout timeout in mS to wait for the first packet, use #CSP_MAX_TIMEOUT for infinite timeout.
+   @return number of packets read, 0 in case of failure or timeout.
+*/
+int csp_recvfrom_many(csp_socket_t *socket, csp_packet_t **packets, unsigned int max, uint32_t timeout);
+
 /**
    Send a packet (without connection).
    @param[in] prio packet priority, see #csp_prio_t
@@ -217,6 +320,22 @@ csp_packet_t *csp_recvfrom(csp_socket_t *socket, uint32_t timeout);
 */
 int csp_sendto(uint8_t prio, uint8_t dst, uint8_t dst_port, uint8_t src_port, uint32_t opts, csp_packet_t *packet, uint32_t timeout);
 
+/**
+   Send a number of packets (without connection) to the same destination.
+   The route is looked up once for all packets. Packets are sent in order, and sending stops at the first failure.
+   @param[in] prio packet priority, see #csp_prio_t
+   @param[in] dst destination address
+   @param[in] dst_port destination port
+   @param[in] src_port source port
+   @param[in] opts connection options, see @ref CSP_CONNECTION_OPTIONS.
+   @param[in] packets packets to send.
+   @param[in] count number of packets.
+   @param[in] timeout unused as of CSP version 1.6
+   @return number of packets sent (taken from the start of \a packets), the remaining packets must be freed by calling csp_buffer_free().
+   An error code is returned if the options are invalid (no packets sent).
+*/
+int csp_sendto_many(uint8_t prio, uint8_t dst, uint8_t dst_port, uint8_t src_port, uint32_t opts, csp_packet_t **packets, unsigned int count, uint32_t timeout);
+
 /**
    Send a packet as a reply to a request (without a connection).
    Calls csp_sendto() with the source address and port from the request.
@@ -232,6 +351,7 @@ int csp_sendto_reply(const csp_packet_t * request, csp_packet_t * reply, uint32_
    Establish outgoing connection.
    The call will return immediately, unless it is a RDP connection (#CSP_O_RDP) in which case it will wait until the other
    end acknowleges the connection (timeout is determined by the current connection timeout set by csp_rdp_set_opt()).
+   Use csp_connect_rdp_opt() for RDP options specific to the connection.
    @param[in] prio priority, see #csp_prio_t
    @param[in] dst Destination address
    @param[in] dst_port Destination port
@@ -284,6 +404,27 @@ int csp_conn_src(csp_conn_t *conn);
 */
 int csp_conn_flags(csp_conn_t *conn);
 
+/**
+   Connection table memory usage.
+   Queue sizes only include the queued items (packet pointers/events), not the overhead of the queue implementation.
+*/
+typedef struct {
+	uint16_t conn_max;		/**< Number of connections in the connection table, csp_conf_t.conn_max. */
+	uint16_t conn_created;		/**< Number of connections with queues created. */
+	uint16_t conn_open;		/**< Number of open connections (including sockets). */
+	uint32_t conn_size;		/**< Size of the connection structure. */
+	uint32_t queue_size;		/**< Size of the queues created per connection (RX queues, QoS events and RDP queues). */
+	uint32_t per_conn;		/**< Memory per connection with queues, conn_size + queue_size. */
+	uint32_t total;			/**< Total memory used by the connection table: conn_max * conn_size + conn_created * queue_size + hash index. */
+} csp_conn_mem_stats_t;
+
+/**
+   Get memory used by the connection table.
+   @param[out] stats memory usage.
+   @return #CSP_ERR_NONE on success, otherwise an error code.
+*/
+int csp_conn_get_mem_stats(csp_conn_mem_stats_t * stats);
+
 /**
    Set socket to listen for incoming connections.
    @param[in] socket socket
@@ -301,8 +442,9 @@ int csp_listen(csp_socket_t *socket, size_t backlog);
 int csp_bind(csp_socket_t *socket, uint8_t port);
 
 /**
-   Start the router task.
-   The router task calls csp_route_work() to do the actual work.
+   Start the router task(s).
+   Starts csp_conf_t.route_workers router tasks. Incoming packets are distributed to the workers by connection (source, destination and ports),
+   so packets on the same connection are always handled by the same worker, in order.
    @param[in] task_stack_size stack size for the task, see csp_thread_create() for details on the stack size parameter.
    @param[in] task_priority priority for the task, see csp_thread_create() for details on the stack size parameter.
    @return #CSP_ERR_NONE on success, otherwise an error code.
@@ -310,22 +452,58 @@ int csp_bind(csp_socket_t *socket, uint8_t port);
 int csp_route_start_task(unsigned int task_stack_size, unsigned int task_priority);
 
 /**
-   Route packet from the incoming router queue and check RDP timeouts.
+   Route packets from the incoming router queue and check RDP timeouts.
+   Waits for the first packet and routes up to a batch of packets, that are immediately available. RDP timeouts are handled when they expire,
+   the wait is cut short by the next RDP timeout.
    In order for incoming packets to routed and RDP timeouts to be checked, this function must be called reguarly.
    If the router task is started by calling csp_route_start_task(), there function should not be called.
+   Only handles the incoming queue(s) of the first router worker, i.e. requires csp_conf_t.route_workers = 1.
    @param[in] timeout timeout in mS to wait for an incoming packet.
-   @return #CSP_ERR_NONE on success, otherwise an error code.
+   @return #CSP_ERR_NONE on success, #CSP_ERR_INVAL if csp_conf_t.route_workers > 1, otherwise an error code.
 */
 int csp_route_work(uint32_t timeout);
 
+/**
+   Number of batch size buckets in #csp_route_stats_t.
+*/
+#define CSP_ROUTE_STATS_BATCH_BUCKETS	5
+
+/**
+   Router worker statistics.
+   The router reads a batch of packets from its incoming queue per wakeup.
+*/
+typedef struct {
+	uint32_t batches;		/**< Number of batches (wakeups with packets). */
+	uint32_t packets;		/**< Number of packets routed. */
+	uint16_t batch_max;		/**< Largest batch. */
+	uint32_t batch_size[CSP_ROUTE_STATS_BATCH_BUCKETS]; /**< Batch size histogram, buckets: 1, 2-3, 4-7, 8-15, 16+. */
+	uint32_t timeout_checks;	/**< Number of expired connection timers (RDP timeouts). */
+	uint32_t prio_packets[CSP_PRIORITIES]; /**< Packets routed per priority. */
+	uint32_t prio_bytes[CSP_PRIORITIES]; /**< Bytes routed per priority. */
+} csp_route_stats_t;
+
+/**
+   Get router worker statistics.
+   @param[in] worker router worker, 0 to csp_conf_t.route_workers - 1.
+   @param[out] stats statistics.
+   @return #CSP_ERR_NONE on success, otherwise an error code.
+*/
+int csp_route_get_stats(unsigned int worker, csp_route_stats_t * stats);
+
+/**
+   Reset router worker statistics.
+*/
+void csp_route_reset_stats(void);
+
 /**
    Start the bridge task.
    The bridge will copy packets between interfaces, i.e. packets received on A will be sent on B, and vice versa.
+   Requires csp_conf_t.route_workers = 1.
    @param[in] task_stack_size stack size for the task, see csp_thread_create() for details on the stack size parameter.
    @param[in] task_priority priority for the task, see csp_thread_create() for details on the stack size parameter.
    @param[in] if_a interface/side A
    @param[in] if_b interface/side B
-   @return #CSP_ERR_NONE on success, otherwise an error code.
+   @return #CSP_ERR_NONE on success, #CSP_ERR_INVAL if csp_conf_t.route_workers > 1, otherwise an error code.
 */
 int csp_bridge_start(unsigned int task_stack_size, unsigned int task_priority, csp_iface_t * if_a, csp_iface_t * if_b);
 
@@ -434,7 +612,7 @@ int csp_get_uptime(uint8_t node, uint32_t timeout, uint32_t * uptime);
    The RDP options are used from the connecting/client side. When a RDP connection is established, the client tranmits the options to the server.
    @param[in] window_size window size
    @param[in] conn_timeout_ms connection timeout in mS
-   @param[in] packet_timeout_ms packet timeout in mS.
+   @param[in] packet_timeout_ms packet timeout in mS, the initial retransmission timeout. The retransmission timeout is adapted to the measured round trip time, once ACKs are received.
    @param[in] delayed_acks enable/disable delayed acknowledgements.
    @param[in] ack_timeout acknowledgement timeout when delayed ACKs is enabled
    @param[in] ack_delay_count send acknowledgement for every ack_delay_count packets.
@@ -457,6 +635,75 @@ void csp_rdp_get_opt(unsigned int *window_size, unsigned int *conn_timeout_ms,
 		unsigned int *packet_timeout_ms, unsigned int *delayed_acks,
 		unsigned int *ack_timeout, unsigned int *ack_delay_count);
 
+/**
+   RDP connection options.
+   @see csp_connect_rdp_opt(), csp_socket_set_rdp_opt()
+*/
+typedef struct {
+	uint32_t window_size;		/**< Window size (segments) */
+	uint32_t conn_timeout_ms;	/**< Connection timeout in mS */
+	uint32_t packet_timeout_ms;	/**< Packet timeout in mS, the initial retransmission timeout */
+	uint32_t delayed_acks;		/**< Enable/disable delayed acknowledgements */
+	uint32_t ack_timeout;		/**< Acknowledgement timeout when delayed ACKs is enabled */
+	uint32_t ack_delay_count;	/**< Send acknowledgement for every ack_delay_count packets */
+} csp_rdp_opt_t;
+
+/**
+   Get the default RDP options, as set by csp_rdp_set_opt().
+   Use this to initialize a #csp_rdp_opt_t before changing individual options.
+   @param[out] opt options
+*/
+void csp_rdp_get_default_opt(csp_rdp_opt_t * opt);
+
+/**
+   Establish outgoing RDP connection with specific RDP options.
+   Same as csp_connect(), but the connection uses \a rdp_opt instead of the options set by csp_rdp_set_opt(), and #CSP_O_RDP is implied.
+   The options are transmitted to the server when the connection is established.
+   @param[in] prio priority, see #csp_prio_t
+   @param[in] dst Destination address
+   @param[in] dst_port Destination port
+   @param[in] timeout unused.
+   @param[in] opts connection options, see @ref CSP_CONNECTION_OPTIONS.
+   @param[in] rdp_opt RDP options, NULL for the options set by csp_rdp_set_opt().
+   @return Established connection or NULL on failure (no free connections, timeout, invalid options).
+*/
+csp_conn_t * csp_connect_rdp_opt(uint8_t prio, uint8_t dst, uint8_t dst_port, uint32_t timeout, uint32_t opts, const csp_rdp_opt_t * rdp_opt);
+
+/**
+   Set RDP options for incoming connections on a socket.
+   Window size and delayed acknowledgements are negotiated by the client, so only the connection and packet timeouts
+   are used by the server side of connections accepted on the socket. Must be set before csp_bind().
+   @param[in] socket socket, created by calling csp_socket().
+   @param[in] opt RDP options, NULL to use the options from the client.
+   @return #CSP_ERR_NONE on success, otherwise an error code.
+*/
+int csp_socket_set_rdp_opt(csp_socket_t * socket, const csp_rdp_opt_t * opt);
+
+/**
+   RDP connection statistics.
+   @see csp_rdp_get_conn_stats()
+*/
+typedef struct {
+	uint32_t window_size;		/**< Window size (segments), negotiated when the connection was opened */
+	uint16_t cwnd;			/**< Congestion window (segments), only used with csp_conf_t.rdp_congestion_control */
+	uint16_t ssthresh;		/**< Slow start threshold (segments) */
+	uint16_t outstanding;		/**< Segments sent, but not acknowledged */
+	uint32_t rto;			/**< Retransmission timeout (mS) */
+	uint32_t srtt;			/**< Smoothed round trip time (mS) */
+	uint32_t rttvar;		/**< Round trip time variation (mS) */
+	uint32_t retransmits;		/**< Retransmitted segments */
+	uint32_t fast_retransmits;	/**< Window reductions caused by EACK (lost segments) */
+	uint32_t timeouts;		/**< Window reductions caused by retransmission timeout */
+} csp_rdp_conn_stats_t;
+
+/**
+   Get RDP connection statistics.
+   @param[in] conn RDP connection.
+   @param[out] stats statistics.
+   @return #CSP_ERR_NONE on success, otherwise an error code.
+*/
+int csp_rdp_get_conn_stats(const csp_conn_t * conn, csp_rdp_conn_stats_t * stats);
+
 /**
    Print connection table to stdout.
 */
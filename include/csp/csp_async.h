@@ -0,0 +1,154 @@
+/*
+Cubesat Space Protocol - A small network-layer protocol designed for Cubesats
+Copyright (C) 2012 Gomspace ApS (http://www.gomspace.com)
+Copyright (C) 2012 AAUSAT3 Project (http://aausat3.space.aau.dk)
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef _CSP_ASYNC_H_
+#define _CSP_ASYNC_H_
+
+/**
+   @file
+
+   Asynchronous transactions.
+
+   An async engine runs many request/reply transactions concurrently, so polling N nodes takes roughly the longest
+   round-trip, instead of the sum of them. Transactions are started by csp_async_transaction() or
+   csp_async_transaction_persistent(), and completed by csp_async_run(), which waits for replies (using a poll set),
+   handles timeouts (using a timer wheel) and calls the completion callback.
+
+   csp_async_transaction() opens a connection per transaction, like csp_transaction_w_opts(). The connection is opened
+   on the calling task, so it is only non-blocking for connection-less protocols - for RDP, use
+   csp_async_transaction_persistent() on a connection opened beforehand.
+   csp_async_transaction_persistent() sends on an existing connection, and allows multiple outstanding transactions
+   per connection. Replies are matched by a 16 bit request id in the data (see csp_async_create()), or in order if
+   the protocol has no request id.
+*/
+
+#include <csp/csp_types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+   Async engine (opaque).
+*/
+typedef struct csp_async_s csp_async_t;
+
+/**
+   Transaction completion callback, called from csp_async_run().
+   @param[in] result #CSP_ERR_NONE if a reply was received, #CSP_ERR_TIMEDOUT on timeout, #CSP_ERR_RESET if the
+   connection was closed, #CSP_ERR_INVAL if the reply length did not match.
+   @param[in] reply reply packet (only if result is #CSP_ERR_NONE), freed when the callback returns.
+   @param[in] context user context.
+*/
+typedef void (*csp_async_cb_t)(int result, csp_packet_t * reply, void * context);
+
+/**
+   No request id in data, replies on persistent connections are matched in order.
+*/
+#define CSP_ASYNC_NO_REQUEST_ID	-1
+
+/**
+   Max transaction timeout (mS), except #CSP_MAX_TIMEOUT. Longer timeouts are outside the range of the timer wheel.
+*/
+#define CSP_ASYNC_TIMEOUT_MAX	0x7FFFFFFFU
+
+/**
+   Create async engine.
+   @param[in] max_transactions max number of outstanding transactions.
+   @param[in] request_id_offset offset of a 16 bit request id (network byte order) in request and reply data, used to match
+   replies on persistent connections. The id is written into the request by the engine. Use #CSP_ASYNC_NO_REQUEST_ID to match
+   replies in order.
+   @return engine, NULL on failure.
+*/
+csp_async_t * csp_async_create(unsigned int max_transactions, int request_id_offset);
+
+/**
+   Destroy async engine.
+   Outstanding transactions are cancelled without calling their callback.
+   @param[in] async engine.
+*/
+void csp_async_destroy(csp_async_t * async);
+
+/**
+   Start transaction on a new connection.
+   The connection is opened by calling csp_connect(), and closed when the transaction completes.
+   @note With RDP (\a opts or default connection options), csp_connect() blocks the calling task for the RDP handshake,
+   i.e. up to the RDP connection timeout. Use csp_async_transaction_persistent() on a connection opened beforehand instead.
+   @param[in] async engine.
+   @param[in] prio priority, see #csp_prio_t
+   @param[in] dest destination address
+   @param[in] port destination port
+   @param[in] timeout timeout in mS to wait for the reply, max #CSP_ASYNC_TIMEOUT_MAX. #CSP_MAX_TIMEOUT waits forever, i.e. until
+   a reply is received or the connection is reset.
+   @param[in] outbuf outgoing data (request)
+   @param[in] outlen length of data in \a outbuf (request)
+   @param[in] inlen length of expected reply, -1 for unknown size.
+   @param[in] opts connection options, see @ref CSP_CONNECTION_OPTIONS.
+   @param[in] callback completion callback.
+   @param[in] context user context for callback.
+   @return #CSP_ERR_NONE if the request was sent, #CSP_ERR_INVAL on invalid arguments (e.g. \a timeout), otherwise an error
+   code (callback is not called).
+*/
+int csp_async_transaction(csp_async_t * async, uint8_t prio, uint8_t dest, uint8_t port, uint32_t timeout,
+                          const void * outbuf, int outlen, int inlen, uint32_t opts, csp_async_cb_t callback, void * context);
+
+/**
+   Start transaction on an existing connection.
+   Multiple transactions can be outstanding on the same connection. The connection is not closed by the engine, but it
+   must stay open until all transactions on it have completed.
+   When replies are matched in order (#CSP_ASYNC_NO_REQUEST_ID), a timeout fails all outstanding transactions on the
+   connection with #CSP_ERR_TIMEDOUT, as a late reply can no longer be matched to its request. Replies arriving late
+   are still matched to new transactions, so the connection should be reopened after a timeout.
+   @param[in] async engine.
+   @param[in] conn connection.
+   @param[in] timeout timeout in mS to wait for the reply, max #CSP_ASYNC_TIMEOUT_MAX. #CSP_MAX_TIMEOUT waits forever, i.e. until
+   a reply is received or the connection is reset.
+   @param[in] outbuf outgoing data (request)
+   @param[in] outlen length of data in \a outbuf (request)
+   @param[in] inlen length of expected reply, -1 for unknown size.
+   @param[in] callback completion callback.
+   @param[in] context user context for callback.
+   @return #CSP_ERR_NONE if the request was sent, #CSP_ERR_INVAL on invalid arguments (e.g. \a timeout), otherwise an error
+   code (callback is not called).
+*/
+int csp_async_transaction_persistent(csp_async_t * async, csp_conn_t * conn, uint32_t timeout,
+                                     const void * outbuf, int outlen, int inlen, csp_async_cb_t callback, void * context);
+
+/**
+   Run engine, i.e. receive replies, handle timeouts and call completion callbacks.
+   Waits until at least one transaction has completed, or the timeout expires.
+   Only one task may run the engine, but transactions can be started from any task (and from the callbacks).
+   @param[in] async engine.
+   @param[in] timeout timeout in mS, #CSP_MAX_TIMEOUT to wait forever.
+   @return number of completed transactions, otherwise an error code.
+*/
+int csp_async_run(csp_async_t * async, uint32_t timeout);
+
+/**
+   Return number of outstanding transactions.
+   @param[in] async engine.
+   @return number of outstanding transactions.
+*/
+unsigned int csp_async_pending(csp_async_t * async);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -32,9 +32,35 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
 extern "C" {
 #endif
 
+#ifndef CSP_BUFFER_CLASSES_MAX
+/**
+   Max number of buffer size classes, see csp_conf_t.buffer_classes.
+*/
+#define CSP_BUFFER_CLASSES_MAX	4
+#endif
+
+/**
+   Buffer owner, i.e. where a buffer currently is held (see csp_buffer_get_stats()).
+   Only tracked if CSP_USE_BUFFER_STATS is enabled.
+*/
+typedef enum {
+	CSP_BUFFER_OWNER_NONE = 0,	//!< Not tagged, e.g. held by the application or in transit through the stack.
+	CSP_BUFFER_OWNER_QFIFO,		//!< Router input queue.
+	CSP_BUFFER_OWNER_CONN_RX,	//!< Connection or socket Rx queue.
+	CSP_BUFFER_OWNER_RDP_TX,	//!< RDP retransmit queue.
+	CSP_BUFFER_OWNER_RDP_RX,	//!< RDP out-of-order Rx queue.
+	CSP_BUFFER_OWNER_PROMISC,	//!< Promiscuous queue.
+	CSP_BUFFER_OWNER_IF_RX,		//!< Interface Rx, e.g. CAN packet buffer or KISS frame being received.
+	CSP_BUFFER_OWNER_COUNT		//!< Number of owners.
+} csp_buffer_owner_t;
+
 /**
    Get free buffer (from task context).
 
+   The buffer is taken from the smallest size class (see csp_conf_t.buffer_classes) that can hold \a data_size,
+   falling back to larger classes if the class is empty. Room for trailers added by the stack (RDP header, CRC32,
+   HMAC, XTEA, etc.) must be included in \a data_size, unless reserved by csp_conf_t.buffer_tailroom.
+
    @param[in] data_size minimum data size of requested buffer.
    @return Buffer (pointer to #csp_packet_t) or NULL if no buffers available or size too big.
 */
@@ -60,34 +86,267 @@ void csp_buffer_free(void *buffer);
 */
 void csp_buffer_free_isr(void *buffer);
 
+/**
+   Get a number of free buffers in one operation (from task context).
+
+   The buffers are taken with a single lock/atomic operation per size class, see csp_buffer_get() for class selection.
+
+   @param[in] data_size minimum data size of requested buffers.
+   @param[out] buffers array for up to \a count buffers (pointers to #csp_packet_t).
+   @param[in] count number of buffers to get.
+   @return number of buffers returned in \a buffers, less than \a count if out of buffers.
+*/
+int csp_buffer_get_n(size_t data_size, void ** buffers, int count);
+
+/**
+   Get a number of free buffers in one operation (from ISR context).
+   @param[in] data_size minimum data size of requested buffers.
+   @param[out] buffers array for up to \a count buffers (pointers to #csp_packet_t).
+   @param[in] count number of buffers to get.
+   @return number of buffers returned in \a buffers.
+*/
+int csp_buffer_get_n_isr(size_t data_size, void ** buffers, int count);
+
+/**
+   Number of buffers validated and released together by csp_buffer_free_n().
+   Also a suitable array size when draining a queue into csp_buffer_free_n().
+*/
+#define CSP_BUFFER_FREE_BATCH	16
+
+/**
+   Free a number of buffers in one operation (from task context).
+   Buffers are returned to their pools with a single lock/atomic operation per size class (and batch).
+   @param[in] buffers array of buffers to free. NULL entries are handled gracefully.
+   @param[in] count number of entries in \a buffers.
+*/
+void csp_buffer_free_n(void * const * buffers, int count);
+
+/**
+   Free a number of buffers in one operation (from ISR context).
+   @param[in] buffers array of buffers to free. NULL entries are handled gracefully.
+   @param[in] count number of entries in \a buffers.
+*/
+void csp_buffer_free_n_isr(void * const * buffers, int count);
+
 /**
    Clone an existing buffer.
-   The existing \a buffer content is copied to the new buffer.
+   The packet header and the used part of the data (\a length bytes) is copied to a new buffer of (at least) the same size class.
    @param[in] buffer buffer to clone.
    @return cloned buffer on success, or NULL on failure.
 */
 void * csp_buffer_clone(void *buffer);
 
+/**
+   Ensure a buffer can hold \a data_size bytes of data.
+   Received packets may be in a buffer that only fits the received data (see csp_conf_t.buffer_classes), so a server
+   reusing the request for a larger reply must call this (or get a new buffer) before writing the reply. Room for trailers
+   added by the stack must be included in \a data_size, as for csp_buffer_get().
+   @param[in] buffer buffer (owned by the caller).
+   @param[in] data_size minimum data size.
+   @return \a buffer if large enough, otherwise a copy (header and data) in a larger buffer - \a buffer is freed.
+   NULL if no buffer could be allocated, \a buffer is freed.
+*/
+void * csp_buffer_resize(void * buffer, size_t data_size);
+
+/**
+   Take an additional reference to a buffer.
+
+   The buffer is returned to its pool, when all references have been released using csp_buffer_free().
+   A shared buffer (more than one reference) must be treated as read-only - including the header (padding, length and id) and
+   the trailer (data following \a length), use csp_buffer_unshare() to get a writable buffer.
+
+   @param[in] buffer buffer (returned by csp_buffer_get()).
+   @return \a buffer, or NULL if \a buffer is invalid.
+*/
+void * csp_buffer_ref(void * buffer);
+
+/**
+   Check if a buffer has more than one reference.
+   @param[in] buffer buffer (returned by csp_buffer_get()).
+   @return true if \a buffer is shared.
+*/
+bool csp_buffer_is_shared(const void * buffer);
+
+/**
+   Get a writable buffer (copy-on-write).
+
+   If the caller holds the only reference, \a buffer is returned. Otherwise \a buffer is cloned using csp_buffer_clone()
+   and the caller's reference to \a buffer is released.
+
+   @param[in] buffer buffer (returned by csp_buffer_get()).
+   @return writable buffer, or NULL if out of buffers - in which case the caller still holds its reference to \a buffer.
+*/
+void * csp_buffer_unshare(void * buffer);
+
+/**
+   Return the headroom of a packet, i.e. number of bytes that can be pushed in front of the current frame start.
+
+   The frame starts at the CSP id (#csp_packet_t.id), and the headroom covers the padding and length field of
+   #csp_packet_t and the extra headroom set by csp_conf_t.buffer_headroom.
+
+   @param[in] packet packet (returned by csp_buffer_get()).
+   @return headroom in bytes.
+*/
+size_t csp_buffer_headroom(const csp_packet_t * packet);
+
+/**
+   Return the tailroom of a packet, i.e. number of bytes that can be appended after the data (\a length).
+   @param[in] packet packet (returned by csp_buffer_get()).
+   @return tailroom in bytes, the data size of the buffer plus csp_conf_t.buffer_tailroom minus \a length.
+*/
+size_t csp_buffer_tailroom(const csp_packet_t * packet);
+
+/**
+   Push (prepend) a header in front of the current frame start, e.g. a link-layer header.
+
+   Pushing overwrites #csp_packet_t.length (and padding), the length is restored when all pushed headers have been pulled
+   again. Use csp_buffer_put()/csp_buffer_trim() to change the data length, while headers are pushed.
+
+   @param[in] packet packet (returned by csp_buffer_get()).
+   @param[in] len header length.
+   @return new frame start, or NULL if there is not enough headroom.
+*/
+void * csp_buffer_push(csp_packet_t * packet, size_t len);
+
+/**
+   Pull (remove) a header pushed by csp_buffer_push().
+   @param[in] packet packet (returned by csp_buffer_get()).
+   @param[in] len header length.
+   @return new frame start, or NULL if \a len exceeds the pushed headers.
+*/
+void * csp_buffer_pull(csp_packet_t * packet, size_t len);
+
+/**
+   Put (append) a trailer after the data and increase the data length.
+   @param[in] packet packet (returned by csp_buffer_get()).
+   @param[in] len trailer length.
+   @return start of the trailer, or NULL if there is not enough tailroom.
+*/
+void * csp_buffer_put(csp_packet_t * packet, size_t len);
+
+/**
+   Trim (remove) a trailer from the end of the data and decrease the data length.
+   @param[in] packet packet (returned by csp_buffer_get()).
+   @param[in] len trailer length.
+   @return start of the removed trailer (still valid until the buffer is modified), or NULL if \a len exceeds the data length.
+*/
+void * csp_buffer_trim(csp_packet_t * packet, size_t len);
+
+/**
+   Buffer pool (size class) statistics.
+*/
+typedef struct {
+	uint16_t data_size;	//!< Data size of the buffers.
+	uint16_t count;		//!< Number of buffers.
+	uint16_t in_use;	//!< Buffers currently in use.
+	uint16_t peak;		//!< High-water mark of \a in_use, i.e. the low-water mark of free buffers is \a count - \a peak.
+	uint32_t gets;		//!< Number of buffers taken from the pool.
+	uint32_t frees;		//!< Number of buffers returned to the pool.
+} csp_buffer_pool_stats_t;
+
+/**
+   Buffer statistics, see csp_buffer_get_stats().
+*/
+typedef struct {
+	uint8_t pool_count;	//!< Number of valid entries in \a pool.
+	csp_buffer_pool_stats_t pool[CSP_BUFFER_CLASSES_MAX]; //!< Pool statistics, sorted by data size.
+	uint32_t failures;	//!< Number of failed csp_buffer_get() calls (out of buffers).
+	uint16_t owner[CSP_BUFFER_OWNER_COUNT]; //!< Buffers in use per owner (#csp_buffer_owner_t), a shared buffer is counted once.
+} csp_buffer_stats_t;
+
+/**
+   Get a snapshot of buffer statistics.
+
+   Data size, count and in-use are always available. Peak, counters and owners are only maintained if compiled with
+   CSP_USE_BUFFER_STATS, otherwise they are 0. The counters are read without locking, so a snapshot taken under load
+   may be slightly inconsistent.
+
+   @param[out] stats statistics.
+   @param[in] owners count buffers per owner (walks all buffers, O(number of buffers)).
+   @return #CSP_ERR_NONE on success, otherwise an error code.
+*/
+int csp_buffer_get_stats(csp_buffer_stats_t * stats, bool owners);
+
+/**
+   Reset buffer statistics, i.e. counters and peak (set to current in use).
+*/
+void csp_buffer_reset_stats(void);
+
+#if (CSP_USE_BUFFER_STATS) || __DOXYGEN__
+/**
+   Tag the current owner of a buffer, used by csp_buffer_get_stats().
+   The owner is reset to #CSP_BUFFER_OWNER_NONE, when the buffer is taken from the pool. A shared buffer has a single tag
+   (the last owner set). Compiles to nothing, unless CSP_USE_BUFFER_STATS is enabled.
+   @param[in] buffer buffer (returned by csp_buffer_get()).
+   @param[in] owner owner.
+*/
+void csp_buffer_set_owner(void * buffer, csp_buffer_owner_t owner);
+#else
+#define csp_buffer_set_owner(buffer, owner) do {} while (0)
+#endif
+
 /**
    Return number of remaining/free buffers.
    The number of buffers is set by csp_init().
-   @return number of remaining/free buffers
+   @return number of remaining/free buffers (all size classes)
 */
 int csp_buffer_remaining(void);
 
 /**
-   Return the size of a CSP buffer.
+   Return number of remaining/free buffers, that can hold at least \a data_size bytes.
+   @param[in] data_size data size.
+   @return number of remaining/free buffers in size classes of \a data_size or larger.
+*/
+int csp_buffer_remaining_size(size_t data_size);
+
+/**
+   Return the size of the largest CSP buffer.
    @return size of a CSP buffer, sizeof(#csp_packet_t) + data_size.
 */
 size_t csp_buffer_size(void);
 
 /**
-   Return the data size of a CSP buffer.
-   The data size is set by csp_init().
+   Return the data size of the largest CSP buffer.
+   The data size is set by csp_init(). A specific buffer may be smaller, see csp_buffer_data_size_of().
    @return data size of a CSP buffer
 */
 size_t csp_buffer_data_size(void);
 
+/**
+   Return the data size of a specific buffer, i.e. the data size of its size class.
+   @param[in] buffer buffer (returned by csp_buffer_get()).
+   @return data size of \a buffer
+*/
+size_t csp_buffer_data_size_of(const void * buffer);
+
+/**
+   Buffer cache statistics.
+   Only available if compiled with #CSP_USE_BUFFER_CACHE.
+*/
+typedef struct {
+	//! Number of gets served from the calling thread's magazine.
+	uint32_t hits;
+	//! Number of magazine refills from the global free list.
+	uint32_t refills;
+	//! Number of magazine drains to the global free list.
+	uint32_t drains;
+	//! Number of buffers freed by another thread than the one that got it.
+	uint32_t cross_thread_frees;
+} csp_buffer_cache_stats_t;
+
+/**
+   Get buffer cache statistics, summed for all threads.
+   @param[out] stats statistics.
+   @return #CSP_ERR_NONE on success, #CSP_ERR_NOTSUP if not compiled with #CSP_USE_BUFFER_CACHE.
+*/
+int csp_buffer_cache_get_stats(csp_buffer_cache_stats_t * stats);
+
+/**
+   Return all buffers in the calling thread's magazine to the global pool.
+   Useful before a thread goes idle for a longer period. Magazines are also flushed on thread exit.
+*/
+void csp_buffer_cache_flush(void);
+
 #ifdef __cplusplus
 }
 #endif
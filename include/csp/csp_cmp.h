@@ -78,6 +78,10 @@ extern "C" {
    Get/set clock.
 */
 #define CSP_CMP_CLOCK 6
+/**
+   Request buffer statistics.
+*/
+#define CSP_CMP_BUF_STATS 7
 /**@}*/
 
 /**
@@ -108,6 +112,16 @@ extern "C" {
 */
 #define CSP_CMP_POKE_MAX_LEN 200
 
+/**
+   CMP buffer statistics - max number of pools (size classes).
+*/
+#define CSP_CMP_BUF_STATS_POOLS 4
+
+/**
+   CMP buffer statistics - max number of owners.
+*/
+#define CSP_CMP_BUF_STATS_OWNERS 8
+
 /**
    CSP management protocol description.
 */
@@ -153,6 +167,19 @@ struct csp_cmp_message {
 			char data[CSP_CMP_POKE_MAX_LEN];
 		} poke;
 		csp_timestamp_t clock;
+		struct __attribute__((__packed__)) {
+			uint8_t pool_count;
+			struct __attribute__((__packed__)) {
+				uint16_t data_size;
+				uint16_t count;
+				uint16_t in_use;
+				uint16_t peak;
+				uint32_t gets;
+				uint32_t frees;
+			} pool[CSP_CMP_BUF_STATS_POOLS];
+			uint32_t failures;
+			uint16_t owner[CSP_CMP_BUF_STATS_OWNERS];
+		} buf_stats;
 	};
 } __attribute__ ((packed));
 
@@ -184,6 +211,7 @@ CMP_MESSAGE(CSP_CMP_IDENT, ident)
 CMP_MESSAGE(CSP_CMP_ROUTE_SET, route_set)
 CMP_MESSAGE(CSP_CMP_IF_STATS, if_stats)
 CMP_MESSAGE(CSP_CMP_CLOCK, clock)
+CMP_MESSAGE(CSP_CMP_BUF_STATS, buf_stats)
 
 /**
    Peek (read) memory on remote node.
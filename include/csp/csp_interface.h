@@ -67,10 +67,25 @@ struct csp_iface_s {
     uint32_t txbytes;          //!< Transmitted bytes
     uint32_t rxbytes;          //!< Received bytes
     uint32_t irq;              //!< Interrupts
+    void * txq;                //!< Internal, TX queue, see csp_iface_txq_start()
+    uint32_t txq_len;          //!< Packets currently in the TX queue
+    uint32_t txq_peak;         //!< Max packets in the TX queue
+    uint32_t txq_drop;         //!< Packets dropped, because the TX queue was full
+    csp_shaper_t * shaper;     //!< Optional rate limit for the interface, see csp_shaper_init()
     struct csp_iface_s *next;  //!< Internal, interfaces are stored in a linked list
 };
 //doc-end:csp_iface_s
 
+/**
+   Add to an interface counter, e.g. csp_iface_stat_add(iface, rx, 1).
+   The counters are updated from interface drivers, router workers and application tasks, so the update is atomic if supported by the compiler.
+*/
+#if (__GCC_ATOMIC_INT_LOCK_FREE == 2)
+#define csp_iface_stat_add(iface, counter, n)	__atomic_add_fetch(&(iface)->counter, (n), __ATOMIC_RELAXED)
+#else
+#define csp_iface_stat_add(iface, counter, n)	((iface)->counter += (n))
+#endif
+
 /**
    Inputs a new packet into the system.
 
@@ -88,6 +103,33 @@ struct csp_iface_s {
 */
 void csp_qfifo_write(csp_packet_t *packet, csp_iface_t *iface, CSP_BASE_TYPE *pxTaskWoken);
 
+/**
+   Start TX queue and drain task for an interface.
+
+   Packets sent on the interface are queued and transmitted by a dedicated task, instead of calling the interface Tx function from the
+   sending task (e.g. the router). A slow interface will therefore not block traffic on other interfaces.
+   The queue is served in priority order (csp_id_t.pri). When the queue is full, the packet is dropped - unless a packet with
+   lower priority is queued, in which case the newest packet with the lowest priority is dropped instead.
+
+   @param[in] iface interface, must be added (csp_iflist_add()) before sending.
+   @param[in] length max number of queued packets.
+   @param[in] task_stack_size stack size for the drain task, see csp_thread_create() for details on the stack size parameter.
+   @param[in] task_priority priority for the drain task, see csp_thread_create() for details on the priority parameter.
+   @return #CSP_ERR_NONE on success, otherwise an error code.
+*/
+int csp_iface_txq_start(csp_iface_t * iface, unsigned int length, unsigned int task_stack_size, unsigned int task_priority);
+
+/**
+   Stop TX queue and drain task for an interface.
+
+   Waits for the drain task to finish the packet being transmitted, frees the packets still queued and the queue itself.
+   Packets are sent directly on the interface afterwards. Must not be called while other tasks are sending on the interface.
+
+   @param[in] iface interface.
+   @return #CSP_ERR_NONE on success, #CSP_ERR_INVAL if the interface has no TX queue.
+*/
+int csp_iface_txq_stop(csp_iface_t * iface);
+
 #ifdef __cplusplus
 }
 #endif
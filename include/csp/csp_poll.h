@@ -0,0 +1,144 @@
+/*
+Cubesat Space Protocol - A small network-layer protocol designed for Cubesats
+Copyright (C) 2012 Gomspace ApS (http://www.gomspace.com)
+Copyright (C) 2012 AAUSAT3 Project (http://aausat3.space.aau.dk)
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef _CSP_POLL_H_
+#define _CSP_POLL_H_
+
+/**
+   @file
+
+   Readiness based multiplexing of sockets and connections.
+
+   A poll set lets a single task wait for many sockets and connections, instead of blocking in csp_accept()/csp_read()
+   per socket/connection. Sockets and connections are added to the set with csp_poll_add(), and csp_poll_wait() returns
+   the ones that are ready. All members of a set share a single wakeup semaphore, which is signalled by the router when
+   a packet or a new connection is queued, or the RDP TX window opens.
+
+   Events are level triggered, i.e. a connection is reported by every call to csp_poll_wait(), as long as it is ready.
+   A socket or connection can only be member of one set, and is removed automatically by csp_close().
+
+   On Linux, a poll set can be integrated in an external event loop (epoll, libuv, etc.) using csp_poll_get_fd().
+*/
+
+#include <csp/csp_types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+   @defgroup CSP_POLL_EVENTS Poll events.
+   @{
+*/
+#define CSP_POLLIN	0x01	/**< Packet ready for csp_read()/csp_recvfrom(), or new connection ready for csp_accept() */
+#define CSP_POLLOUT	0x02	/**< csp_send() will not block on the RDP TX window, always set for non-RDP connections */
+#define CSP_POLLHUP	0x04	/**< RDP connection closed by the other end or timed out, always reported */
+/**@}*/
+
+/**
+   Poll set (opaque).
+*/
+typedef struct csp_poll_s csp_poll_t;
+
+/**
+   Poll event, returned by csp_poll_wait().
+*/
+typedef struct {
+	csp_conn_t * conn;		/**< Socket or connection */
+	uint8_t events;			/**< Ready events, see @ref CSP_POLL_EVENTS */
+	void * context;			/**< User context, see csp_poll_add() */
+} csp_poll_event_t;
+
+/**
+   Create poll set.
+   @return poll set, NULL on failure.
+*/
+csp_poll_t * csp_poll_create(void);
+
+/**
+   Destroy poll set.
+   Remaining members are removed from the set. No task may be waiting on the set.
+   @param[in] poll poll set.
+*/
+void csp_poll_destroy(csp_poll_t * poll);
+
+/**
+   Add socket or connection to poll set.
+   @param[in] poll poll set.
+   @param[in] conn socket or connection.
+   @param[in] events events to wait for, see @ref CSP_POLL_EVENTS.
+   @param[in] context user context, returned in #csp_poll_event_t.
+   @return #CSP_ERR_NONE on success, #CSP_ERR_USED if already member of a set, otherwise an error code.
+*/
+int csp_poll_add(csp_poll_t * poll, csp_conn_t * conn, uint8_t events, void * context);
+
+/**
+   Change events and context of a member of poll set.
+   @param[in] poll poll set.
+   @param[in] conn socket or connection.
+   @param[in] events events to wait for, see @ref CSP_POLL_EVENTS.
+   @param[in] context user context, returned in #csp_poll_event_t.
+   @return #CSP_ERR_NONE on success, otherwise an error code.
+*/
+int csp_poll_modify(csp_poll_t * poll, csp_conn_t * conn, uint8_t events, void * context);
+
+/**
+   Remove socket or connection from poll set.
+   @param[in] poll poll set.
+   @param[in] conn socket or connection.
+   @return #CSP_ERR_NONE on success, otherwise an error code.
+*/
+int csp_poll_remove(csp_poll_t * poll, csp_conn_t * conn);
+
+/**
+   Wait for sockets or connections in poll set to become ready.
+   Only one task should wait on a poll set at a time.
+   @param[in] poll poll set.
+   @param[out] events array for up to \a max ready events.
+   @param[in] max max number of events.
+   @param[in] timeout timeout in mS to wait for an event, #CSP_MAX_TIMEOUT to wait forever.
+   @return number of events (0 on timeout), otherwise an error code.
+*/
+int csp_poll_wait(csp_poll_t * poll, csp_poll_event_t * events, unsigned int max, uint32_t timeout);
+
+/**
+   Interrupt csp_poll_wait().
+   The task waiting on the poll set (or the next csp_poll_wait(), if none is waiting) returns, with 0 events if no member
+   is ready. Used to make the waiting task re-evaluate its timeout, e.g. after adding work from another task.
+   @param[in] poll poll set.
+*/
+void csp_poll_interrupt(csp_poll_t * poll);
+
+/**
+   Get file descriptor for poll set (Linux only).
+   Returns an eventfd, that becomes readable when members of the set may be ready. It can be registered in an external
+   event loop (epoll, libuv, etc.), which should call csp_poll_wait() with timeout 0 when the descriptor is readable.
+   csp_poll_wait() clears the descriptor, and keeps it readable as long as members are ready (level triggered).
+   For a descriptor per socket or connection, use a set with a single member.
+   The descriptor is created on first call, and closed by csp_poll_destroy().
+   @param[in] poll poll set.
+   @return file descriptor (>= 0), #CSP_ERR_NOTSUP if not supported on the platform, otherwise an error code.
+*/
+int csp_poll_get_fd(csp_poll_t * poll);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -27,8 +27,9 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
    Promiscuous packet queue.
 
    This function is used to enable promiscuous mode for incoming packets, e.g. router, bridge.
-   If enabled, a copy of all incoming packets are cloned (using csp_buffer_clone()) and placed in a
-   FIFO queue, that can be read using csp_promisc_read().
+   If enabled, a reference to all incoming packets (see csp_buffer_ref()) is placed in a FIFO queue, that can be
+   read using csp_promisc_read(). The packets are shared with the stack and must be treated as read-only, use
+   csp_buffer_unshare() before modifying or re-using a packet.
 */
 
 #include <csp/csp_types.h>
@@ -46,6 +47,7 @@ int csp_promisc_enable(unsigned int queue_size);
 
 /**
    Disable promiscuous mode.
+   Packets still in the queue are freed.
 */
 void csp_promisc_disable(void);
 
@@ -54,10 +56,20 @@ void csp_promisc_disable(void);
 
    Returns the first packet from the promiscuous packet queue.
    @param[in] timeout Timeout in ms to wait for a packet.
-   @return Packet (free with csp_buffer_free() or re-use packet), NULL on error or timeout.
+   @return Packet (read-only, free with csp_buffer_free()), NULL on error or timeout.
 */
 csp_packet_t *csp_promisc_read(uint32_t timeout);
 
+/**
+   Get/dequeue a number of packets from promiscuous packet queue in one operation.
+
+   @param[out] packets array for up to \a count packets (read-only, free with csp_buffer_free_n()).
+   @param[in] count max number of packets to read.
+   @param[in] timeout Timeout in ms to wait for the first packet.
+   @return Number of packets read, 0 on error or timeout.
+*/
+int csp_promisc_read_n(csp_packet_t ** packets, int count, uint32_t timeout);
+
 #ifdef __cplusplus
 }
 #endif
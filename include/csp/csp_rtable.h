@@ -57,6 +57,8 @@ struct csp_route_s {
     csp_iface_t * iface;
     /** If different from #CSP_NO_VIA_ADDRESS, send packet to this address, instead of the destination address in the CSP header. */
     uint8_t via;
+    /** Optional rate limit for the route, see csp_rtable_set_shaper(). */
+    csp_shaper_t * shaper;
 };
 
 /**
@@ -76,6 +78,16 @@ const csp_route_t * csp_rtable_find_route(uint8_t dest_address);
 */
 int csp_rtable_set(uint8_t dest_address, uint8_t mask, csp_iface_t *ifc, uint8_t via);
 
+/**
+   Set rate limit (shaper) on an existing route.
+   The route must match exactly (address and mask), the shaper must remain valid as long as the route exists.
+   @param[in] dest_address destination address.
+   @param[in] mask number of bits in netmask
+   @param[in] shaper shaper, see csp_shaper_init(). NULL removes the shaper.
+   @return #CSP_ERR_NONE on success, or an error code.
+*/
+int csp_rtable_set_shaper(uint8_t dest_address, uint8_t mask, csp_shaper_t * shaper);
+
 /**
    Save routing table as a string (readable format).
    @see csp_rtable_load() for additional information, e.g. format.
@@ -0,0 +1,102 @@
+/*
+Cubesat Space Protocol - A small network-layer protocol designed for Cubesats
+Copyright (C) 2012 Gomspace ApS (http://www.gomspace.com)
+Copyright (C) 2012 AAUSAT3 Project (http://aausat3.space.aau.dk) 
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef _CSP_SHAPER_H_
+#define _CSP_SHAPER_H_
+
+/**
+   @file
+
+   Token bucket rate limiting (traffic shaping).
+
+   A shaper can be attached to an interface (csp_iface_t.shaper) and/or a route (csp_rtable_set_shaper()), limiting
+   the rate of packets sent by csp_send_direct().
+   If the interface has a TX queue (csp_iface_txq_start()), packets exceeding the rate are delayed by the TX queue task (shaped).
+   Otherwise packets exceeding the rate are dropped (policed).
+*/
+
+#include <csp/csp_types.h>
+#include <csp/arch/csp_semaphore.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+   Token bucket shaper.
+   Initialize with csp_shaper_init(), the remaining members are read-only.
+*/
+struct csp_shaper_s {
+	uint32_t rate_bytes;		/**< Bytes per second, 0 = unlimited. */
+	uint32_t rate_packets;		/**< Packets per second, 0 = unlimited. */
+	uint32_t burst_bytes;		/**< Max burst (bucket size) in bytes. */
+	uint32_t burst_packets;		/**< Max burst (bucket size) in packets. */
+	uint32_t shaped;		/**< Packets delayed to conform to the rate. */
+	uint32_t dropped;		/**< Packets dropped, because they exceeded the rate. */
+	int64_t tokens_bytes;		/**< Internal, available bytes * 1000. */
+	int64_t tokens_packets;		/**< Internal, available packets * 1000. */
+	uint32_t timestamp;		/**< Internal, time of last refill (mS). */
+	csp_mutex_t lock;		/**< Internal. */
+};
+
+/**
+   Initialize shaper.
+   The bucket starts full.
+   @param[out] shaper shaper.
+   @param[in] rate_bytes bytes per second, 0 = unlimited.
+   @param[in] rate_packets packets per second, 0 = unlimited.
+   @param[in] burst_bytes max burst in bytes, should be at least the largest packet (MTU). 0 = one second of \a rate_bytes.
+   @param[in] burst_packets max burst in packets. 0 = one second of \a rate_packets.
+   @return #CSP_ERR_NONE on success, otherwise an error code.
+*/
+int csp_shaper_init(csp_shaper_t * shaper, uint32_t rate_bytes, uint32_t rate_packets, uint32_t burst_bytes, uint32_t burst_packets);
+
+/**
+   Police packet, i.e. check if the packet conforms to the rate without waiting.
+   @param[in] shaper shaper, NULL is allowed (unlimited).
+   @param[in] bytes packet size.
+   @return true if the packet conforms (tokens are taken), false if the packet exceeds the rate and should be dropped (counted in csp_shaper_t.dropped).
+*/
+bool csp_shaper_police(csp_shaper_t * shaper, uint16_t bytes);
+
+/**
+   Police packet against two shapers (e.g. route and interface), see csp_shaper_police().
+   Tokens are only taken if the packet conforms to both shapers. Both shapers are locked while checking and taking tokens,
+   so concurrent senders can't overdraw the buckets.
+   @param[in] first shaper, NULL is allowed (unlimited).
+   @param[in] second shaper, NULL is allowed (unlimited). May be the same as \a first.
+   @param[in] bytes packet size.
+   @return true if the packet conforms to both shapers (tokens are taken), false if the packet exceeds a rate and should be
+   dropped (counted in csp_shaper_t.dropped of the exceeded shaper(s)).
+*/
+bool csp_shaper_police_pair(csp_shaper_t * first, csp_shaper_t * second, uint16_t bytes);
+
+/**
+   Wait until the packet conforms to the rate, and take the tokens.
+   Waits are counted in csp_shaper_t.shaped.
+   @param[in] shaper shaper, NULL is allowed (unlimited).
+   @param[in] bytes packet size.
+*/
+void csp_shaper_wait(csp_shaper_t * shaper, uint16_t bytes);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
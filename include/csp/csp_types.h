@@ -250,6 +250,8 @@ typedef struct {
 typedef struct csp_iface_s csp_iface_t;
 /** Forward declaration of outgoing CSP route, see #csp_route_s for details. */
 typedef struct csp_route_s csp_route_t;
+/** Forward declaration of token bucket shaper, see #csp_shaper_s for details. */
+typedef struct csp_shaper_s csp_shaper_t;
 
 /** Forward declaration of socket structure */
 typedef struct csp_conn_s csp_socket_t;
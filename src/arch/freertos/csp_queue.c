@@ -51,6 +51,47 @@ int csp_queue_dequeue_isr(csp_queue_handle_t handle, void * buf, CSP_BASE_TYPE *
 	return xQueueReceiveFromISR(handle, buf, task_woken);
 }
 
+int csp_queue_enqueue_n(csp_queue_handle_t handle, void * const * values, int count) {
+	/* Queue API must not be called from a critical section, so the batch isn't atomic - like the ISR variant */
+	int n = 0;
+	for (; n < count; ++n) {
+		if (xQueueSendToBack(handle, &values[n], 0) != pdTRUE)
+			break;
+	}
+	return n;
+}
+
+int csp_queue_enqueue_n_isr(csp_queue_handle_t handle, void * const * values, int count, CSP_BASE_TYPE * task_woken) {
+	int n = 0;
+	for (; n < count; ++n) {
+		if (xQueueSendToBackFromISR(handle, &values[n], task_woken) != pdTRUE)
+			break;
+	}
+	return n;
+}
+
+int csp_queue_dequeue_n(csp_queue_handle_t handle, void ** buf, int count, uint32_t timeout) {
+	if (count <= 0)
+		return 0;
+	if (csp_queue_dequeue(handle, buf, timeout) != pdTRUE)
+		return 0;
+	int n = 1;
+	for (; n < count; ++n) {
+		if (xQueueReceive(handle, &buf[n], 0) != pdTRUE)
+			break;
+	}
+	return n;
+}
+
+int csp_queue_dequeue_n_isr(csp_queue_handle_t handle, void ** buf, int count, CSP_BASE_TYPE * task_woken) {
+	int n = 0;
+	for (; n < count; ++n) {
+		if (xQueueReceiveFromISR(handle, &buf[n], task_woken) != pdTRUE)
+			break;
+	}
+	return n;
+}
+
 int csp_queue_size(csp_queue_handle_t handle) {
 	return uxQueueMessagesWaiting(handle);
 }
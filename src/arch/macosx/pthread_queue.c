@@ -167,6 +167,54 @@ int pthread_queue_dequeue(pthread_queue_t * queue, void * buf, uint32_t timeout)
 	
 }
 
+int pthread_queue_enqueue_n(pthread_queue_t * queue, const void * values, int count) {
+
+	int n = 0;
+
+	/* Get queue lock */
+	pthread_mutex_lock(&(queue->mutex));
+	for (; (n < count) && (queue->items < queue->size); ++n) {
+		memcpy(queue->buffer+(queue->in * queue->item_size), (const char *) values + (n * queue->item_size), queue->item_size);
+		queue->items++;
+		queue->in = (queue->in + 1) % queue->size;
+	}
+	pthread_mutex_unlock(&(queue->mutex));
+
+	/* Nofify blocked threads */
+	if (n > 0)
+		pthread_cond_broadcast(&(queue->cond_empty));
+
+	return n;
+
+}
+
+int pthread_queue_dequeue_n(pthread_queue_t * queue, void * buf, int count, uint32_t timeout) {
+
+	if (count <= 0)
+		return 0;
+
+	/* Wait for the first element */
+	if (pthread_queue_dequeue(queue, buf, timeout) != PTHREAD_QUEUE_OK)
+		return 0;
+
+	/* Take any remaining elements */
+	int n = 1;
+	pthread_mutex_lock(&(queue->mutex));
+	for (; (n < count) && (queue->items > 0); ++n) {
+		memcpy((char *) buf + (n * queue->item_size), queue->buffer+(queue->out * queue->item_size), queue->item_size);
+		queue->items--;
+		queue->out = (queue->out + 1) % queue->size;
+	}
+	pthread_mutex_unlock(&(queue->mutex));
+
+	/* Nofify blocked threads */
+	if (n > 1)
+		pthread_cond_broadcast(&(queue->cond_full));
+
+	return n;
+
+}
+
 int pthread_queue_items(pthread_queue_t * queue) {
 
 	pthread_mutex_lock(&(queue->mutex));
@@ -50,6 +50,27 @@ int csp_queue_dequeue_isr(csp_queue_handle_t handle, void * buf, CSP_BASE_TYPE *
 	return windows_queue_dequeue(handle, buf, 0);
 }
 
+int csp_queue_enqueue_n(csp_queue_handle_t handle, void * const * values, int count) {
+	return windows_queue_enqueue_n(handle, values, count);
+}
+
+int csp_queue_enqueue_n_isr(csp_queue_handle_t handle, void * const * values, int count, CSP_BASE_TYPE * task_woken) {
+	if( task_woken != NULL )
+		*task_woken = 0;
+	return windows_queue_enqueue_n(handle, values, count);
+}
+
+int csp_queue_dequeue_n(csp_queue_handle_t handle, void ** buf, int count, uint32_t timeout) {
+	return windows_queue_dequeue_n(handle, buf, count, timeout);
+}
+
+int csp_queue_dequeue_n_isr(csp_queue_handle_t handle, void ** buf, int count, CSP_BASE_TYPE * task_woken) {
+	if (task_woken != NULL) {
+		*task_woken = 0;
+	}
+	return windows_queue_dequeue_n(handle, buf, count, 0);
+}
+
 int csp_queue_size(csp_queue_handle_t handle) {
 	return windows_queue_items(handle);
 }
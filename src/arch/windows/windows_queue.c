@@ -116,6 +116,44 @@ int windows_queue_dequeue(windows_queue_t * queue, void * buf, int timeout) {
 	return WINDOWS_QUEUE_OK;
 }
 
+int windows_queue_enqueue_n(windows_queue_t * queue, const void * values, int count) {
+
+	int n = 0;
+	EnterCriticalSection(&(queue->mutex));
+	for (; (n < count) && !queueFull(queue); ++n) {
+		int offset = ((queue->head_idx+queue->items) % queue->size) * queue->item_size;
+		memcpy((unsigned char*)queue->buffer + offset, (const unsigned char*)values + (n * queue->item_size), queue->item_size);
+		queue->items++;
+	}
+
+	LeaveCriticalSection(&(queue->mutex));
+	if (n > 0)
+		WakeAllConditionVariable(&(queue->cond_empty));
+	return n;
+}
+
+int windows_queue_dequeue_n(windows_queue_t * queue, void * buf, int count, int timeout) {
+
+	int n = 0;
+	EnterCriticalSection(&(queue->mutex));
+	while(queueEmpty(queue)) {
+		int ret = SleepConditionVariableCS(&(queue->cond_empty), &(queue->mutex), timeout);
+		if( !ret ) {
+			LeaveCriticalSection(&(queue->mutex));
+			return 0;
+		}
+	}
+	for (; (n < count) && !queueEmpty(queue); ++n) {
+		memcpy((unsigned char*)buf + (n * queue->item_size), (unsigned char*)queue->buffer+(queue->head_idx%queue->size*queue->item_size), queue->item_size);
+		queue->items--;
+		queue->head_idx = (queue->head_idx + 1) % queue->size;
+	}
+
+	LeaveCriticalSection(&(queue->mutex));
+	WakeAllConditionVariable(&(queue->cond_full));
+	return n;
+}
+
 int windows_queue_items(windows_queue_t * queue) {
 
 	int items;
@@ -38,6 +38,8 @@ windows_queue_t * windows_queue_create(int length, size_t item_size);
 void windows_queue_delete(windows_queue_t * q);
 int windows_queue_enqueue(windows_queue_t * queue, const void * value, int timeout);
 int windows_queue_dequeue(windows_queue_t * queue, void * buf, int timeout);
+int windows_queue_enqueue_n(windows_queue_t * queue, const void * values, int count);
+int windows_queue_dequeue_n(windows_queue_t * queue, void * buf, int count, int timeout);
 int windows_queue_items(windows_queue_t * queue);
 
 #ifdef __cplusplus
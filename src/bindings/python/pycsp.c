@@ -792,6 +792,43 @@ static PyObject* pycsp_cmp_clock_get(PyObject *self, PyObject *args) {
                          csp_ntoh32(msg.clock.tv_nsec));
 }
 
+static PyObject* pycsp_cmp_buf_stats(PyObject *self, PyObject *args) {
+    uint8_t node;
+    uint32_t timeout = 1000;
+    if (!PyArg_ParseTuple(args, "b|I", &node, &timeout)) {
+        Py_RETURN_NONE;
+    }
+
+    struct csp_cmp_message msg;
+    memset(&msg, 0, sizeof(msg));
+
+    int res;
+    Py_BEGIN_ALLOW_THREADS;
+    res = csp_cmp_buf_stats(node, timeout, &msg);
+    Py_END_ALLOW_THREADS;
+    if (res != CSP_ERR_NONE) {
+        return PyErr_Error("csp_cmp_buf_stats()", res);
+    }
+
+    const unsigned int pool_count = (msg.buf_stats.pool_count < CSP_CMP_BUF_STATS_POOLS) ? msg.buf_stats.pool_count : CSP_CMP_BUF_STATS_POOLS;
+    PyObject * pools = PyList_New(pool_count);
+    for (unsigned int i = 0; i < pool_count; ++i) {
+        PyList_SetItem(pools, i, Py_BuildValue("HHHHII",
+                                               csp_ntoh16(msg.buf_stats.pool[i].data_size),
+                                               csp_ntoh16(msg.buf_stats.pool[i].count),
+                                               csp_ntoh16(msg.buf_stats.pool[i].in_use),
+                                               csp_ntoh16(msg.buf_stats.pool[i].peak),
+                                               csp_ntoh32(msg.buf_stats.pool[i].gets),
+                                               csp_ntoh32(msg.buf_stats.pool[i].frees)));
+    }
+    PyObject * owners = PyList_New(CSP_CMP_BUF_STATS_OWNERS);
+    for (unsigned int i = 0; i < CSP_CMP_BUF_STATS_OWNERS; ++i) {
+        PyList_SetItem(owners, i, Py_BuildValue("H", csp_ntoh16(msg.buf_stats.owner[i])));
+    }
+
+    return Py_BuildValue("INN", csp_ntoh32(msg.buf_stats.failures), pools, owners);
+}
+
 static PyObject* pycsp_zmqhub_init(PyObject *self, PyObject *args) {
     char addr;
     char* host;
@@ -852,7 +889,7 @@ static PyObject* pycsp_packet_set_data(PyObject *self, PyObject *args) {
     if (packet == NULL) {
         return NULL; // TypeError is thrown
     }
-    if (data.len > (int)csp_buffer_data_size()) {
+    if (data.len > (int)csp_buffer_data_size_of(packet)) {
         return PyErr_Error("packet_set_data() - exceeding data size", CSP_ERR_INVAL);
     }
 
@@ -945,6 +982,7 @@ static PyMethodDef methods[] = {
     {"cmp_poke",            pycsp_cmp_poke,            METH_VARARGS, ""},
     {"cmp_clock_set",       pycsp_cmp_clock_set,       METH_VARARGS, ""},
     {"cmp_clock_get",       pycsp_cmp_clock_get,       METH_VARARGS, ""},
+    {"cmp_buf_stats",       pycsp_cmp_buf_stats,       METH_VARARGS, ""},
 
     /* csp/interfaces/csp_if_zmqhub.h */
     {"zmqhub_init",         pycsp_zmqhub_init,         METH_VARARGS, ""},
@@ -1053,6 +1091,15 @@ PyMODINIT_FUNC PyInit_libcsp_py3(void) {
     PyModule_AddIntConstant(m, "CSP_ERR_CRC32", CSP_ERR_CRC32);
     PyModule_AddIntConstant(m, "CSP_ERR_SFP", CSP_ERR_SFP);
 
+    /* csp/csp_buffer.h */
+    PyModule_AddIntConstant(m, "CSP_BUFFER_OWNER_NONE", CSP_BUFFER_OWNER_NONE);
+    PyModule_AddIntConstant(m, "CSP_BUFFER_OWNER_QFIFO", CSP_BUFFER_OWNER_QFIFO);
+    PyModule_AddIntConstant(m, "CSP_BUFFER_OWNER_CONN_RX", CSP_BUFFER_OWNER_CONN_RX);
+    PyModule_AddIntConstant(m, "CSP_BUFFER_OWNER_RDP_TX", CSP_BUFFER_OWNER_RDP_TX);
+    PyModule_AddIntConstant(m, "CSP_BUFFER_OWNER_RDP_RX", CSP_BUFFER_OWNER_RDP_RX);
+    PyModule_AddIntConstant(m, "CSP_BUFFER_OWNER_PROMISC", CSP_BUFFER_OWNER_PROMISC);
+    PyModule_AddIntConstant(m, "CSP_BUFFER_OWNER_IF_RX", CSP_BUFFER_OWNER_IF_RX);
+
     /* misc */
     PyModule_AddIntConstant(m, "CSP_NODE_MAC", CSP_NODE_MAC);
     PyModule_AddIntConstant(m, "CSP_NO_VIA_ADDRESS", CSP_NO_VIA_ADDRESS);
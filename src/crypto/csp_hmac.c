@@ -145,7 +145,7 @@ int csp_hmac_set_key(const void * key, uint32_t keylen) {
 
 int csp_hmac_append(csp_packet_t * packet, bool include_header) {
 
-	if ((packet->length + (unsigned int)CSP_HMAC_LENGTH) > csp_buffer_data_size()) {
+	if (csp_buffer_tailroom(packet) < (unsigned int)CSP_HMAC_LENGTH) {
 		return CSP_ERR_NOMEM;
 	}
 
@@ -158,8 +158,7 @@ int csp_hmac_append(csp_packet_t * packet, bool include_header) {
 	}
 
 	/* Truncate hash and copy to packet */
-	memcpy(&packet->data[packet->length], hmac, CSP_HMAC_LENGTH);
-	packet->length += CSP_HMAC_LENGTH;
+	memcpy(csp_buffer_put(packet, CSP_HMAC_LENGTH), hmac, CSP_HMAC_LENGTH);
 
 	return CSP_ERR_NONE;
 
@@ -187,7 +186,7 @@ int csp_hmac_verify(csp_packet_t * packet, bool include_header) {
 	}
 
 	/* Strip HMAC */
-	packet->length -= CSP_HMAC_LENGTH;
+	csp_buffer_trim(packet, CSP_HMAC_LENGTH);
 	return CSP_ERR_NONE;
 
 }
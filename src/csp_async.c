@@ -0,0 +1,543 @@
+/*
+Cubesat Space Protocol - A small network-layer protocol designed for Cubesats
+Copyright (C) 2012 Gomspace ApS (http://www.gomspace.com)
+Copyright (C) 2012 AAUSAT3 Project (http://aausat3.space.aau.dk)
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include <csp/csp_async.h>
+
+#include <string.h>
+#include <csp/csp.h>
+#include <csp/arch/csp_malloc.h>
+#include <csp/arch/csp_semaphore.h>
+#include <csp/arch/csp_time.h>
+#include "csp_timer.h"
+
+/**
+   Timer wheel tick (resolution of transaction timeouts).
+*/
+#define CSP_ASYNC_TICK_MS	10
+
+/**
+   Max poll events handled per wakeup.
+*/
+#define CSP_ASYNC_EVENTS	16
+
+/**
+   Transaction.
+*/
+typedef struct csp_async_txn_s {
+	csp_timer_t timer;		/**< Reply timeout */
+	csp_async_t * async;		/**< Engine */
+	csp_conn_t * conn;		/**< Connection */
+	bool own_conn;			/**< Connection opened by the engine, closed on completion */
+	bool active;			/**< Waiting for reply */
+	uint16_t id;			/**< Request id */
+	uint32_t seq;			/**< Send order, used for matching replies in order */
+	int inlen;			/**< Expected reply length, -1 for any */
+	int result;			/**< Result, when completed */
+	csp_packet_t * reply;		/**< Reply, when completed */
+	csp_async_cb_t callback;
+	void * context;
+	struct csp_async_txn_s * next;	/**< Free list or completed list */
+} csp_async_txn_t;
+
+struct csp_async_s {
+	csp_mutex_t lock;		/**< Protects the transactions and the timer wheel */
+	csp_mutex_t send_lock;		/**< Keeps send order and registration order the same */
+	csp_poll_t * poll;		/**< Connections with outstanding transactions */
+	csp_timer_wheel_t wheel;	/**< Transaction timeouts */
+	csp_async_txn_t * txns;		/**< Transaction pool */
+	unsigned int max;
+	unsigned int used;		/**< Transactions not on the free list */
+	csp_async_txn_t * free;		/**< Free transactions */
+	csp_async_txn_t * done;		/**< Completed transactions, waiting for callback */
+	csp_async_txn_t * done_tail;
+	int id_offset;			/**< Offset of request id in data, or CSP_ASYNC_NO_REQUEST_ID */
+	uint16_t next_id;
+	uint32_t next_seq;
+};
+
+/* Return true if the connection has active transactions - call with lock held */
+static bool csp_async_conn_active(csp_async_t * async, csp_conn_t * conn) {
+
+	for (unsigned int i = 0; i < async->max; i++) {
+		if (async->txns[i].active && (async->txns[i].conn == conn)) {
+			return true;
+		}
+	}
+
+	return false;
+
+}
+
+/* Complete transaction, the callback is called by csp_async_run() - call with lock held */
+static void csp_async_complete(csp_async_t * async, csp_async_txn_t * txn, int result, csp_packet_t * reply) {
+
+	txn->active = false;
+	txn->result = result;
+	txn->reply = reply;
+	csp_timer_stop(&async->wheel, &txn->timer);
+
+	/* Stop polling the connection, own connections are closed after the callback */
+	if (txn->own_conn || !csp_async_conn_active(async, txn->conn)) {
+		csp_poll_remove(async->poll, txn->conn);
+	}
+
+	txn->next = NULL;
+	if (async->done_tail) {
+		async->done_tail->next = txn;
+	} else {
+		async->done = txn;
+	}
+	async->done_tail = txn;
+
+}
+
+static void csp_async_timeout(csp_timer_t * timer, void * context) {
+
+	csp_async_txn_t * txn = context;
+	csp_async_t * async = txn->async;
+	csp_async_complete(async, txn, CSP_ERR_TIMEDOUT, NULL);
+
+	/* Replies matched in order: a late reply would be matched to the next transaction, so fail the remaining ones */
+	if (!txn->own_conn && (async->id_offset < 0)) {
+		for (unsigned int i = 0; i < async->max; i++) {
+			csp_async_txn_t * other = &async->txns[i];
+			if (other->active && (other->conn == txn->conn)) {
+				csp_async_complete(async, other, CSP_ERR_TIMEDOUT, NULL);
+			}
+		}
+	}
+
+}
+
+/* Return transaction to free list - call with lock held */
+static void csp_async_release(csp_async_t * async, csp_async_txn_t * txn) {
+
+	txn->conn = NULL;
+	txn->next = async->free;
+	async->free = txn;
+	async->used--;
+
+}
+
+/* Call callbacks of completed transactions */
+static int csp_async_callbacks(csp_async_t * async) {
+
+	int completed = 0;
+
+	for (;;) {
+		csp_mutex_lock(&async->lock, CSP_MAX_TIMEOUT);
+		csp_async_txn_t * txn = async->done;
+		if (txn) {
+			async->done = txn->next;
+			if (async->done == NULL) {
+				async->done_tail = NULL;
+			}
+		}
+		csp_mutex_unlock(&async->lock);
+
+		if (txn == NULL) {
+			break;
+		}
+
+		if (txn->own_conn) {
+			csp_close(txn->conn);
+		}
+
+		/* Callback may start new transactions */
+		txn->callback(txn->result, txn->reply, txn->context);
+		if (txn->reply) {
+			csp_buffer_free(txn->reply);
+		}
+
+		csp_mutex_lock(&async->lock, CSP_MAX_TIMEOUT);
+		csp_async_release(async, txn);
+		csp_mutex_unlock(&async->lock);
+
+		completed++;
+	}
+
+	return completed;
+
+}
+
+/* Find transaction for reply - call with lock held */
+static csp_async_txn_t * csp_async_match(csp_async_t * async, csp_conn_t * conn, const csp_packet_t * reply) {
+
+	csp_async_txn_t * match = NULL;
+
+	bool by_id = false;
+	uint16_t id = 0;
+	if (async->id_offset >= 0) {
+		if (reply->length >= (async->id_offset + 2)) {
+			by_id = true;
+			id = (reply->data[async->id_offset] << 8) | reply->data[async->id_offset + 1];
+		}
+	}
+
+	for (unsigned int i = 0; i < async->max; i++) {
+		csp_async_txn_t * txn = &async->txns[i];
+		if (!txn->active || (txn->conn != conn)) {
+			continue;
+		}
+		if (txn->own_conn) {
+			/* Only one transaction per connection */
+			return txn;
+		}
+		if (by_id) {
+			if (txn->id == id) {
+				return txn;
+			}
+		} else if ((async->id_offset < 0) && ((match == NULL) || ((int32_t)(txn->seq - match->seq) < 0))) {
+			/* Oldest transaction */
+			match = txn;
+		}
+	}
+
+	return match;
+
+}
+
+/* Read replies from connection */
+static void csp_async_receive(csp_async_t * async, csp_conn_t * conn, uint8_t events) {
+
+	if (events & CSP_POLLIN) {
+		csp_packet_t * packet;
+		while ((packet = csp_read(conn, 0)) != NULL) {
+			csp_mutex_lock(&async->lock, CSP_MAX_TIMEOUT);
+			csp_async_txn_t * txn = csp_async_match(async, conn, packet);
+			if (txn) {
+				if ((txn->inlen != -1) && ((int)packet->length != txn->inlen)) {
+					csp_log_error("Reply length %u expected %d", packet->length, txn->inlen);
+					csp_buffer_free(packet);
+					csp_async_complete(async, txn, CSP_ERR_INVAL, NULL);
+				} else {
+					csp_async_complete(async, txn, CSP_ERR_NONE, packet);
+				}
+			}
+			csp_mutex_unlock(&async->lock);
+			if (txn == NULL) {
+				csp_log_warn("No transaction for reply from %u, dropped", packet->id.src);
+				csp_buffer_free(packet);
+			}
+		}
+	}
+
+	if (events & CSP_POLLHUP) {
+		csp_mutex_lock(&async->lock, CSP_MAX_TIMEOUT);
+		for (unsigned int i = 0; i < async->max; i++) {
+			csp_async_txn_t * txn = &async->txns[i];
+			if (txn->active && (txn->conn == conn)) {
+				csp_async_complete(async, txn, CSP_ERR_RESET, NULL);
+			}
+		}
+		csp_mutex_unlock(&async->lock);
+	}
+
+}
+
+csp_async_t * csp_async_create(unsigned int max_transactions, int request_id_offset) {
+
+	if (max_transactions == 0) {
+		return NULL;
+	}
+
+	csp_async_t * async = csp_calloc(1, sizeof(*async));
+	if (async == NULL) {
+		return NULL;
+	}
+
+	async->txns = csp_calloc(max_transactions, sizeof(*async->txns));
+	async->poll = csp_poll_create();
+	if ((async->txns == NULL) || (async->poll == NULL) ||
+	    (csp_mutex_create(&async->lock) != CSP_MUTEX_OK) ||
+	    (csp_mutex_create(&async->send_lock) != CSP_MUTEX_OK)) {
+		csp_log_error("Failed to create async engine");
+		csp_poll_destroy(async->poll);
+		csp_free(async->txns);
+		csp_free(async);
+		return NULL;
+	}
+
+	async->max = max_transactions;
+	async->id_offset = (request_id_offset >= 0) ? request_id_offset : CSP_ASYNC_NO_REQUEST_ID;
+	csp_timer_wheel_init(&async->wheel, CSP_ASYNC_TICK_MS, csp_get_ms());
+
+	for (unsigned int i = 0; i < max_transactions; i++) {
+		csp_async_txn_t * txn = &async->txns[i];
+		txn->async = async;
+		csp_timer_init(&txn->timer, csp_async_timeout, txn);
+		txn->next = async->free;
+		async->free = txn;
+	}
+
+	return async;
+
+}
+
+void csp_async_destroy(csp_async_t * async) {
+
+	if (async == NULL) {
+		return;
+	}
+
+	for (unsigned int i = 0; i < async->max; i++) {
+		csp_async_txn_t * txn = &async->txns[i];
+		if (txn->conn == NULL) {
+			continue;
+		}
+		if (txn->reply) {
+			csp_buffer_free(txn->reply);
+		}
+		csp_poll_remove(async->poll, txn->conn);
+		if (txn->own_conn) {
+			csp_close(txn->conn);
+		}
+	}
+
+	csp_poll_destroy(async->poll);
+	csp_mutex_remove(&async->lock);
+	csp_mutex_remove(&async->send_lock);
+	csp_free(async->txns);
+	csp_free(async);
+
+}
+
+/* Timeouts must be within the range of the timer wheel, or wait forever */
+static inline bool csp_async_timeout_valid(uint32_t timeout) {
+
+	return (timeout == CSP_MAX_TIMEOUT) || (timeout <= CSP_ASYNC_TIMEOUT_MAX);
+
+}
+
+/* Register and send request */
+static int csp_async_send(csp_async_t * async, csp_async_txn_t * txn, csp_conn_t * conn, bool own_conn, uint32_t timeout,
+                          const void * outbuf, int outlen, int inlen, csp_async_cb_t callback, void * context) {
+
+	csp_packet_t * packet = csp_buffer_get((outlen > 0) ? outlen : 1);
+	if (packet == NULL) {
+		return CSP_ERR_NOBUFS;
+	}
+	if ((outlen > 0) && (outbuf != NULL)) {
+		memcpy(packet->data, outbuf, outlen);
+	}
+	packet->length = (outlen > 0) ? outlen : 0;
+
+	csp_mutex_lock(&async->send_lock, CSP_MAX_TIMEOUT);
+
+	/* Register before sending, the reply may arrive before csp_send() returns */
+	csp_mutex_lock(&async->lock, CSP_MAX_TIMEOUT);
+	int res = CSP_ERR_NONE;
+	if (own_conn || !csp_async_conn_active(async, conn)) {
+		res = csp_poll_add(async->poll, conn, CSP_POLLIN, NULL);
+	}
+	if (res == CSP_ERR_NONE) {
+		txn->conn = conn;
+		txn->own_conn = own_conn;
+		txn->id = async->next_id++;
+		txn->seq = async->next_seq++;
+		txn->inlen = inlen;
+		txn->result = CSP_ERR_NONE;
+		txn->reply = NULL;
+		txn->callback = callback;
+		txn->context = context;
+		txn->active = true;
+		if (timeout != CSP_MAX_TIMEOUT) {
+			csp_timer_start(&async->wheel, &txn->timer, csp_get_ms() + timeout);
+		}
+	}
+	csp_mutex_unlock(&async->lock);
+
+	/* csp_async_run() may be waiting in another task, with a timeout computed before this transaction */
+	if ((res == CSP_ERR_NONE) && (timeout != CSP_MAX_TIMEOUT)) {
+		csp_poll_interrupt(async->poll);
+	}
+
+	if (res != CSP_ERR_NONE) {
+		csp_mutex_unlock(&async->send_lock);
+		csp_buffer_free(packet);
+		return res;
+	}
+
+	if ((async->id_offset >= 0) && (packet->length >= (async->id_offset + 2))) {
+		packet->data[async->id_offset] = txn->id >> 8;
+		packet->data[async->id_offset + 1] = txn->id & 0xFF;
+	}
+
+	const int sent = csp_send(conn, packet, 0);
+
+	csp_mutex_unlock(&async->send_lock);
+
+	if (sent) {
+		return CSP_ERR_NONE;
+	}
+
+	csp_buffer_free(packet);
+
+	/* Cancel, unless already completed (e.g. connection reset) - then the callback reports the error */
+	csp_mutex_lock(&async->lock, CSP_MAX_TIMEOUT);
+	if (txn->active) {
+		txn->active = false;
+		csp_timer_stop(&async->wheel, &txn->timer);
+		if (own_conn || !csp_async_conn_active(async, conn)) {
+			csp_poll_remove(async->poll, conn);
+		}
+		res = CSP_ERR_TX;
+	}
+	csp_mutex_unlock(&async->lock);
+
+	return res;
+
+}
+
+/* Take transaction from free list */
+static csp_async_txn_t * csp_async_alloc(csp_async_t * async) {
+
+	csp_mutex_lock(&async->lock, CSP_MAX_TIMEOUT);
+	csp_async_txn_t * txn = async->free;
+	if (txn) {
+		async->free = txn->next;
+		txn->next = NULL;
+		async->used++;
+	}
+	csp_mutex_unlock(&async->lock);
+
+	return txn;
+
+}
+
+static void csp_async_free(csp_async_t * async, csp_async_txn_t * txn) {
+
+	csp_mutex_lock(&async->lock, CSP_MAX_TIMEOUT);
+	csp_async_release(async, txn);
+	csp_mutex_unlock(&async->lock);
+
+}
+
+int csp_async_transaction(csp_async_t * async, uint8_t prio, uint8_t dest, uint8_t port, uint32_t timeout,
+                          const void * outbuf, int outlen, int inlen, uint32_t opts, csp_async_cb_t callback, void * context) {
+
+	if ((async == NULL) || (callback == NULL) || !csp_async_timeout_valid(timeout)) {
+		return CSP_ERR_INVAL;
+	}
+
+	csp_async_txn_t * txn = csp_async_alloc(async);
+	if (txn == NULL) {
+		return CSP_ERR_NOMEM;
+	}
+
+	csp_conn_t * conn = csp_connect(prio, dest, port, timeout, opts);
+	if (conn == NULL) {
+		csp_async_free(async, txn);
+		return CSP_ERR_NOMEM;
+	}
+
+	int res = csp_async_send(async, txn, conn, true, timeout, outbuf, outlen, inlen, callback, context);
+	if (res != CSP_ERR_NONE) {
+		csp_close(conn);
+		csp_async_free(async, txn);
+	}
+
+	return res;
+
+}
+
+int csp_async_transaction_persistent(csp_async_t * async, csp_conn_t * conn, uint32_t timeout,
+                                     const void * outbuf, int outlen, int inlen, csp_async_cb_t callback, void * context) {
+
+	if ((async == NULL) || (conn == NULL) || (callback == NULL) || !csp_async_timeout_valid(timeout)) {
+		return CSP_ERR_INVAL;
+	}
+
+	csp_async_txn_t * txn = csp_async_alloc(async);
+	if (txn == NULL) {
+		return CSP_ERR_NOMEM;
+	}
+
+	int res = csp_async_send(async, txn, conn, false, timeout, outbuf, outlen, inlen, callback, context);
+	if (res != CSP_ERR_NONE) {
+		csp_async_free(async, txn);
+	}
+
+	return res;
+
+}
+
+int csp_async_run(csp_async_t * async, uint32_t timeout) {
+
+	if (async == NULL) {
+		return CSP_ERR_INVAL;
+	}
+
+	const uint32_t start = csp_get_ms();
+	int completed = 0;
+
+	for (;;) {
+
+		/* Timeouts */
+		const uint32_t now = csp_get_ms();
+		csp_mutex_lock(&async->lock, CSP_MAX_TIMEOUT);
+		csp_timer_wheel_run(&async->wheel, now);
+		/* Sleep until the first timeout, new transactions interrupt the wait (csp_poll_interrupt()) */
+		uint32_t wait = csp_timer_wheel_next(&async->wheel, now);
+		csp_mutex_unlock(&async->lock);
+
+		completed += csp_async_callbacks(async);
+		if (completed) {
+			return completed;
+		}
+
+		if (timeout != CSP_MAX_TIMEOUT) {
+			const uint32_t elapsed = now - start;
+			if (elapsed >= timeout) {
+				return 0;
+			}
+			if (wait > (timeout - elapsed)) {
+				wait = timeout - elapsed;
+			}
+		}
+
+		/* Replies */
+		csp_poll_event_t events[CSP_ASYNC_EVENTS];
+		const int count = csp_poll_wait(async->poll, events, CSP_ASYNC_EVENTS, wait);
+		for (int i = 0; i < count; i++) {
+			csp_async_receive(async, events[i].conn, events[i].events);
+		}
+
+		completed += csp_async_callbacks(async);
+		if (completed) {
+			return completed;
+		}
+	}
+
+}
+
+unsigned int csp_async_pending(csp_async_t * async) {
+
+	if (async == NULL) {
+		return 0;
+	}
+
+	csp_mutex_lock(&async->lock, CSP_MAX_TIMEOUT);
+	const unsigned int used = async->used;
+	csp_mutex_unlock(&async->lock);
+
+	return used;
+
+}
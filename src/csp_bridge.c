@@ -51,7 +51,7 @@ static CSP_DEFINE_TASK(csp_bridge) {
 
 		/* Get next packet to route */
 		csp_qfifo_t input;
-		if (csp_qfifo_read(&input) != CSP_ERR_NONE) {
+		if (csp_qfifo_read(0, &input) != CSP_ERR_NONE) {
 			continue;
 		}
 
@@ -67,7 +67,7 @@ static CSP_DEFINE_TASK(csp_bridge) {
 #endif
 
 		/* Find the opposing interface */
-		csp_route_t route;
+		csp_route_t route = {.shaper = NULL};
 		if (input.iface == bif_a.iface) {
 			route.iface = bif_b.iface;
 			route.via = get_via(&bif_a, packet);
@@ -103,6 +103,12 @@ static bool is_zmq_interface(const char * ifname)
 
 int csp_bridge_start(unsigned int task_stack_size, unsigned int task_priority, csp_iface_t * if_a, csp_iface_t * if_b) {
 
+	/* The bridge only reads the first worker's queue(s) */
+	if (csp_qfifo_shard_count() > 1) {
+		csp_log_error("Bridge requires route_workers = 1");
+		return CSP_ERR_INVAL;
+	}
+
 	/* Set static references to A/B side of bridge */
 	bif_a.iface = if_a;
 	bif_a.is_zmq = is_zmq_interface(if_a->name);
@@ -25,21 +25,102 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
 #include <csp/arch/csp_malloc.h>
 #include "csp_init.h"
 
+#if (CSP_USE_BUFFER_CACHE)
+#include <pthread.h>
+#include <csp/arch/csp_semaphore.h>
+#endif
+
 #ifndef CSP_BUFFER_ALIGN
 #define CSP_BUFFER_ALIGN	(sizeof(int *))
 #endif
 
+#if (CSP_USE_BUFFER_CACHE)
+#ifndef CSP_BUFFER_CACHE_SIZE
+/** Max number of buffers held in a thread's magazine (per class) */
+#define CSP_BUFFER_CACHE_SIZE	16
+#endif
+/** Magazines are only enabled, if the pool holds at least this many buffers per magazine slot */
+#define CSP_BUFFER_CACHE_RATIO	16
+#endif
+
 /** Internal buffer header */
 typedef struct csp_skbf_s {
 	unsigned int refcount;
+	uint8_t pool; // index in csp_buffer_pools
+	uint16_t head; // bytes pushed in front of csp_packet_t.id, see csp_buffer_push()
+	uint16_t length; // csp_packet_t.length, while overwritten by pushed headers
+#if (CSP_USE_BUFFER_STATS)
+	uint8_t owner; // csp_buffer_owner_t
+#endif
+#if (CSP_USE_BUFFER_CACHE)
+	uint32_t next; // index of next buffer on the global free list
+	struct csp_buffer_cache_s * cache; // magazine of the thread that allocated the buffer
+#endif
 	void * skbf_addr;
-	char skbf_data[]; // -> csp_packet_t
+	char skbf_data[]; // -> headroom + csp_packet_t
 } csp_skbf_t;
 
-// Queue of free CSP buffers
-static csp_queue_handle_t csp_buffers;
-// Chunk of memory allocated for CSP buffers
-static char * csp_buffer_pool;
+/** Pool of buffers with the same data size (size class) */
+typedef struct {
+	uint16_t data_size;
+	uint16_t count;
+	// Size of each buffer (incl. header) in the pool
+	unsigned int skbfsize;
+	// Chunk of memory allocated for the buffers
+	char * memory;
+#if (CSP_USE_BUFFER_CACHE)
+	// Free list head: low 32 bits is buffer index, high 32 bits is an ABA tag
+	uint64_t free_head;
+	// Number of buffers on the global free list
+	int free_count;
+	// Magazine capacity, 0 if magazines are disabled (too few buffers)
+	unsigned int cache_capacity;
+#else
+	// Queue of free buffers
+	csp_queue_handle_t queue;
+#endif
+#if (CSP_USE_BUFFER_STATS)
+	unsigned int in_use;
+	unsigned int peak;
+	uint32_t gets;
+	uint32_t frees;
+#endif
+} csp_buffer_pool_t;
+
+// Buffer pools, sorted by data size
+static csp_buffer_pool_t csp_buffer_pools[CSP_BUFFER_CLASSES_MAX];
+static unsigned int csp_buffer_pool_count;
+// Extra headroom in front of csp_packet_t (aligned) and reserved tailroom after data, same for all pools
+static uint16_t csp_buffer_headroom_size;
+static uint16_t csp_buffer_tailroom_size;
+#if (CSP_USE_BUFFER_STATS)
+static uint32_t csp_buffer_get_failures;
+#endif
+
+#if (CSP_USE_BUFFER_CACHE)
+/** Per-thread magazines of free buffers, one per pool */
+typedef struct csp_buffer_cache_s {
+	unsigned int generation; // csp_buffer_init() generation, stale magazines are discarded
+	struct {
+		unsigned int count;
+		csp_skbf_t * buffers[CSP_BUFFER_CACHE_SIZE];
+	} magazine[CSP_BUFFER_CLASSES_MAX];
+	csp_buffer_cache_stats_t stats;
+	struct csp_buffer_cache_s * next; // list of active magazines
+} csp_buffer_cache_t;
+
+// Marks end of the global free list
+#define CSP_BUFFER_NIL		UINT32_MAX
+static unsigned int csp_buffer_generation;
+static bool csp_buffer_cache_ready;
+// Thread magazines, flushed back to the free lists on thread exit
+static __thread csp_buffer_cache_t csp_buffer_cache;
+static pthread_key_t csp_buffer_cache_key;
+// Active magazines and statistics from exited threads, protected by csp_buffer_cache_lock
+static csp_buffer_cache_t * csp_buffer_caches;
+static csp_buffer_cache_stats_t csp_buffer_cache_retired;
+CSP_DEFINE_CRITICAL(csp_buffer_cache_lock);
+#endif
 
 // Ensure the csp_packet is correctly aligned (as it is not packed)
 CSP_STATIC_ASSERT(CSP_HEADER_LENGTH == sizeof(csp_id_t), csp_header_length);
@@ -47,75 +128,573 @@ CSP_STATIC_ASSERT(sizeof(csp_packet_t) == 16, csp_packet);
 CSP_STATIC_ASSERT(offsetof(csp_packet_t, length) == 10, length_field_misaligned);
 CSP_STATIC_ASSERT(offsetof(csp_packet_t, id) == 12, csp_id_field_misaligned);
 CSP_STATIC_ASSERT(offsetof(csp_packet_t, data) == 16, data_field_misaligned);
+CSP_STATIC_ASSERT(CSP_BUFFER_CLASSES_MAX <= UINT8_MAX, csp_buffer_classes_max);
 
-int csp_buffer_init(void) {
+#if (__GCC_ATOMIC_INT_LOCK_FREE == 2)
+/* Shared buffers (csp_buffer_ref()) may be released from different threads */
+#define csp_buffer_refcount_inc(buf)	__atomic_add_fetch(&(buf)->refcount, 1, __ATOMIC_RELAXED)
+#define csp_buffer_refcount_dec(buf)	__atomic_sub_fetch(&(buf)->refcount, 1, __ATOMIC_ACQ_REL)
+#define csp_buffer_refcount_get(buf)	__atomic_load_n(&(buf)->refcount, __ATOMIC_ACQUIRE)
+#else
+/* No lock-free atomics (e.g. Cortex-M0), shared buffers must be released from the same context */
+#define csp_buffer_refcount_inc(buf)	(++(buf)->refcount)
+#define csp_buffer_refcount_dec(buf)	(--(buf)->refcount)
+#define csp_buffer_refcount_get(buf)	((buf)->refcount)
+#endif
+
+#if (CSP_USE_BUFFER_STATS)
+#if (__GCC_ATOMIC_INT_LOCK_FREE == 2)
+#define csp_buffer_stat_add(var, n)	__atomic_add_fetch(&(var), (n), __ATOMIC_RELAXED)
+#define csp_buffer_stat_sub(var, n)	__atomic_sub_fetch(&(var), (n), __ATOMIC_RELAXED)
+#else
+#define csp_buffer_stat_add(var, n)	((var) += (n))
+#define csp_buffer_stat_sub(var, n)	((var) -= (n))
+#endif
+#endif
+
+/* Account buffers taken from a pool */
+static inline void csp_buffer_stats_get(unsigned int pool_index, unsigned int count) {
+#if (CSP_USE_BUFFER_STATS)
+	csp_buffer_pool_t * pool = &csp_buffer_pools[pool_index];
+	csp_buffer_stat_add(pool->gets, count);
+	const unsigned int in_use = csp_buffer_stat_add(pool->in_use, count);
+#if (__GCC_ATOMIC_INT_LOCK_FREE == 2)
+	unsigned int peak = __atomic_load_n(&pool->peak, __ATOMIC_RELAXED);
+	while ((in_use > peak) && !__atomic_compare_exchange_n(&pool->peak, &peak, in_use, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+#else
+	if (in_use > pool->peak) {
+		pool->peak = in_use;
+	}
+#endif
+#endif
+}
+
+/* Account buffers returned to a pool */
+static inline void csp_buffer_stats_put(unsigned int pool_index, unsigned int count) {
+#if (CSP_USE_BUFFER_STATS)
+	csp_buffer_pool_t * pool = &csp_buffer_pools[pool_index];
+	csp_buffer_stat_add(pool->frees, count);
+	csp_buffer_stat_sub(pool->in_use, count);
+#endif
+}
+
+static inline void csp_buffer_stats_failed(void) {
+#if (CSP_USE_BUFFER_STATS)
+	csp_buffer_stat_add(csp_buffer_get_failures, 1);
+#endif
+}
+
+static inline csp_skbf_t * csp_buffer_to_skbf(const void * packet) {
+	return (csp_skbf_t *)(((uintptr_t) packet) - csp_buffer_headroom_size - sizeof(csp_skbf_t));
+}
+
+static inline void * csp_buffer_to_packet(csp_skbf_t * buf) {
+	return &buf->skbf_data[csp_buffer_headroom_size];
+}
+
+/* Current data length, csp_packet_t.length is overwritten while headers are pushed */
+static inline uint16_t * csp_buffer_length_ref(csp_skbf_t * buf, csp_packet_t * packet) {
+	return (buf->head > 0) ? &buf->length : &packet->length;
+}
+
+static inline uint16_t csp_buffer_length(const csp_skbf_t * buf, const csp_packet_t * packet) {
+	return (buf->head > 0) ? buf->length : packet->length;
+}
+
+#if (CSP_USE_BUFFER_CACHE)
+
+static inline csp_skbf_t * csp_buffer_at(const csp_buffer_pool_t * pool, uint32_t index) {
+	return (csp_skbf_t *) &pool->memory[index * pool->skbfsize];
+}
+
+static inline uint32_t csp_buffer_index(const csp_buffer_pool_t * pool, const csp_skbf_t * buf) {
+	return ((const char *) buf - pool->memory) / pool->skbfsize;
+}
+
+/* Push a chain of buffers (linked through next) onto the global free list */
+static void csp_buffer_freelist_push(csp_buffer_pool_t * pool, csp_skbf_t * first, csp_skbf_t * last, unsigned int count) {
+
+	const uint64_t index = csp_buffer_index(pool, first);
+	uint64_t head = __atomic_load_n(&pool->free_head, __ATOMIC_ACQUIRE);
+	uint64_t new_head;
+	do {
+		__atomic_store_n(&last->next, (uint32_t) head, __ATOMIC_RELAXED);
+		new_head = ((head + (1ULL << 32)) & 0xFFFFFFFF00000000ULL) | index;
+	} while (!__atomic_compare_exchange_n(&pool->free_head, &head, new_head, true, __ATOMIC_RELEASE, __ATOMIC_ACQUIRE));
+
+	__atomic_fetch_add(&pool->free_count, count, __ATOMIC_RELAXED);
+
+}
+
+/* Pop up to count buffers from the global free list in one operation, returns number of buffers popped */
+static unsigned int csp_buffer_freelist_pop(csp_buffer_pool_t * pool, csp_skbf_t ** buffers, unsigned int count) {
+
+	uint64_t head = __atomic_load_n(&pool->free_head, __ATOMIC_ACQUIRE);
+	for (;;) {
+		unsigned int popped = 0;
+		uint32_t index = (uint32_t) head;
+		while ((popped < count) && (index < pool->count)) {
+			buffers[popped] = csp_buffer_at(pool, index);
+			index = __atomic_load_n(&buffers[popped]->next, __ATOMIC_RELAXED);
+			++popped;
+		}
+		if (popped == 0) {
+			return 0;
+		}
+		if ((index != CSP_BUFFER_NIL) && (index >= pool->count)) {
+			/* List changed while walking it - start over */
+			head = __atomic_load_n(&pool->free_head, __ATOMIC_ACQUIRE);
+			continue;
+		}
+		/* The tag changes on every push/pop, so an unchanged head means the walked chain is intact */
+		const uint64_t new_head = ((head + (1ULL << 32)) & 0xFFFFFFFF00000000ULL) | index;
+		if (__atomic_compare_exchange_n(&pool->free_head, &head, new_head, true, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)) {
+			__atomic_fetch_sub(&pool->free_count, popped, __ATOMIC_RELAXED);
+			return popped;
+		}
+	}
+
+}
+
+/* Return the top count buffers of a magazine to the global free list */
+static void csp_buffer_cache_drain(csp_buffer_cache_t * cache, unsigned int pool_index, unsigned int count) {
+
+	if (count == 0) {
+		return;
+	}
+
+	csp_buffer_pool_t * pool = &csp_buffer_pools[pool_index];
+	unsigned int * magazine_count = &cache->magazine[pool_index].count;
+	csp_skbf_t ** buffers = &cache->magazine[pool_index].buffers[*magazine_count - count];
+	for (unsigned int i = 0; i < (count - 1); ++i) {
+		__atomic_store_n(&buffers[i]->next, csp_buffer_index(pool, buffers[i + 1]), __ATOMIC_RELAXED);
+	}
+	csp_buffer_freelist_push(pool, buffers[0], buffers[count - 1], count);
+	*magazine_count -= count;
+	cache->stats.drains++;
+
+}
+
+/* Thread exit: flush magazines and keep their statistics */
+static void csp_buffer_cache_exit(void * arg) {
+
+	csp_buffer_cache_t * cache = arg;
+	if (cache->generation != csp_buffer_generation) {
+		return;
+	}
+
+	for (unsigned int i = 0; i < csp_buffer_pool_count; ++i) {
+		csp_buffer_cache_drain(cache, i, cache->magazine[i].count);
+	}
+
+	CSP_ENTER_CRITICAL(csp_buffer_cache_lock);
+	for (csp_buffer_cache_t ** p = &csp_buffer_caches; *p; p = &(*p)->next) {
+		if (*p == cache) {
+			*p = cache->next;
+			break;
+		}
+	}
+	csp_buffer_cache_retired.hits += cache->stats.hits;
+	csp_buffer_cache_retired.refills += cache->stats.refills;
+	csp_buffer_cache_retired.drains += cache->stats.drains;
+	csp_buffer_cache_retired.cross_thread_frees += cache->stats.cross_thread_frees;
+	CSP_EXIT_CRITICAL(csp_buffer_cache_lock);
+
+	cache->generation = 0;
+
+}
+
+/* Get calling thread's magazines */
+static csp_buffer_cache_t * csp_buffer_cache_get(void) {
+
+	csp_buffer_cache_t * cache = &csp_buffer_cache;
+	if (cache->generation != csp_buffer_generation) {
+		/* First use in this thread (or since csp_buffer_init()) */
+		memset(cache, 0, sizeof(*cache));
+		CSP_ENTER_CRITICAL(csp_buffer_cache_lock);
+		cache->next = csp_buffer_caches;
+		csp_buffer_caches = cache;
+		CSP_EXIT_CRITICAL(csp_buffer_cache_lock);
+		pthread_setspecific(csp_buffer_cache_key, cache);
+		cache->generation = csp_buffer_generation;
+	}
+
+	return cache;
+
+}
+
+static csp_skbf_t * csp_buffer_pool_get(unsigned int pool_index) {
+
+	csp_buffer_pool_t * pool = &csp_buffer_pools[pool_index];
+	csp_skbf_t * buf = NULL;
+	if (pool->cache_capacity == 0) {
+		if (csp_buffer_freelist_pop(pool, &buf, 1)) {
+			buf->cache = NULL;
+		}
+		return buf;
+	}
+
+	csp_buffer_cache_t * cache = csp_buffer_cache_get();
+	unsigned int * magazine_count = &cache->magazine[pool_index].count;
+	if (*magazine_count > 0) {
+		cache->stats.hits++;
+	} else {
+		*magazine_count = csp_buffer_freelist_pop(pool, cache->magazine[pool_index].buffers, pool->cache_capacity / 2);
+		if (*magazine_count == 0) {
+			return NULL;
+		}
+		cache->stats.refills++;
+	}
+
+	buf = cache->magazine[pool_index].buffers[--(*magazine_count)];
+	buf->cache = cache;
+	return buf;
+
+}
+
+static csp_skbf_t * csp_buffer_pool_get_isr(unsigned int pool_index) {
+
+	csp_skbf_t * buf = NULL;
+	if (csp_buffer_freelist_pop(&csp_buffer_pools[pool_index], &buf, 1)) {
+		buf->cache = NULL;
+	}
+	return buf;
+
+}
+
+static void csp_buffer_pool_put(csp_skbf_t * buf) {
+
+	csp_buffer_pool_t * pool = &csp_buffer_pools[buf->pool];
+	if (pool->cache_capacity == 0) {
+		csp_buffer_freelist_push(pool, buf, buf, 1);
+		return;
+	}
+
+	csp_buffer_cache_t * cache = csp_buffer_cache_get();
+	if (buf->cache && (buf->cache != cache)) {
+		cache->stats.cross_thread_frees++;
+	}
+
+	if (cache->magazine[buf->pool].count >= pool->cache_capacity) {
+		csp_buffer_cache_drain(cache, buf->pool, pool->cache_capacity / 2);
+	}
+	cache->magazine[buf->pool].buffers[cache->magazine[buf->pool].count++] = buf;
+
+}
+
+static void csp_buffer_pool_put_isr(csp_skbf_t * buf) {
+	csp_buffer_freelist_push(&csp_buffer_pools[buf->pool], buf, buf, 1);
+}
+
+static unsigned int csp_buffer_pool_get_n(unsigned int pool_index, csp_skbf_t ** buffers, unsigned int count, bool isr) {
+
+	csp_buffer_pool_t * pool = &csp_buffer_pools[pool_index];
+	unsigned int n = 0;
+	csp_buffer_cache_t * cache = NULL;
+
+	if (!isr && (pool->cache_capacity > 0)) {
+		/* Take from the magazine first */
+		cache = csp_buffer_cache_get();
+		unsigned int * magazine_count = &cache->magazine[pool_index].count;
+		while ((n < count) && (*magazine_count > 0)) {
+			buffers[n++] = cache->magazine[pool_index].buffers[--(*magazine_count)];
+		}
+		cache->stats.hits += n;
+	}
+
+	n += csp_buffer_freelist_pop(pool, &buffers[n], count - n);
+
+	for (unsigned int i = 0; i < n; ++i) {
+		buffers[i]->cache = cache;
+	}
+
+	return n;
+
+}
+
+/* Put buffers from the same pool */
+static void csp_buffer_pool_put_n(csp_skbf_t ** buffers, unsigned int count, bool isr) {
+
+	const unsigned int pool_index = buffers[0]->pool;
+	csp_buffer_pool_t * pool = &csp_buffer_pools[pool_index];
+
+	if (!isr && (pool->cache_capacity > 0)) {
+		/* Fill up the magazine, the rest goes to the free list */
+		csp_buffer_cache_t * cache = csp_buffer_cache_get();
+		unsigned int * magazine_count = &cache->magazine[pool_index].count;
+		while ((count > 0) && (*magazine_count < pool->cache_capacity)) {
+			csp_skbf_t * buf = buffers[--count];
+			if (buf->cache && (buf->cache != cache)) {
+				cache->stats.cross_thread_frees++;
+			}
+			cache->magazine[pool_index].buffers[(*magazine_count)++] = buf;
+		}
+	}
+
+	if (count == 0) {
+		return;
+	}
+
+	for (unsigned int i = 0; i < (count - 1); ++i) {
+		__atomic_store_n(&buffers[i]->next, csp_buffer_index(pool, buffers[i + 1]), __ATOMIC_RELAXED);
+	}
+	csp_buffer_freelist_push(pool, buffers[0], buffers[count - 1], count);
+
+}
+
+static int csp_buffer_pool_remaining(unsigned int pool_index) {
+
+	/* Caller must hold csp_buffer_cache_lock */
+	int remaining = __atomic_load_n(&csp_buffer_pools[pool_index].free_count, __ATOMIC_RELAXED);
+	for (csp_buffer_cache_t * cache = csp_buffer_caches; cache; cache = cache->next) {
+		remaining += cache->magazine[pool_index].count;
+	}
+	return remaining;
+
+}
+
+#else // CSP_USE_BUFFER_CACHE
+
+static csp_skbf_t * csp_buffer_pool_get(unsigned int pool_index) {
+
+	csp_skbf_t * buf = NULL;
+	csp_queue_dequeue(csp_buffer_pools[pool_index].queue, &buf, 0);
+	return buf;
+
+}
+
+static csp_skbf_t * csp_buffer_pool_get_isr(unsigned int pool_index) {
+
+	csp_skbf_t * buf = NULL;
+	CSP_BASE_TYPE task_woken = 0;
+	csp_queue_dequeue_isr(csp_buffer_pools[pool_index].queue, &buf, &task_woken);
+	return buf;
+
+}
+
+static void csp_buffer_pool_put(csp_skbf_t * buf) {
+	csp_queue_enqueue(csp_buffer_pools[buf->pool].queue, &buf, 0);
+}
+
+static void csp_buffer_pool_put_isr(csp_skbf_t * buf) {
+
+	CSP_BASE_TYPE task_woken = 0;
+	csp_queue_enqueue_isr(csp_buffer_pools[buf->pool].queue, &buf, &task_woken);
+
+}
+
+static unsigned int csp_buffer_pool_get_n(unsigned int pool_index, csp_skbf_t ** buffers, unsigned int count, bool isr) {
+
+	if (isr) {
+		CSP_BASE_TYPE task_woken = 0;
+		return csp_queue_dequeue_n_isr(csp_buffer_pools[pool_index].queue, (void **) buffers, count, &task_woken);
+	}
+	return csp_queue_dequeue_n(csp_buffer_pools[pool_index].queue, (void **) buffers, count, 0);
+
+}
+
+/* Put buffers from the same pool */
+static void csp_buffer_pool_put_n(csp_skbf_t ** buffers, unsigned int count, bool isr) {
+
+	if (isr) {
+		CSP_BASE_TYPE task_woken = 0;
+		csp_queue_enqueue_n_isr(csp_buffer_pools[buffers[0]->pool].queue, (void **) buffers, count, &task_woken);
+	} else {
+		csp_queue_enqueue_n(csp_buffer_pools[buffers[0]->pool].queue, (void **) buffers, count);
+	}
+
+}
+
+static int csp_buffer_pool_remaining(unsigned int pool_index) {
+	return csp_queue_size(csp_buffer_pools[pool_index].queue);
+}
+
+#endif // CSP_USE_BUFFER_CACHE
+
+static int csp_buffer_pool_init(unsigned int pool_index, uint16_t data_size, uint16_t count) {
+
+	csp_buffer_pool_t * pool = &csp_buffer_pools[pool_index];
 
 	// calculate total size and ensure correct alignment (int *) for buffers
-	const unsigned int skbfsize = CSP_BUFFER_ALIGN * ((sizeof(csp_skbf_t) + csp_buffer_size() + (CSP_BUFFER_ALIGN - 1)) / CSP_BUFFER_ALIGN);
+	pool->data_size = data_size;
+	pool->count = count;
+	pool->skbfsize = CSP_BUFFER_ALIGN * ((sizeof(csp_skbf_t) + csp_buffer_headroom_size + CSP_BUFFER_PACKET_OVERHEAD + data_size + csp_buffer_tailroom_size + (CSP_BUFFER_ALIGN - 1)) / CSP_BUFFER_ALIGN);
 
-	csp_buffer_pool = csp_malloc(csp_conf.buffers * skbfsize);
-	if (csp_buffer_pool == NULL)
-		goto fail_malloc;
+	pool->memory = csp_malloc(count * pool->skbfsize);
+	if (pool->memory == NULL) {
+		return CSP_ERR_NOMEM;
+	}
 
-	csp_buffers = csp_queue_create(csp_conf.buffers, sizeof(void *));
-	if (!csp_buffers)
-		goto fail_queue;
+#if (CSP_USE_BUFFER_CACHE)
+	for (unsigned int i = 0; i < count; i++) {
+		csp_skbf_t * buf = csp_buffer_at(pool, i);
+		buf->skbf_addr = buf;
+		buf->refcount = 0;
+		buf->pool = pool_index;
+		buf->next = ((i + 1) < count) ? (i + 1) : CSP_BUFFER_NIL;
+	}
+	pool->free_head = (count > 0) ? 0 : CSP_BUFFER_NIL;
+	pool->free_count = count;
+
+	/* Buffers held in idle magazines are unavailable to other threads, so only enable magazines on large pools */
+	pool->cache_capacity = count / CSP_BUFFER_CACHE_RATIO;
+	if (pool->cache_capacity > CSP_BUFFER_CACHE_SIZE) {
+		pool->cache_capacity = CSP_BUFFER_CACHE_SIZE;
+	} else if (pool->cache_capacity < 2) {
+		pool->cache_capacity = 0;
+	}
+#else
+	pool->queue = csp_queue_create(count, sizeof(void *));
+	if (!pool->queue) {
+		csp_free(pool->memory);
+		pool->memory = NULL;
+		return CSP_ERR_NOMEM;
+	}
 
-	for (unsigned int i = 0; i < csp_conf.buffers; i++) {
-		csp_skbf_t * buf = (void *) &csp_buffer_pool[i * skbfsize];
+	for (unsigned int i = 0; i < count; i++) {
+		csp_skbf_t * buf = (void *) &pool->memory[i * pool->skbfsize];
 		buf->skbf_addr = buf;
-		csp_queue_enqueue(csp_buffers, &buf, 0);
+		buf->pool = pool_index;
+		csp_queue_enqueue(pool->queue, &buf, 0);
 	}
+#endif
 
 	return CSP_ERR_NONE;
 
-fail_queue:
-	csp_buffer_free_resources();
-fail_malloc:
-	return CSP_ERR_NOMEM;
+}
+
+int csp_buffer_init(void) {
+
+	csp_buffer_class_t classes[CSP_BUFFER_CLASSES_MAX];
+	unsigned int class_count = 0;
+
+	if (csp_conf.buffer_class_count == 0) {
+		classes[0].data_size = csp_conf.buffer_data_size;
+		classes[0].count = csp_conf.buffers;
+		class_count = 1;
+	} else {
+		if ((csp_conf.buffer_classes == NULL) || (csp_conf.buffer_class_count > CSP_BUFFER_CLASSES_MAX)) {
+			csp_log_error("Invalid buffer classes, count: %u, max: %u", csp_conf.buffer_class_count, CSP_BUFFER_CLASSES_MAX);
+			return CSP_ERR_INVAL;
+		}
+		/* Insert sorted by data size */
+		for (unsigned int i = 0; i < csp_conf.buffer_class_count; ++i) {
+			unsigned int j = class_count++;
+			for (; (j > 0) && (classes[j - 1].data_size > csp_conf.buffer_classes[i].data_size); --j) {
+				classes[j] = classes[j - 1];
+			}
+			classes[j] = csp_conf.buffer_classes[i];
+		}
+	}
+
+	/* Extra headroom must keep csp_packet_t aligned */
+	csp_buffer_headroom_size = CSP_BUFFER_ALIGN * ((csp_conf.buffer_headroom + (CSP_BUFFER_ALIGN - 1)) / CSP_BUFFER_ALIGN);
+	csp_buffer_tailroom_size = csp_conf.buffer_tailroom;
+
+#if (CSP_USE_BUFFER_CACHE)
+	if (CSP_INIT_CRITICAL(csp_buffer_cache_lock) != CSP_ERR_NONE) {
+		return CSP_ERR_NOMEM;
+	}
+
+	if (pthread_key_create(&csp_buffer_cache_key, csp_buffer_cache_exit) != 0) {
+		csp_bin_sem_remove(&csp_buffer_cache_lock);
+		return CSP_ERR_NOMEM;
+	}
+
+	++csp_buffer_generation;
+	csp_buffer_cache_ready = true;
+#endif
+
+	for (csp_buffer_pool_count = 0; csp_buffer_pool_count < class_count; ++csp_buffer_pool_count) {
+		if (csp_buffer_pool_init(csp_buffer_pool_count, classes[csp_buffer_pool_count].data_size, classes[csp_buffer_pool_count].count) != CSP_ERR_NONE) {
+			csp_buffer_free_resources();
+			return CSP_ERR_NOMEM;
+		}
+	}
+
+	return CSP_ERR_NONE;
 
 }
 
 void csp_buffer_free_resources(void) {
 
-	if (csp_buffers) {
-		csp_queue_remove(csp_buffers);
-		csp_buffers = NULL;
+#if (CSP_USE_BUFFER_CACHE)
+	if (csp_buffer_cache_ready) {
+		/* Magazines in other threads are invalidated by the next csp_buffer_init() (generation) */
+		pthread_key_delete(csp_buffer_cache_key);
+		csp_bin_sem_remove(&csp_buffer_cache_lock);
+		csp_buffer_caches = NULL;
+		memset(&csp_buffer_cache_retired, 0, sizeof(csp_buffer_cache_retired));
+		++csp_buffer_generation;
+		csp_buffer_cache_ready = false;
+	}
+#endif
+
+	for (unsigned int i = 0; i < csp_buffer_pool_count; ++i) {
+#if (!CSP_USE_BUFFER_CACHE)
+		if (csp_buffer_pools[i].queue) {
+			csp_queue_remove(csp_buffer_pools[i].queue);
+		}
+#endif
+		csp_free(csp_buffer_pools[i].memory);
 	}
-	csp_free(csp_buffer_pool);
-	csp_buffer_pool = NULL;
+	memset(csp_buffer_pools, 0, sizeof(csp_buffer_pools));
+	csp_buffer_pool_count = 0;
+	csp_buffer_headroom_size = 0;
+	csp_buffer_tailroom_size = 0;
+
+}
+
+/* Get buffer from the smallest class that fits data_size and has free buffers */
+static csp_skbf_t * csp_buffer_get_internal(size_t data_size, bool isr) {
+
+	for (unsigned int i = 0; i < csp_buffer_pool_count; ++i) {
+		if (csp_buffer_pools[i].data_size >= data_size) {
+			csp_skbf_t * buf = isr ? csp_buffer_pool_get_isr(i) : csp_buffer_pool_get(i);
+			if (buf) {
+				csp_buffer_stats_get(i, 1);
+				return buf;
+			}
+		}
+	}
+
+	return NULL;
 
 }
 
 void *csp_buffer_get_isr(size_t _data_size) {
 
-	if (_data_size > csp_conf.buffer_data_size)
+	if (_data_size > csp_buffer_data_size())
 		return NULL;
 
-	csp_skbf_t * buffer = NULL;
-	CSP_BASE_TYPE task_woken = 0;
-	csp_queue_dequeue_isr(csp_buffers, &buffer, &task_woken);
-	if (buffer == NULL)
+	csp_skbf_t * buffer = csp_buffer_get_internal(_data_size, true);
+	if (buffer == NULL) {
+		csp_buffer_stats_failed();
 		return NULL;
+	}
 
 	if (buffer != buffer->skbf_addr)
 		return NULL;
 
 	buffer->refcount = 1;
-	return buffer->skbf_data;
+	buffer->head = 0;
+#if (CSP_USE_BUFFER_STATS)
+	buffer->owner = CSP_BUFFER_OWNER_NONE;
+#endif
+	return csp_buffer_to_packet(buffer);
 
 }
 
 void *csp_buffer_get(size_t _data_size) {
 
-	if (_data_size > csp_conf.buffer_data_size) {
-		csp_log_error("GET: Attempt to allocate too large data size %u > max %u", (unsigned int) _data_size, (unsigned int) csp_conf.buffer_data_size);
+	if (_data_size > csp_buffer_data_size()) {
+		csp_log_error("GET: Attempt to allocate too large data size %u > max %u", (unsigned int) _data_size, (unsigned int) csp_buffer_data_size());
 		return NULL;
 	}
 
-	csp_skbf_t * buffer = NULL;
-	csp_queue_dequeue(csp_buffers, &buffer, 0);
+	csp_skbf_t * buffer = csp_buffer_get_internal(_data_size, false);
 	if (buffer == NULL) {
+		csp_buffer_stats_failed();
 		csp_log_error("GET: Out of buffers");
 		return NULL;
 	}
@@ -128,7 +707,11 @@ void *csp_buffer_get(size_t _data_size) {
 	csp_log_buffer("GET: %p", buffer);
 
 	buffer->refcount = 1;
-	return buffer->skbf_data;
+	buffer->head = 0;
+#if (CSP_USE_BUFFER_STATS)
+	buffer->owner = CSP_BUFFER_OWNER_NONE;
+#endif
+	return csp_buffer_to_packet(buffer);
 }
 
 void csp_buffer_free_isr(void *packet) {
@@ -138,26 +721,26 @@ void csp_buffer_free_isr(void *packet) {
 		return;
 	}
 
-	csp_skbf_t * buf = (void*)(((uint8_t*)packet) - sizeof(csp_skbf_t));
+	csp_skbf_t * buf = csp_buffer_to_skbf(packet);
 
 	if (((uintptr_t) buf % CSP_BUFFER_ALIGN) > 0) {
 		return;
 	}
 
-	if (buf->skbf_addr != buf) {
+	if ((buf->skbf_addr != buf) || (buf->pool >= csp_buffer_pool_count)) {
 		return;
 	}
 
-	if (buf->refcount == 0) {
+	if (csp_buffer_refcount_get(buf) == 0) {
 		return;
 	}
 
-	if (--(buf->refcount) > 0) {
+	if (csp_buffer_refcount_dec(buf) > 0) {
 		return;
 	}
 
-	CSP_BASE_TYPE task_woken = 0;
-	csp_queue_enqueue_isr(csp_buffers, &buf, &task_woken);
+	csp_buffer_stats_put(buf->pool, 1);
+	csp_buffer_pool_put_isr(buf);
 
 }
 
@@ -168,30 +751,174 @@ void csp_buffer_free(void *packet) {
 		return;
 	}
 
-	csp_skbf_t * buf = (void*)(((uint8_t*)packet) - sizeof(csp_skbf_t));
+	csp_skbf_t * buf = csp_buffer_to_skbf(packet);
 
 	if (((uintptr_t) buf % CSP_BUFFER_ALIGN) > 0) {
 		csp_log_error("FREE: Unaligned CSP buffer pointer %p", packet);
 		return;
 	}
 
-	if (buf->skbf_addr != buf) {
+	if ((buf->skbf_addr != buf) || (buf->pool >= csp_buffer_pool_count)) {
 		csp_log_error("FREE: Invalid CSP buffer pointer %p", packet);
 		return;
 	}
 
-	if (buf->refcount == 0) {
+	if (csp_buffer_refcount_get(buf) == 0) {
 		csp_log_error("FREE: Buffer already free %p", buf);
 		return;
 	}
 
-	if (--(buf->refcount) > 0) {
-		csp_log_error("FREE: Buffer %p in use by %u users", buf, buf->refcount);
+	const unsigned int refcount = csp_buffer_refcount_dec(buf);
+	if (refcount > 0) {
+		csp_log_buffer("FREE: %p still has %u references", buf, refcount);
 		return;
 	}
 
 	csp_log_buffer("FREE: %p", buf);
-	csp_queue_enqueue(csp_buffers, &buf, 0);
+	csp_buffer_stats_put(buf->pool, 1);
+	csp_buffer_pool_put(buf);
+
+}
+
+static int csp_buffer_get_n_internal(size_t data_size, void ** buffers, int count, bool isr) {
+
+	if ((count <= 0) || (data_size > csp_buffer_data_size())) {
+		return 0;
+	}
+
+	int n = 0;
+	for (unsigned int i = 0; (i < csp_buffer_pool_count) && (n < count); ++i) {
+		if (csp_buffer_pools[i].data_size >= data_size) {
+			const unsigned int got = csp_buffer_pool_get_n(i, (csp_skbf_t **) &buffers[n], count - n, isr);
+			csp_buffer_stats_get(i, got);
+			n += got;
+		}
+	}
+
+	/* Validate and convert to buffer (packet) pointers */
+	int valid = 0;
+	for (int i = 0; i < n; ++i) {
+		csp_skbf_t * buf = buffers[i];
+		if (buf != buf->skbf_addr) {
+			if (!isr) {
+				csp_log_error("GET: Corrupt CSP buffer %p != %p", buf, buf->skbf_addr);
+			}
+			continue;
+		}
+		buf->refcount = 1;
+		buf->head = 0;
+#if (CSP_USE_BUFFER_STATS)
+		buf->owner = CSP_BUFFER_OWNER_NONE;
+#endif
+		buffers[valid++] = csp_buffer_to_packet(buf);
+	}
+
+	return valid;
+
+}
+
+int csp_buffer_get_n(size_t data_size, void ** buffers, int count) {
+
+	const int n = csp_buffer_get_n_internal(data_size, buffers, count, false);
+	if (n < count) {
+		csp_buffer_stats_failed();
+		csp_log_buffer("GET: Out of buffers, got %d of %d", n, count);
+	}
+	csp_log_buffer("GET: %d buffers", n);
+	return n;
+
+}
+
+int csp_buffer_get_n_isr(size_t data_size, void ** buffers, int count) {
+	const int n = csp_buffer_get_n_internal(data_size, buffers, count, true);
+	if (n < count) {
+		csp_buffer_stats_failed();
+	}
+	return n;
+}
+
+static void csp_buffer_free_n_internal(void * const * packets, int count, bool isr) {
+
+	while (count > 0) {
+
+		/* Drop references and collect buffers to release, a batch at a time */
+		csp_skbf_t * release[CSP_BUFFER_FREE_BATCH];
+		unsigned int released = 0;
+		for (; (count > 0) && (released < CSP_BUFFER_FREE_BATCH); --count, ++packets) {
+
+			if (*packets == NULL) {
+				continue;
+			}
+
+			csp_skbf_t * buf = csp_buffer_to_skbf(*packets);
+
+			if ((((uintptr_t) buf % CSP_BUFFER_ALIGN) > 0) || (buf->skbf_addr != buf) || (buf->pool >= csp_buffer_pool_count)) {
+				if (!isr) {
+					csp_log_error("FREE: Invalid CSP buffer pointer %p", *packets);
+				}
+				continue;
+			}
+
+			if (csp_buffer_refcount_get(buf) == 0) {
+				if (!isr) {
+					csp_log_error("FREE: Buffer already free %p", buf);
+				}
+				continue;
+			}
+
+			if (csp_buffer_refcount_dec(buf) > 0) {
+				continue;
+			}
+
+			release[released++] = buf;
+		}
+
+		/* Return to pools, one operation per pool */
+		for (unsigned int pool = 0; (pool < csp_buffer_pool_count) && (released > 0); ++pool) {
+			csp_skbf_t * batch[CSP_BUFFER_FREE_BATCH];
+			unsigned int batch_count = 0;
+			unsigned int keep = 0;
+			for (unsigned int i = 0; i < released; ++i) {
+				if (release[i]->pool == pool) {
+					batch[batch_count++] = release[i];
+				} else {
+					release[keep++] = release[i];
+				}
+			}
+			released = keep;
+			if (batch_count > 0) {
+				csp_buffer_stats_put(pool, batch_count);
+				csp_buffer_pool_put_n(batch, batch_count, isr);
+			}
+		}
+	}
+
+}
+
+void csp_buffer_free_n(void * const * buffers, int count) {
+	csp_buffer_free_n_internal(buffers, count, false);
+}
+
+void csp_buffer_free_n_isr(void * const * buffers, int count) {
+	csp_buffer_free_n_internal(buffers, count, true);
+}
+
+/* Copy packet to a new buffer of at least \a data_size, which must be at least the size of the packet's class */
+static csp_packet_t * csp_buffer_copy(const csp_packet_t * packet, size_t data_size) {
+
+	csp_packet_t *clone = csp_buffer_get(data_size);
+	if (clone) {
+		/* Only copy the used part (incl. pushed headers), the rest of the buffer is undefined anyway */
+		const csp_skbf_t * buf = csp_buffer_to_skbf(packet);
+		const size_t length = csp_buffer_length(buf, packet);
+		const size_t front = (buf->head > offsetof(csp_packet_t, id)) ? (buf->head - offsetof(csp_packet_t, id)) : 0;
+		memcpy(((uint8_t *) clone) - front, ((uint8_t *) packet) - front, front + CSP_BUFFER_PACKET_OVERHEAD + length);
+		csp_skbf_t * clone_buf = csp_buffer_to_skbf(clone);
+		clone_buf->head = buf->head;
+		clone_buf->length = buf->length;
+	}
+
+	return clone;
 
 }
 
@@ -202,23 +929,262 @@ void *csp_buffer_clone(void *buffer) {
 		return NULL;
 	}
 
-	csp_packet_t *clone = csp_buffer_get(packet->length);
-	if (clone) {
-		memcpy(clone, packet, csp_buffer_size());
+	/* Same class as the original, so the clone has room for the same trailers */
+	return csp_buffer_copy(packet, csp_buffer_data_size_of(packet));
+
+}
+
+void * csp_buffer_resize(void * buffer, size_t data_size) {
+
+	csp_packet_t * packet = (csp_packet_t *) buffer;
+	if ((packet == NULL) || (csp_buffer_data_size_of(packet) >= data_size)) {
+		return packet;
 	}
 
-	return clone;
+	csp_packet_t * resized = csp_buffer_copy(packet, data_size);
+	csp_buffer_free(packet);
+
+	return resized;
+
+}
+
+void * csp_buffer_ref(void * buffer) {
+
+	if (buffer == NULL) {
+		return NULL;
+	}
+
+	csp_skbf_t * buf = csp_buffer_to_skbf(buffer);
+
+	if ((((uintptr_t) buf % CSP_BUFFER_ALIGN) > 0) || (buf->skbf_addr != buf) || (buf->pool >= csp_buffer_pool_count)) {
+		csp_log_error("REF: Invalid CSP buffer pointer %p", buffer);
+		return NULL;
+	}
+
+	if (csp_buffer_refcount_get(buf) == 0) {
+		csp_log_error("REF: Buffer is free %p", buf);
+		return NULL;
+	}
+
+	csp_buffer_refcount_inc(buf);
+	return buffer;
+
+}
+
+bool csp_buffer_is_shared(const void * buffer) {
+
+	const csp_skbf_t * buf = csp_buffer_to_skbf(buffer);
+	return (csp_buffer_refcount_get(buf) > 1);
+
+}
+
+void * csp_buffer_unshare(void * buffer) {
+
+	if ((buffer == NULL) || !csp_buffer_is_shared(buffer)) {
+		return buffer;
+	}
+
+	void * copy = csp_buffer_clone(buffer);
+	if (copy) {
+		csp_buffer_free(buffer);
+	}
+
+	return copy;
+
+}
+
+size_t csp_buffer_headroom(const csp_packet_t * packet) {
+	return csp_buffer_headroom_size + offsetof(csp_packet_t, id) - csp_buffer_to_skbf(packet)->head;
+}
+
+size_t csp_buffer_tailroom(const csp_packet_t * packet) {
+	const csp_skbf_t * buf = csp_buffer_to_skbf(packet);
+	const size_t size = csp_buffer_pools[buf->pool].data_size + csp_buffer_tailroom_size;
+	const uint16_t length = csp_buffer_length(buf, packet);
+	return (length < size) ? (size - length) : 0;
+}
+
+void * csp_buffer_push(csp_packet_t * packet, size_t len) {
+
+	if (len > csp_buffer_headroom(packet)) {
+		return NULL;
+	}
+
+	csp_skbf_t * buf = csp_buffer_to_skbf(packet);
+	if ((buf->head == 0) && (len > 0)) {
+		/* Length field is about to be overwritten */
+		buf->length = packet->length;
+	}
+	buf->head += len;
+	return ((uint8_t *) &packet->id) - buf->head;
+
+}
+
+void * csp_buffer_pull(csp_packet_t * packet, size_t len) {
+
+	csp_skbf_t * buf = csp_buffer_to_skbf(packet);
+	if (len > buf->head) {
+		return NULL;
+	}
+
+	buf->head -= len;
+	if ((buf->head == 0) && (len > 0)) {
+		packet->length = buf->length;
+	}
+	return ((uint8_t *) &packet->id) - buf->head;
+
+}
+
+void * csp_buffer_put(csp_packet_t * packet, size_t len) {
+
+	if (len > csp_buffer_tailroom(packet)) {
+		return NULL;
+	}
+
+	uint16_t * length = csp_buffer_length_ref(csp_buffer_to_skbf(packet), packet);
+	void * tail = &packet->data[*length];
+	*length += len;
+	return tail;
+
+}
+
+void * csp_buffer_trim(csp_packet_t * packet, size_t len) {
+
+	uint16_t * length = csp_buffer_length_ref(csp_buffer_to_skbf(packet), packet);
+	if (len > *length) {
+		return NULL;
+	}
+
+	*length -= len;
+	return &packet->data[*length];
 
 }
 
 int csp_buffer_remaining(void) {
-	return csp_queue_size(csp_buffers);
+	return csp_buffer_remaining_size(0);
+}
+
+int csp_buffer_remaining_size(size_t data_size) {
+
+	int remaining = 0;
+#if (CSP_USE_BUFFER_CACHE)
+	CSP_ENTER_CRITICAL(csp_buffer_cache_lock);
+#endif
+	for (unsigned int i = 0; i < csp_buffer_pool_count; ++i) {
+		if (csp_buffer_pools[i].data_size >= data_size) {
+			remaining += csp_buffer_pool_remaining(i);
+		}
+	}
+#if (CSP_USE_BUFFER_CACHE)
+	CSP_EXIT_CRITICAL(csp_buffer_cache_lock);
+#endif
+	return remaining;
+
+}
+
+int csp_buffer_get_stats(csp_buffer_stats_t * stats, bool owners) {
+
+	memset(stats, 0, sizeof(*stats));
+
+	stats->pool_count = csp_buffer_pool_count;
+	for (unsigned int i = 0; i < csp_buffer_pool_count; ++i) {
+		const csp_buffer_pool_t * pool = &csp_buffer_pools[i];
+		csp_buffer_pool_stats_t * pool_stats = &stats->pool[i];
+		pool_stats->data_size = pool->data_size;
+		pool_stats->count = pool->count;
+#if (CSP_USE_BUFFER_STATS)
+		pool_stats->in_use = pool->in_use;
+		pool_stats->peak = pool->peak;
+		pool_stats->gets = pool->gets;
+		pool_stats->frees = pool->frees;
+
+		if (owners) {
+			for (unsigned int j = 0; j < pool->count; ++j) {
+				const csp_skbf_t * buf = (const void *) &pool->memory[j * pool->skbfsize];
+				if ((csp_buffer_refcount_get(buf) > 0) && (buf->owner < CSP_BUFFER_OWNER_COUNT)) {
+					stats->owner[buf->owner]++;
+				}
+			}
+		}
+#else
+#if (CSP_USE_BUFFER_CACHE)
+		CSP_ENTER_CRITICAL(csp_buffer_cache_lock);
+#endif
+		pool_stats->in_use = pool->count - csp_buffer_pool_remaining(i);
+#if (CSP_USE_BUFFER_CACHE)
+		CSP_EXIT_CRITICAL(csp_buffer_cache_lock);
+#endif
+		(void) owners;
+#endif
+	}
+
+#if (CSP_USE_BUFFER_STATS)
+	stats->failures = csp_buffer_get_failures;
+#endif
+
+	return CSP_ERR_NONE;
+
+}
+
+void csp_buffer_reset_stats(void) {
+#if (CSP_USE_BUFFER_STATS)
+	for (unsigned int i = 0; i < csp_buffer_pool_count; ++i) {
+		csp_buffer_pool_t * pool = &csp_buffer_pools[i];
+		pool->peak = pool->in_use;
+		pool->gets = 0;
+		pool->frees = 0;
+	}
+	csp_buffer_get_failures = 0;
+#endif
+}
+
+#if (CSP_USE_BUFFER_STATS)
+void csp_buffer_set_owner(void * buffer, csp_buffer_owner_t owner) {
+	if (buffer) {
+		csp_buffer_to_skbf(buffer)->owner = owner;
+	}
+}
+#endif
+
+int csp_buffer_cache_get_stats(csp_buffer_cache_stats_t * stats) {
+#if (CSP_USE_BUFFER_CACHE)
+	CSP_ENTER_CRITICAL(csp_buffer_cache_lock);
+	*stats = csp_buffer_cache_retired;
+	for (csp_buffer_cache_t * cache = csp_buffer_caches; cache; cache = cache->next) {
+		stats->hits += cache->stats.hits;
+		stats->refills += cache->stats.refills;
+		stats->drains += cache->stats.drains;
+		stats->cross_thread_frees += cache->stats.cross_thread_frees;
+	}
+	CSP_EXIT_CRITICAL(csp_buffer_cache_lock);
+	return CSP_ERR_NONE;
+#else
+	memset(stats, 0, sizeof(*stats));
+	return CSP_ERR_NOTSUP;
+#endif
+}
+
+void csp_buffer_cache_flush(void) {
+#if (CSP_USE_BUFFER_CACHE)
+	csp_buffer_cache_t * cache = csp_buffer_cache_get();
+	for (unsigned int i = 0; i < csp_buffer_pool_count; ++i) {
+		csp_buffer_cache_drain(cache, i, cache->magazine[i].count);
+	}
+#endif
 }
 
 size_t csp_buffer_size(void) {
-	return (csp_conf.buffer_data_size + CSP_BUFFER_PACKET_OVERHEAD);
+	return (csp_buffer_data_size() + CSP_BUFFER_PACKET_OVERHEAD);
 }
 
 size_t csp_buffer_data_size(void) {
-	return csp_conf.buffer_data_size;
+	if (csp_buffer_pool_count == 0) {
+		return csp_conf.buffer_data_size;
+	}
+	return csp_buffer_pools[csp_buffer_pool_count - 1].data_size;
+}
+
+size_t csp_buffer_data_size_of(const void * buffer) {
+	const csp_skbf_t * buf = csp_buffer_to_skbf(buffer);
+	return csp_buffer_pools[buf->pool].data_size;
 }
@@ -29,6 +29,8 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
 #include <csp/arch/csp_malloc.h>
 #include <csp/arch/csp_time.h>
 #include "csp_init.h"
+#include "csp_poll.h"
+#include "csp_qfifo.h"
 #include "transport/csp_transport.h"
 
 /* Connection pool */
@@ -43,16 +45,256 @@ static uint8_t sport;
 /* Source port lock */
 static csp_bin_sem_handle_t sport_lock;
 
-void csp_conn_check_timeouts(void) {
+/* Hash index of open client connections on the incoming identifier (CSP_ID_CONN_MASK), protected by conn_lock for updates */
+static csp_conn_t ** conn_hash;
+static uint32_t conn_hash_mask;
+
+/* Number of connections with queues created, protected by conn_lock */
+static uint16_t conn_created;
+
+/* Number of client connections using a local port (incoming destination port), protected by conn_lock */
+static uint16_t conn_port_refs[CSP_ID_PORT_MAX + 1];
+
+/* Bitmap of local ports in use, i.e. conn_port_refs > 0 */
+static uint32_t conn_port_used[(CSP_ID_PORT_MAX + 32) / 32];
+
 #if (CSP_USE_RDP)
-	for (int i = 0; i < csp_conf.conn_max; i++) {
-		if (arr_conn[i].state == CONN_OPEN) {
-			if (arr_conn[i].idin.flags & CSP_FRDP) {
-				csp_rdp_check_timeouts(&arr_conn[i]);
+
+#ifndef CSP_CONN_TIMER_TICK_MS
+/**
+ * Resolution of connection timeouts (RDP retransmission, delayed ACK, connection and close-wait timeouts).
+ */
+#define CSP_CONN_TIMER_TICK_MS	10
+#endif
+
+/**
+ * Connection timers of a router worker.
+ * The timers are started by any task, but only run by the router worker, see csp_conn_check_timeouts().
+ */
+typedef struct {
+	csp_timer_wheel_t wheel;
+	csp_mutex_t lock;		/* Protects the wheel and the expired list */
+	bool lock_created;
+	csp_conn_t * expired;		/* Connections with an expired timer, linked by timer_next */
+	uint32_t wakeup;		/* Time the router worker sleeps until, unless idle */
+	bool idle;			/* Router worker sleeps until the next packet */
+} csp_conn_timers_t;
+
+static csp_conn_timers_t conn_timers[CSP_ROUTE_WORKERS_MAX];
+
+/* Timer callback, called from csp_timer_wheel_run() with the timer lock held - queue the connection for csp_conn_check_timeouts() */
+static void csp_conn_timer_expired(csp_timer_t * timer, void * context) {
+
+	csp_conn_t * conn = context;
+	csp_conn_timers_t * timers = &conn_timers[conn->timer_shard];
+
+	if (!conn->timer_expired) {
+		conn->timer_expired = true;
+		conn->timer_next = timers->expired;
+		timers->expired = conn;
+	}
+
+}
+
+#endif
+
+static inline uint32_t csp_conn_hash(uint32_t id) {
+
+	/* Multiplicative hash, conn_hash_mask + 1 is a power of two */
+	return (((id & CSP_ID_CONN_MASK) * 2654435761u) >> 16) & conn_hash_mask;
+
+}
+
+static inline bool csp_conn_port_is_used(unsigned int port) {
+
+	return (conn_port_used[port / 32] & (1u << (port % 32))) != 0;
+
+}
+
+/* Add client connection to hash index and port map - call with conn_lock held */
+static void csp_conn_index_add(csp_conn_t * conn) {
+
+	const uint32_t bucket = csp_conn_hash(conn->idin.ext);
+	/* Lookups are done without the lock: hash_next (release) publishes idin, the bucket (release) publishes hash_next */
+	__atomic_store_n(&conn->hash_next, conn_hash[bucket], __ATOMIC_RELEASE);
+	__atomic_store_n(&conn_hash[bucket], conn, __ATOMIC_RELEASE);
+
+	const unsigned int port = conn->idin.dport;
+	if (conn_port_refs[port]++ == 0) {
+		conn_port_used[port / 32] |= (1u << (port % 32));
+	}
+
+}
+
+/* Remove client connection from hash index and port map - call with conn_lock held */
+static void csp_conn_index_remove(csp_conn_t * conn) {
+
+	for (csp_conn_t ** pnext = &conn_hash[csp_conn_hash(conn->idin.ext)]; *pnext; pnext = &(*pnext)->hash_next) {
+		if (*pnext == conn) {
+			/* conn->hash_next is left intact, so a concurrent lookup standing on conn can continue */
+			__atomic_store_n(pnext, conn->hash_next, __ATOMIC_RELEASE);
+
+			const unsigned int port = conn->idin.dport;
+			if (--conn_port_refs[port] == 0) {
+				conn_port_used[port / 32] &= ~(1u << (port % 32));
+			}
+			return;
+		}
+	}
+
+}
+
+/* Remove queues of a connection */
+static void csp_conn_remove_queues(csp_conn_t * conn) {
+
+	for (int prio = 0; prio < CSP_RX_QUEUES; prio++) {
+		if (conn->rx_queue[prio]) {
+			csp_queue_remove(conn->rx_queue[prio]);
+			conn->rx_queue[prio] = NULL;
+		}
+	}
+
+#if (CSP_USE_QOS)
+	if (conn->rx_event) {
+		csp_queue_remove(conn->rx_event);
+		conn->rx_event = NULL;
+	}
+#endif
+
+}
+
+/* Create queues of a connection, kept until csp_conn_free_resources() - call with conn_lock held (or during init) */
+static int csp_conn_create_queues(csp_conn_t * conn) {
+
+	for (int prio = 0; prio < CSP_RX_QUEUES; prio++) {
+		conn->rx_queue[prio] = csp_queue_create(csp_conf.conn_queue_length, sizeof(csp_packet_t *));
+		if (conn->rx_queue[prio] == NULL) {
+			csp_log_error("rx_queue = csp_queue_create() failed");
+			csp_conn_remove_queues(conn);
+			return CSP_ERR_NOMEM;
+		}
+	}
+
+#if (CSP_USE_QOS)
+	conn->rx_event = csp_queue_create(csp_conf.conn_queue_length, sizeof(int));
+	if (conn->rx_event == NULL) {
+		csp_log_error("rx_event = csp_queue_create() failed");
+		csp_conn_remove_queues(conn);
+		return CSP_ERR_NOMEM;
+	}
+#endif
+
+#if (CSP_USE_RDP)
+	csp_timer_init(&conn->timer, csp_conn_timer_expired, conn);
+	if (csp_rdp_init(conn) != CSP_ERR_NONE) {
+		csp_log_error("csp_rdp_allocate(conn) failed");
+		csp_conn_remove_queues(conn);
+		return CSP_ERR_NOMEM;
+	}
+#endif
+
+	conn_created++;
+
+	return CSP_ERR_NONE;
+
+}
+
+#if (CSP_USE_RDP)
+
+void csp_conn_timer_start(csp_conn_t * conn, uint32_t expires) {
+
+	const unsigned int shard = csp_qfifo_shard(conn->idin);
+	csp_conn_timers_t * timers = &conn_timers[shard];
+	bool wake = false;
+
+	csp_mutex_lock(&timers->lock, CSP_MAX_TIMEOUT);
+
+	/* A connection only has one timer, keep the first expiry */
+	if (!csp_timer_pending(&conn->timer) || ((int32_t)(expires - conn->timer.expires) < 0)) {
+		conn->timer_shard = shard;
+		csp_timer_start(&timers->wheel, &conn->timer, expires);
+
+		/* Wake the router worker, if it sleeps past the new expiry */
+		if (timers->idle || ((int32_t)(expires - timers->wakeup) < 0)) {
+			timers->idle = false;
+			timers->wakeup = expires;
+			wake = true;
+		}
+	}
+
+	csp_mutex_unlock(&timers->lock);
+
+	if (wake) {
+		csp_qfifo_wake_up_shard(shard);
+	}
+
+}
+
+void csp_conn_timer_stop(csp_conn_t * conn) {
+
+	csp_conn_timers_t * timers = &conn_timers[conn->timer_shard];
+
+	csp_mutex_lock(&timers->lock, CSP_MAX_TIMEOUT);
+
+	csp_timer_stop(&timers->wheel, &conn->timer);
+
+	if (conn->timer_expired) {
+		for (csp_conn_t ** pnext = &timers->expired; *pnext; pnext = &(*pnext)->timer_next) {
+			if (*pnext == conn) {
+				*pnext = conn->timer_next;
+				break;
 			}
 		}
+		conn->timer_expired = false;
+	}
+
+	csp_mutex_unlock(&timers->lock);
+
+}
+
+#endif
+
+uint32_t csp_conn_check_timeouts(unsigned int shard, unsigned int * expired) {
+
+	unsigned int count = 0;
+	uint32_t timeout = CSP_MAX_TIMEOUT;
+
+#if (CSP_USE_RDP)
+	csp_conn_timers_t * timers = &conn_timers[shard];
+
+	csp_mutex_lock(&timers->lock, CSP_MAX_TIMEOUT);
+	csp_timer_wheel_run(&timers->wheel, csp_get_ms());
+
+	/* Handle expired connections without the timer lock, as the handler starts/stops timers.
+	 * A connection closed by another task meanwhile is removed from the list by csp_conn_timer_stop() */
+	csp_conn_t * conn;
+	while ((conn = timers->expired) != NULL) {
+		timers->expired = conn->timer_next;
+		conn->timer_expired = false;
+		csp_mutex_unlock(&timers->lock);
+
+		if ((conn->state == CONN_OPEN) && (conn->idin.flags & CSP_FRDP)) {
+			csp_rdp_check_timeouts(conn);
+		}
+		count++;
+
+		csp_mutex_lock(&timers->lock, CSP_MAX_TIMEOUT);
 	}
+
+	/* Sleep until the next timer, a timer started with an earlier expiry wakes the router worker */
+	const uint32_t now = csp_get_ms();
+	timeout = csp_timer_wheel_next(&timers->wheel, now);
+	timers->idle = (timeout == CSP_MAX_TIMEOUT);
+	timers->wakeup = now + timeout;
+	csp_mutex_unlock(&timers->lock);
 #endif
+
+	if (expired) {
+		*expired = count;
+	}
+
+	return timeout;
+
 }
 
 int csp_conn_get_rxq(int prio) {
@@ -77,6 +319,7 @@ int csp_conn_enqueue_packet(csp_conn_t * conn, csp_packet_t * packet) {
 		rxq = CSP_RX_QUEUES - 1;
 	}
 
+	csp_buffer_set_owner(packet, CSP_BUFFER_OWNER_CONN_RX);
 	if (csp_queue_enqueue(conn->rx_queue[rxq], &packet, 0) != CSP_QUEUE_OK) {
 		csp_log_error("RX queue %p full with %u items", conn->rx_queue[rxq], csp_queue_size(conn->rx_queue[rxq]));
 		return CSP_ERR_NOMEM;
@@ -90,6 +333,8 @@ int csp_conn_enqueue_packet(csp_conn_t * conn, csp_packet_t * packet) {
 	}
 #endif
 
+	csp_poll_signal(conn);
+
 	return CSP_ERR_NONE;
 }
 
@@ -101,6 +346,20 @@ int csp_conn_init(void) {
 		return CSP_ERR_NOMEM;
 	}
 
+	/* Hash index, at least twice the number of connections */
+	uint32_t buckets = 1;
+	while (buckets < (2 * (uint32_t) csp_conf.conn_max)) {
+		buckets <<= 1;
+	}
+	conn_hash = csp_calloc(buckets, sizeof(*conn_hash));
+	if (conn_hash == NULL) {
+		csp_log_error("Allocation for %"PRIu32" connection hash buckets failed", buckets);
+		return CSP_ERR_NOMEM;
+	}
+	conn_hash_mask = buckets - 1;
+	memset(conn_port_refs, 0, sizeof(conn_port_refs));
+	memset(conn_port_used, 0, sizeof(conn_port_used));
+
 	if (csp_bin_sem_create(&conn_lock) != CSP_SEMAPHORE_OK) {
 		csp_log_error("csp_bin_sem_create(&conn_lock) failed");
 		return CSP_ERR_NOMEM;
@@ -115,30 +374,29 @@ int csp_conn_init(void) {
 		return CSP_ERR_NOMEM;
 	}
 
-	for (int i = 0; i < csp_conf.conn_max; i++) {
-		csp_conn_t * conn = &arr_conn[i];
-		for (int prio = 0; prio < CSP_RX_QUEUES; prio++) {
-			conn->rx_queue[prio] = csp_queue_create(csp_conf.conn_queue_length, sizeof(csp_packet_t *));
-			if (conn->rx_queue[prio] == NULL) {
-				csp_log_error("rx_queue = csp_queue_create() failed");
+#if (CSP_USE_RDP)
+	/* Connection timers of each router worker */
+	for (unsigned int i = 0; i < csp_qfifo_shard_count(); i++) {
+		csp_conn_timers_t * timers = &conn_timers[i];
+		if (!timers->lock_created) {
+			if (csp_mutex_create(&timers->lock) != CSP_MUTEX_OK) {
+				csp_log_error("csp_mutex_create(&timers->lock) failed");
 				return CSP_ERR_NOMEM;
 			}
+			timers->lock_created = true;
 		}
-
-#if (CSP_USE_QOS)
-		conn->rx_event = csp_queue_create(csp_conf.conn_queue_length, sizeof(int));
-		if (conn->rx_event == NULL) {
-			csp_log_error("rx_event = csp_queue_create() failed");
-			return CSP_ERR_NOMEM;
-		}
+		csp_timer_wheel_init(&timers->wheel, CSP_CONN_TIMER_TICK_MS, csp_get_ms());
+		timers->expired = NULL;
+		timers->idle = true;
+	}
 #endif
 
-#if (CSP_USE_RDP)
-		if (csp_rdp_init(conn) != CSP_ERR_NONE) {
-			csp_log_error("csp_rdp_allocate(conn) failed");
+	/* Create queues for the first connections, the remaining are created on first use by csp_conn_allocate() */
+	conn_created = 0;
+	for (unsigned int i = 0; (i < csp_conf.conn_prealloc) && (i < csp_conf.conn_max); i++) {
+		if (csp_conn_create_queues(&arr_conn[i]) != CSP_ERR_NONE) {
 			return CSP_ERR_NOMEM;
 		}
-#endif
 	}
 
 	return CSP_ERR_NONE;
@@ -152,26 +410,25 @@ void csp_conn_free_resources(void) {
 	for (unsigned int i = 0; i < csp_conf.conn_max; i++) {
             csp_conn_t * conn = &arr_conn[i];
 
-            for (int prio = 0; prio < CSP_RX_QUEUES; prio++) {
-                if (conn->rx_queue[prio]) {
-                    csp_queue_remove(conn->rx_queue[prio]);
-                }
+            if (conn->rx_queue[0] == NULL) {
+                // queues never created
+                continue;
             }
 
-#if (CSP_USE_QOS)
-            if (conn->rx_event) {
-                csp_queue_remove(conn->rx_event);
-            }
-#endif
+            csp_conn_remove_queues(conn);
 
 #if (CSP_USE_RDP)
             csp_rdp_free_resources(conn);
 #endif
 	}
+        conn_created = 0;
 
         csp_free(arr_conn);
         arr_conn = NULL;
 
+        csp_free(conn_hash);
+        conn_hash = NULL;
+
         //csp_bin_sem_remove(&conn_lock);
         memset(&conn_lock, 0, sizeof(conn_lock));
 
@@ -180,10 +437,40 @@ void csp_conn_free_resources(void) {
 
         sport = 0;
     }
+
+#if (CSP_USE_RDP)
+    for (unsigned int i = 0; i < CSP_ROUTE_WORKERS_MAX; i++) {
+        if (conn_timers[i].lock_created) {
+            csp_mutex_remove(&conn_timers[i].lock);
+            conn_timers[i].lock_created = false;
+        }
+    }
+#endif
 }
 
 csp_conn_t * csp_conn_find(uint32_t id, uint32_t mask) {
 
+	if (mask == CSP_ID_CONN_MASK) {
+		/* Lookup in hash index, without the lock */
+		id = (id & mask);
+		const uint32_t bucket = csp_conn_hash(id);
+		csp_conn_t * conn = __atomic_load_n(&conn_hash[bucket], __ATOMIC_ACQUIRE);
+		while (conn) {
+			csp_conn_t * next = __atomic_load_n(&conn->hash_next, __ATOMIC_ACQUIRE);
+			const uint32_t idin = __atomic_load_n(&conn->idin.ext, __ATOMIC_RELAXED);
+			if (csp_conn_hash(idin) != bucket) {
+				/* Closed and reused in another bucket meanwhile, so next belongs to that bucket - restart */
+				conn = __atomic_load_n(&conn_hash[bucket], __ATOMIC_ACQUIRE);
+				continue;
+			}
+			if ((conn->state == CONN_OPEN) && (conn->type == CONN_CLIENT) && ((idin & mask) == id)) {
+				return conn;
+			}
+			conn = next;
+		}
+		return NULL;
+	}
+
 	/* Search for matching connection */
 	id = (id & mask);
 	for (int i = 0; i < csp_conf.conn_max; i++) {
@@ -199,15 +486,15 @@ csp_conn_t * csp_conn_find(uint32_t id, uint32_t mask) {
 
 static int csp_conn_flush_rx_queue(csp_conn_t * conn) {
 
-	csp_packet_t * packet;
+	void * packets[CSP_BUFFER_FREE_BATCH];
+	int count;
 
 	int prio;
 
 	/* Flush packet queues */
 	for (prio = 0; prio < CSP_RX_QUEUES; prio++) {
-		while (csp_queue_dequeue(conn->rx_queue[prio], &packet, 0) == CSP_QUEUE_OK)
-			if (packet != NULL)
-				csp_buffer_free(packet);
+		while ((count = csp_queue_dequeue_n(conn->rx_queue[prio], packets, CSP_BUFFER_FREE_BATCH, 0)) > 0)
+			csp_buffer_free_n(packets, count);
 	}
 
 	/* Flush event queue */
@@ -222,7 +509,7 @@ static int csp_conn_flush_rx_queue(csp_conn_t * conn) {
 
 csp_conn_t * csp_conn_allocate(csp_conn_type_t type) {
 
-	static uint8_t csp_conn_last_given = 0;
+	static unsigned int csp_conn_last_given = 0;
 
 	if (csp_bin_sem_wait(&conn_lock, CSP_MAX_TIMEOUT) != CSP_SEMAPHORE_OK) {
 		csp_log_error("Failed to lock conn array");
@@ -231,8 +518,8 @@ csp_conn_t * csp_conn_allocate(csp_conn_type_t type) {
 
 	/* Search for free connection */
 	csp_conn_t * conn = NULL;
-	int i = csp_conn_last_given;
-	for (int j = 0; j < csp_conf.conn_max; j++) {
+	unsigned int i = csp_conn_last_given;
+	for (unsigned int j = 0; j < csp_conf.conn_max; j++) {
 		i = (i + 1) % csp_conf.conn_max;
 		conn = &arr_conn[i];
 		if (conn->state == CONN_CLOSED) {
@@ -240,11 +527,22 @@ csp_conn_t * csp_conn_allocate(csp_conn_type_t type) {
 		}
 	}
 
+	if (conn && (conn->state == CONN_CLOSED) && (conn->rx_queue[0] == NULL) && (csp_conn_create_queues(conn) != CSP_ERR_NONE)) {
+		csp_bin_sem_post(&conn_lock);
+		csp_log_error("Failed to create queues for connection %u", i);
+		return NULL;
+	}
+
 	if (conn && (conn->state == CONN_CLOSED)) {
-		conn->idin.ext = 0;
+		/* idin may be read concurrently by csp_conn_find() */
+		__atomic_store_n(&conn->idin.ext, 0, __ATOMIC_RELAXED);
 		conn->idout.ext = 0;
 		conn->socket = NULL;
+		conn->listener = NULL;
 		conn->timestamp = 0;
+#if (CSP_USE_RDP)
+		conn->rdp.socket_opt = false;
+#endif
 		conn->type = type;
 		conn->state = CONN_OPEN;
 		csp_conn_last_given = i;
@@ -271,12 +569,18 @@ csp_conn_t * csp_conn_new(csp_id_t idin, csp_id_t idout) {
 	if (conn) {
 		/* No lock is needed here, because nobody else *
 		 * has a reference to this connection yet.     */
-		conn->idin.ext = idin.ext;
+		__atomic_store_n(&conn->idin.ext, idin.ext, __ATOMIC_RELAXED);
 		conn->idout.ext = idout.ext;
 		conn->timestamp = csp_get_ms();
 
 		/* Ensure connection queue is empty */
 		csp_conn_flush_rx_queue(conn);
+
+		/* Make connection visible to csp_conn_find() */
+		if (csp_bin_sem_wait(&conn_lock, CSP_MAX_TIMEOUT) == CSP_SEMAPHORE_OK) {
+			csp_conn_index_add(conn);
+			csp_bin_sem_post(&conn_lock);
+		}
 	}
 
 	return conn;
@@ -284,6 +588,10 @@ csp_conn_t * csp_conn_new(csp_id_t idin, csp_id_t idout) {
 }
 
 int csp_close(csp_conn_t * conn) {
+    if (conn) {
+        /* Connection is no longer known by userspace */
+        csp_poll_conn_remove(conn);
+    }
     return csp_conn_close(conn, CSP_RDP_CLOSED_BY_USERSPACE);
 }
 
@@ -307,6 +615,13 @@ int csp_conn_close(csp_conn_t * conn, uint8_t closed_by) {
 	}
 #endif
 
+	csp_poll_conn_remove(conn);
+
+#if (CSP_USE_RDP)
+	/* Stop timer, before the connection (and identifier) can be reused */
+	csp_conn_timer_stop(conn);
+#endif
+
 	/* Lock connection array while closing connection */
 	if (csp_bin_sem_wait(&conn_lock, CSP_MAX_TIMEOUT) != CSP_SEMAPHORE_OK) {
 		csp_log_error("Failed to lock conn array");
@@ -316,6 +631,10 @@ int csp_conn_close(csp_conn_t * conn, uint8_t closed_by) {
 	/* Set to closed */
 	conn->state = CONN_CLOSED;
 
+	if (conn->type == CONN_CLIENT) {
+		csp_conn_index_remove(conn);
+	}
+
 	/* Ensure connection queue is empty */
 	csp_conn_flush_rx_queue(conn);
 
@@ -337,11 +656,24 @@ int csp_conn_close(csp_conn_t * conn, uint8_t closed_by) {
 	return CSP_ERR_NONE;
 }
 
-csp_conn_t * csp_connect(uint8_t prio, uint8_t dest, uint8_t dport, uint32_t timeout, uint32_t opts) {
+/* Options stored in csp_conn_t.opts for a client connection opened with \a opts */
+uint32_t csp_conn_client_opts(uint32_t opts) {
 
 	/* Force options on all connections */
 	opts |= csp_conf.conn_dfl_so;
 
+	if (opts & CSP_O_NOCRC32) {
+		opts &= ~CSP_O_CRC32;
+	}
+
+	return opts;
+
+}
+
+static csp_conn_t * csp_connect_internal(uint8_t prio, uint8_t dest, uint8_t dport, uint32_t opts, const csp_rdp_opt_t * rdp_opt) {
+
+	opts = csp_conn_client_opts(opts);
+
 	/* Generate identifier */
 	csp_id_t incoming_id, outgoing_id;
 	incoming_id.pri = prio;
@@ -356,10 +688,6 @@ csp_conn_t * csp_connect(uint8_t prio, uint8_t dest, uint8_t dport, uint32_t tim
 	outgoing_id.flags = 0;
 
 	/* Set connection options */
-	if (opts & CSP_O_NOCRC32) {
-		opts &= ~CSP_O_CRC32;
-	}
-
 	if (opts & CSP_O_RDP) {
 #if (CSP_USE_RDP)
 		incoming_id.flags |= CSP_FRDP;
@@ -413,11 +741,11 @@ csp_conn_t * csp_connect(uint8_t prio, uint8_t dest, uint8_t dport, uint32_t tim
 		if (sport > CSP_ID_PORT_MAX)
 			sport = csp_conf.port_max_bind + 1;
 
-		outgoing_id.sport = sport;
-		incoming_id.dport = sport;
+		/* Match on destination port of _incoming_ identifier, i.e. any client connection using the port */
+		if (!csp_conn_port_is_used(sport)) {
+			outgoing_id.sport = sport;
+			incoming_id.dport = sport;
 
-		/* Match on destination port of _incoming_ identifier */
-		if (csp_conn_find(incoming_id.ext, CSP_ID_DPORT_MASK) == NULL) {
 			/* Break - we found an unused ephemeral port
                            allocate connection while locked to mark port in use */
 			conn = csp_conn_new(incoming_id, outgoing_id);
@@ -440,7 +768,7 @@ csp_conn_t * csp_connect(uint8_t prio, uint8_t dest, uint8_t dport, uint32_t tim
 	if (outgoing_id.flags & CSP_FRDP) {
 		/* If the transport layer has failed to connect
 		 * deallocate connection structure again and return NULL */
-		if (csp_rdp_connect(conn) != CSP_ERR_NONE) {
+		if (csp_rdp_connect(conn, rdp_opt) != CSP_ERR_NONE) {
 			csp_close(conn);
 			return NULL;
 		}
@@ -452,6 +780,24 @@ csp_conn_t * csp_connect(uint8_t prio, uint8_t dest, uint8_t dport, uint32_t tim
 
 }
 
+csp_conn_t * csp_connect(uint8_t prio, uint8_t dest, uint8_t dport, uint32_t timeout, uint32_t opts) {
+
+	return csp_connect_internal(prio, dest, dport, opts, NULL);
+
+}
+
+csp_conn_t * csp_connect_rdp_opt(uint8_t prio, uint8_t dest, uint8_t dport, uint32_t timeout, uint32_t opts, const csp_rdp_opt_t * rdp_opt) {
+
+#if (CSP_USE_RDP)
+	if (rdp_opt && (csp_rdp_check_opt(rdp_opt) != CSP_ERR_NONE)) {
+		return NULL;
+	}
+#endif
+
+	return csp_connect_internal(prio, dest, dport, opts | CSP_O_RDP, rdp_opt);
+
+}
+
 int csp_conn_dport(csp_conn_t * conn) {
 
 	return conn->idin.dport;
@@ -520,6 +866,42 @@ int csp_conn_print_table_str(char * str_buf, int str_size) {
 }
 #endif
 
+int csp_conn_get_mem_stats(csp_conn_mem_stats_t * stats) {
+
+	if ((stats == NULL) || (arr_conn == NULL)) {
+		return CSP_ERR_INVAL;
+	}
+
+	uint32_t queue_size = CSP_RX_QUEUES * csp_conf.conn_queue_length * sizeof(csp_packet_t *);
+#if (CSP_USE_QOS)
+	queue_size += csp_conf.conn_queue_length * sizeof(int);
+#endif
+#if (CSP_USE_RDP)
+	/* TX buffer (window) and RX buffer (2 * window, slots and bitmap), see csp_rdp_init() */
+	queue_size += csp_conf.rdp_max_window * sizeof(csp_rdp_tx_slot_t);
+	queue_size += 2 * csp_conf.rdp_max_window * sizeof(csp_packet_t *);
+	queue_size += ((2 * csp_conf.rdp_max_window) + 31) / 32 * sizeof(uint32_t);
+#endif
+
+	uint16_t conn_open = 0;
+	for (unsigned int i = 0; i < csp_conf.conn_max; i++) {
+		if (arr_conn[i].state == CONN_OPEN) {
+			conn_open++;
+		}
+	}
+
+	stats->conn_max = csp_conf.conn_max;
+	stats->conn_created = conn_created;
+	stats->conn_open = conn_open;
+	stats->conn_size = sizeof(csp_conn_t);
+	stats->queue_size = queue_size;
+	stats->per_conn = stats->conn_size + queue_size;
+	stats->total = (csp_conf.conn_max * stats->conn_size) + (conn_created * queue_size) + ((conn_hash_mask + 1) * sizeof(*conn_hash));
+
+	return CSP_ERR_NONE;
+
+}
+
 const csp_conn_t * csp_conn_get_array(size_t * size)
 {
 	*size = csp_conf.conn_max;
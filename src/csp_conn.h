@@ -25,6 +25,8 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
 #include <csp/arch/csp_queue.h>
 #include <csp/arch/csp_semaphore.h>
 
+#include "csp_timer.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -59,6 +61,17 @@ typedef enum {
 #define CSP_RDP_CLOSED_BY_TIMEOUT    0x04
 #define CSP_RDP_CLOSED_BY_ALL        (CSP_RDP_CLOSED_BY_USERSPACE | CSP_RDP_CLOSED_BY_PROTOCOL | CSP_RDP_CLOSED_BY_TIMEOUT)
 
+/**
+ * RDP retransmit buffer slot
+ */
+typedef struct {
+	csp_packet_t * packet;		/**< Unacknowledged segment, NULL if free (or acknowledged by EACK) */
+	uint32_t timestamp;		/**< Time the segment was (re)transmitted */
+	uint32_t quarantine;		/**< No EACK triggered retransmission before this time */
+	uint8_t retransmits;		/**< Number of retransmissions, no RTT sample if retransmitted (Karn) */
+	bool fast_retransmit;		/**< Marked as lost by EACK, retransmitted without RTO backoff */
+} csp_rdp_tx_slot_t;
+
 /**
  * RDP Connection
  */
@@ -78,11 +91,44 @@ typedef struct {
 	uint32_t ack_timeout;
 	uint32_t ack_delay_count;
 	uint32_t ack_timestamp;
+	bool socket_opt;		/**< Socket only: options set by csp_socket_set_rdp_opt(), used for accepted connections */
+	uint32_t srtt;			/**< Smoothed round trip time (ms) */
+	uint32_t rttvar;		/**< Round trip time variation (ms) */
+	uint32_t rto;			/**< Retransmission timeout (ms), packet_timeout until the first RTT sample */
+	bool rtt_valid;			/**< srtt and rttvar are set from a RTT sample */
+	uint16_t cwnd;			/**< Congestion window (segments), see csp_conf_t.rdp_congestion_control */
+	uint16_t ssthresh;		/**< Slow start threshold (segments) */
+	uint16_t cwnd_count;		/**< Segments acknowledged since last increase of cwnd (congestion avoidance) */
+	uint16_t recover;		/**< snd_nxt when the window was reduced, no further reduction by EACK until acknowledged */
+	bool recovery;			/**< Window has been reduced, waiting for recover to be acknowledged */
+	uint32_t retransmits;		/**< Retransmitted segments */
+	uint32_t fast_retransmits;	/**< Window reductions caused by EACK */
+	uint32_t timeouts;		/**< Window reductions caused by retransmission timeout */
 	csp_bin_sem_handle_t tx_wait;
-	csp_queue_handle_t tx_queue;
-	csp_queue_handle_t rx_queue;
+	csp_mutex_t lock;		/**< Protects the TX and RX buffers */
+	csp_rdp_tx_slot_t * tx_slot;	/**< Retransmit buffer, slot (tx_head + n) % tx_size holds sequence number snd_una + n */
+	uint16_t tx_size;		/**< Number of TX slots (csp_conf_t.rdp_max_window) */
+	uint16_t tx_head;		/**< TX slot of sequence number snd_una */
+	csp_packet_t ** rx_slot;	/**< Out-of-order RX buffer, slot (rx_head + n) % rx_size holds sequence number rcv_cur + 1 + n */
+	uint32_t * rx_map;		/**< Bitmap of used RX slots */
+	uint16_t rx_size;		/**< Number of RX slots (2 * csp_conf_t.rdp_max_window) */
+	uint16_t rx_head;		/**< RX slot of sequence number rcv_cur + 1 */
+	uint16_t rx_count;		/**< Number of segments in the RX buffer */
 } csp_rdp_t;
 
+/**
+ * Poll set membership, see csp_poll_add(). Protected by the poll lock.
+ */
+typedef struct {
+	csp_poll_t * set;		/**< Poll set, NULL if not member of a set */
+	uint8_t events;			/**< Events to wait for */
+	bool ready;			/**< On the ready list of the set */
+	void * context;			/**< User context */
+	struct csp_conn_s * next;	/**< Next member of the set */
+	struct csp_conn_s * prev;	/**< Previous member of the set */
+	struct csp_conn_s * ready_next;	/**< Next connection on the ready list */
+} csp_conn_poll_t;
+
 /** @brief Connection struct */
 struct csp_conn_s {
 	csp_conn_type_t type;		/* Connection type (CONN_CLIENT or CONN_SERVER) */
@@ -96,7 +142,14 @@ struct csp_conn_s {
 	csp_queue_handle_t socket;	/* Socket to be "woken" when first packet is ready */
 	uint32_t timestamp;		/* Time the connection was opened */
 	uint32_t opts;			/* Connection or socket options */
+	struct csp_conn_s * hash_next;	/* Next connection in hash bucket, see csp_conn_find() */
+	struct csp_conn_s * listener;	/* Socket the connection is queued to for csp_accept(), signalled by csp_poll_signal() */
+	csp_conn_poll_t poll;		/* Poll set membership */
 #if (CSP_USE_RDP)
+	csp_timer_t timer;		/* Connection timer (RDP timeouts), on the timer wheel of the router worker */
+	struct csp_conn_s * timer_next;	/* Next connection with an expired timer, see csp_conn_check_timeouts() */
+	uint8_t timer_shard;		/* Router worker of the timer wheel */
+	bool timer_expired;		/* Timer has expired, waiting for csp_conn_check_timeouts() */
 	csp_rdp_t rdp;			/* RDP state */
 #endif
 };
@@ -106,7 +159,10 @@ int csp_conn_init(void);
 csp_conn_t * csp_conn_allocate(csp_conn_type_t type);
 csp_conn_t * csp_conn_find(uint32_t id, uint32_t mask);
 csp_conn_t * csp_conn_new(csp_id_t idin, csp_id_t idout);
-void csp_conn_check_timeouts(void);
+uint32_t csp_conn_client_opts(uint32_t opts);
+uint32_t csp_conn_check_timeouts(unsigned int shard, unsigned int * expired);
+void csp_conn_timer_start(csp_conn_t * conn, uint32_t expires);
+void csp_conn_timer_stop(csp_conn_t * conn);
 int csp_conn_get_rxq(int prio);
 int csp_conn_close(csp_conn_t * conn, uint8_t closed_by);
 
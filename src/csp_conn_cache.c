@@ -0,0 +1,195 @@
+/*
+Cubesat Space Protocol - A small network-layer protocol designed for Cubesats
+Copyright (C) 2012 Gomspace ApS (http://www.gomspace.com)
+Copyright (C) 2012 AAUSAT3 Project (http://aausat3.space.aau.dk)
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "csp_conn_cache.h"
+
+#include <csp/arch/csp_malloc.h>
+#include <csp/arch/csp_semaphore.h>
+#include <csp/arch/csp_time.h>
+#include "csp_init.h"
+#include "csp_conn.h"
+
+/**
+   Idle connection.
+*/
+typedef struct {
+	csp_conn_t * conn;		/**< Connection, NULL if unused */
+	uint32_t idle_since;		/**< Time the connection was returned to the cache */
+} csp_conn_cache_entry_t;
+
+static csp_conn_cache_entry_t * cache;
+static csp_mutex_t cache_lock;
+
+/* Close connections idle for too long - call with cache_lock held */
+static void csp_conn_cache_expire(uint32_t now) {
+
+	for (unsigned int i = 0; i < csp_conf.conn_cache_size; i++) {
+		if (cache[i].conn && ((now - cache[i].idle_since) >= csp_conf.conn_cache_idle_ms)) {
+			csp_close(cache[i].conn);
+			cache[i].conn = NULL;
+		}
+	}
+
+}
+
+/* Return true if an idle connection can still be used */
+static bool csp_conn_cache_usable(csp_conn_t * conn) {
+
+	if (conn->state != CONN_OPEN) {
+		return false;
+	}
+
+#if (CSP_USE_RDP)
+	/* Closed or reset by the other end */
+	if ((conn->idout.flags & CSP_FRDP) && (conn->rdp.state != RDP_OPEN)) {
+		return false;
+	}
+#endif
+
+	return true;
+
+}
+
+int csp_conn_cache_init(void) {
+
+	if (csp_conf.conn_cache_size == 0) {
+		return CSP_ERR_NONE;
+	}
+
+	cache = csp_calloc(csp_conf.conn_cache_size, sizeof(*cache));
+	if (cache == NULL) {
+		csp_log_error("Allocation for %u cached connections failed", csp_conf.conn_cache_size);
+		return CSP_ERR_NOMEM;
+	}
+
+	if (csp_mutex_create(&cache_lock) != CSP_MUTEX_OK) {
+		csp_log_error("csp_mutex_create(&cache_lock) failed");
+		csp_free(cache);
+		cache = NULL;
+		return CSP_ERR_NOMEM;
+	}
+
+	return CSP_ERR_NONE;
+
+}
+
+void csp_conn_cache_free_resources(void) {
+
+	if (cache) {
+		csp_conn_cache_flush();
+		csp_mutex_remove(&cache_lock);
+		csp_free(cache);
+		cache = NULL;
+	}
+
+}
+
+csp_conn_t * csp_conn_cache_get(uint8_t prio, uint8_t dest, uint8_t dport, uint32_t opts) {
+
+	if (cache == NULL) {
+		return NULL;
+	}
+
+	/* Compare with the options stored by csp_connect() */
+	opts = csp_conn_client_opts(opts);
+
+	csp_conn_t * conn = NULL;
+
+	csp_mutex_lock(&cache_lock, CSP_MAX_TIMEOUT);
+	csp_conn_cache_expire(csp_get_ms());
+	for (unsigned int i = 0; i < csp_conf.conn_cache_size; i++) {
+		csp_conn_t * idle = cache[i].conn;
+		if (idle && (idle->idout.dst == dest) && (idle->idout.dport == dport) && (idle->opts == opts)) {
+			cache[i].conn = NULL;
+			if (csp_conn_cache_usable(idle)) {
+				conn = idle;
+				break;
+			}
+			csp_close(idle);
+		}
+	}
+	csp_mutex_unlock(&cache_lock);
+
+	if (conn) {
+		/* Drop anything received while idle */
+		csp_packet_t * packets[8];
+		int read;
+		while ((read = csp_read_many(conn, packets, 8, 0)) > 0) {
+			csp_buffer_free_n((void **) packets, read);
+		}
+		conn->idout.pri = prio;
+	}
+
+	return conn;
+
+}
+
+void csp_conn_cache_put(csp_conn_t * conn, bool reusable) {
+
+	if (conn == NULL) {
+		return;
+	}
+
+	if ((cache == NULL) || !reusable || !csp_conn_cache_usable(conn)) {
+		csp_close(conn);
+		return;
+	}
+
+	const uint32_t now = csp_get_ms();
+
+	csp_mutex_lock(&cache_lock, CSP_MAX_TIMEOUT);
+	csp_conn_cache_expire(now);
+
+	/* Use a free entry, or replace the connection idle for the longest time */
+	csp_conn_cache_entry_t * entry = &cache[0];
+	for (unsigned int i = 0; i < csp_conf.conn_cache_size; i++) {
+		if (cache[i].conn == NULL) {
+			entry = &cache[i];
+			break;
+		}
+		if ((now - cache[i].idle_since) > (now - entry->idle_since)) {
+			entry = &cache[i];
+		}
+	}
+	if (entry->conn) {
+		csp_close(entry->conn);
+	}
+	entry->conn = conn;
+	entry->idle_since = now;
+	csp_mutex_unlock(&cache_lock);
+
+}
+
+void csp_conn_cache_flush(void) {
+
+	if (cache == NULL) {
+		return;
+	}
+
+	csp_mutex_lock(&cache_lock, CSP_MAX_TIMEOUT);
+	for (unsigned int i = 0; i < csp_conf.conn_cache_size; i++) {
+		if (cache[i].conn) {
+			csp_close(cache[i].conn);
+			cache[i].conn = NULL;
+		}
+	}
+	csp_mutex_unlock(&cache_lock);
+
+}
@@ -0,0 +1,61 @@
+/*
+Cubesat Space Protocol - A small network-layer protocol designed for Cubesats
+Copyright (C) 2012 Gomspace ApS (http://www.gomspace.com)
+Copyright (C) 2012 AAUSAT3 Project (http://aausat3.space.aau.dk)
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef _CSP_CONN_CACHE_H_
+#define _CSP_CONN_CACHE_H_
+
+#include <csp/csp.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+   Init connection cache, see csp_conf_t.conn_cache_size.
+   @return #CSP_ERR_NONE on success, otherwise an error code.
+*/
+int csp_conn_cache_init(void);
+
+/**
+   Free connection cache, idle connections are closed.
+*/
+void csp_conn_cache_free_resources(void);
+
+/**
+   Get idle connection from cache.
+   @param[in] prio priority, set on the connection.
+   @param[in] dest destination address.
+   @param[in] dport destination port.
+   @param[in] opts connection options (before csp_conf_t.conn_dfl_so is applied).
+   @return connection, NULL if there is no matching idle connection.
+*/
+csp_conn_t * csp_conn_cache_get(uint8_t prio, uint8_t dest, uint8_t dport, uint32_t opts);
+
+/**
+   Return connection to cache, or close it.
+   @param[in] conn connection.
+   @param[in] reusable true if the connection can be reused, i.e. the last transaction completed.
+*/
+void csp_conn_cache_put(csp_conn_t * conn, bool reusable);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
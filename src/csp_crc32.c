@@ -79,7 +79,7 @@ int csp_crc32_append(csp_packet_t * packet, bool include_header) {
 
 	uint32_t crc;
 
-	if ((packet->length + sizeof(crc)) > csp_buffer_data_size()) {
+	if (csp_buffer_tailroom(packet) < sizeof(crc)) {
 		return CSP_ERR_NOMEM;
 	}
 
@@ -93,8 +93,7 @@ int csp_crc32_append(csp_packet_t * packet, bool include_header) {
 	crc = csp_hton32(crc);
 
 	/* Copy checksum to packet */
-	memcpy(&packet->data[packet->length], &crc, sizeof(crc));
-	packet->length += sizeof(crc);
+	memcpy(csp_buffer_put(packet, sizeof(crc)), &crc, sizeof(crc));
 
 	return CSP_ERR_NONE;
 
@@ -123,7 +122,7 @@ int csp_crc32_verify(csp_packet_t * packet, bool include_header) {
 	}
 
 	/* Strip CRC32 */
-	packet->length -= sizeof(crc);
+	csp_buffer_trim(packet, sizeof(crc));
 	return CSP_ERR_NONE;
 
 }
@@ -25,9 +25,11 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
 
 /**
  * Check for a duplicate packet
+ * Each router worker has its own history - duplicates have the same id, and are therefore always handled by the same worker.
+ * @param shard router worker (input shard)
  * @param packet pointer to packet
  * @return false if not a duplicate, true if duplicate
  */
-bool csp_dedup_is_duplicate(csp_packet_t *packet);
+bool csp_dedup_is_duplicate(unsigned int shard, csp_packet_t *packet);
 
 #endif /* CSP_DEDUP_H_ */
@@ -0,0 +1,289 @@
+/*
+Cubesat Space Protocol - A small network-layer protocol designed for Cubesats
+Copyright (C) 2012 Gomspace ApS (http://www.gomspace.com)
+Copyright (C) 2012 AAUSAT3 Project (http://aausat3.space.aau.dk)
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "csp_iface_txq.h"
+
+#include <csp/csp_iflist.h>
+#include <csp/arch/csp_malloc.h>
+#include <csp/arch/csp_semaphore.h>
+#include <csp/arch/csp_thread.h>
+
+/**
+   Queued packet.
+*/
+typedef struct {
+	csp_packet_t * packet;
+	uint8_t via;
+	csp_shaper_t * shaper;
+} csp_iface_txq_element_t;
+
+/**
+   TX queue, a ring per priority sharing a common max length.
+*/
+typedef struct {
+	csp_iface_t * iface;
+	unsigned int length;
+	unsigned int count;
+	unsigned int head[CSP_PRIORITIES];
+	unsigned int used[CSP_PRIORITIES];
+	csp_iface_txq_element_t * ring[CSP_PRIORITIES];
+	csp_mutex_t lock;
+	csp_bin_sem_handle_t wakeup;
+	volatile bool stop;
+	csp_bin_sem_handle_t stopped;
+} csp_iface_txq_t;
+
+static inline csp_iface_txq_element_t * csp_iface_txq_slot(csp_iface_txq_t * txq, unsigned int prio, unsigned int index) {
+
+	return &txq->ring[prio][(txq->head[prio] + index) % txq->length];
+
+}
+
+static bool csp_iface_txq_pop(csp_iface_txq_t * txq, csp_iface_txq_element_t * element) {
+
+	bool found = false;
+
+	csp_mutex_lock(&txq->lock, CSP_MAX_TIMEOUT);
+
+	/* Highest priority first */
+	for (unsigned int prio = 0; prio < CSP_PRIORITIES; prio++) {
+		if (txq->used[prio]) {
+			*element = *csp_iface_txq_slot(txq, prio, 0);
+			txq->head[prio] = (txq->head[prio] + 1) % txq->length;
+			txq->used[prio]--;
+			txq->count--;
+			txq->iface->txq_len = txq->count;
+			found = true;
+			break;
+		}
+	}
+
+	csp_mutex_unlock(&txq->lock);
+
+	return found;
+
+}
+
+static CSP_DEFINE_TASK(csp_iface_txq_task) {
+
+	csp_iface_txq_t * txq = param;
+	csp_iface_t * iface = txq->iface;
+
+	while (!txq->stop) {
+
+		csp_bin_sem_wait(&txq->wakeup, CSP_MAX_TIMEOUT);
+
+		csp_iface_txq_element_t element;
+		while (!txq->stop && csp_iface_txq_pop(txq, &element)) {
+
+			const csp_route_t ifroute = {.iface = iface, .via = element.via, .shaper = element.shaper};
+
+			/* Store length before passing to interface */
+			const uint16_t bytes = element.packet->length;
+
+			/* Delay packet to conform to rate limits (route and interface) */
+			csp_shaper_wait(element.shaper, bytes);
+			csp_shaper_wait(iface->shaper, bytes);
+
+			if ((*iface->nexthop)(&ifroute, element.packet) == CSP_ERR_NONE) {
+				csp_iface_stat_add(iface, tx, 1);
+				csp_iface_stat_add(iface, txbytes, bytes);
+			} else {
+				csp_buffer_free(element.packet);
+				csp_iface_stat_add(iface, tx_error, 1);
+			}
+		}
+	}
+
+	/* Last access to the queue, csp_iface_txq_stop() frees it */
+	csp_bin_sem_post(&txq->stopped);
+	csp_thread_exit();
+
+	return CSP_TASK_RETURN;
+
+}
+
+int csp_iface_txq_enqueue(const csp_route_t * ifroute, csp_packet_t * packet) {
+
+	csp_iface_t * iface = ifroute->iface;
+	csp_iface_txq_t * txq = iface->txq;
+	csp_packet_t * drop = NULL;
+
+	const unsigned int prio = packet->id.pri;
+
+	csp_mutex_lock(&txq->lock, CSP_MAX_TIMEOUT);
+
+	if (txq->count >= txq->length) {
+		/* Full - make room by dropping the newest packet with the lowest priority, if lower than this packet */
+		for (unsigned int low = CSP_PRIORITIES - 1; low > prio; low--) {
+			if (txq->used[low]) {
+				txq->used[low]--;
+				txq->count--;
+				drop = csp_iface_txq_slot(txq, low, txq->used[low])->packet;
+				break;
+			}
+		}
+		if (drop == NULL) {
+			/* Tail drop */
+			drop = packet;
+		}
+	}
+
+	if (drop != packet) {
+		csp_iface_txq_element_t * element = csp_iface_txq_slot(txq, prio, txq->used[prio]);
+		element->packet = packet;
+		element->via = ifroute->via;
+		element->shaper = ifroute->shaper;
+		txq->used[prio]++;
+		txq->count++;
+		iface->txq_len = txq->count;
+		if (txq->count > iface->txq_peak) {
+			iface->txq_peak = txq->count;
+		}
+	}
+
+	csp_mutex_unlock(&txq->lock);
+
+	if (drop) {
+		/* Only counted here, not as tx_error */
+		csp_iface_stat_add(iface, txq_drop, 1);
+		if (drop == packet) {
+			return CSP_ERR_NOBUFS;
+		}
+		csp_buffer_free(drop);
+	}
+
+	csp_bin_sem_post(&txq->wakeup);
+
+	return CSP_ERR_NONE;
+
+}
+
+int csp_iface_txq_start(csp_iface_t * iface, unsigned int length, unsigned int task_stack_size, unsigned int task_priority) {
+
+	if ((iface == NULL) || (iface->nexthop == NULL) || (length == 0)) {
+		return CSP_ERR_INVAL;
+	}
+
+	if (iface->txq) {
+		return CSP_ERR_ALREADY;
+	}
+
+	csp_iface_txq_t * txq = csp_calloc(1, sizeof(*txq));
+	if (txq == NULL) {
+		return CSP_ERR_NOMEM;
+	}
+
+	txq->iface = iface;
+	txq->length = length;
+	for (unsigned int prio = 0; prio < CSP_PRIORITIES; prio++) {
+		txq->ring[prio] = csp_calloc(length, sizeof(*txq->ring[prio]));
+		if (txq->ring[prio] == NULL) {
+			goto err_ring;
+		}
+	}
+
+	if (csp_mutex_create(&txq->lock) != CSP_MUTEX_OK) {
+		goto err_ring;
+	}
+
+	if (csp_bin_sem_create(&txq->wakeup) != CSP_SEMAPHORE_OK) {
+		goto err_lock;
+	}
+	/* Semaphore is created 'given' - take it, so the drain task blocks until packets are queued */
+	csp_bin_sem_wait(&txq->wakeup, 0);
+
+	if (csp_bin_sem_create(&txq->stopped) != CSP_SEMAPHORE_OK) {
+		goto err_wakeup;
+	}
+	csp_bin_sem_wait(&txq->stopped, 0);
+
+	iface->txq_len = 0;
+	iface->txq_peak = 0;
+	iface->txq_drop = 0;
+
+	int ret = csp_thread_create(csp_iface_txq_task, "TXQ", task_stack_size, txq, task_priority, NULL);
+	if (ret != 0) {
+		csp_log_error("Failed to start TX queue task for %s, error: %d", iface->name, ret);
+		goto err_sem;
+	}
+
+	/* Enable queue, after the drain task is running */
+	iface->txq = txq;
+
+	return CSP_ERR_NONE;
+
+err_sem:
+	csp_bin_sem_remove(&txq->stopped);
+err_wakeup:
+	csp_bin_sem_remove(&txq->wakeup);
+err_lock:
+	csp_mutex_remove(&txq->lock);
+err_ring:
+	for (unsigned int prio = 0; prio < CSP_PRIORITIES; prio++) {
+		csp_free(txq->ring[prio]);
+	}
+	csp_free(txq);
+	return CSP_ERR_NOMEM;
+
+}
+
+int csp_iface_txq_stop(csp_iface_t * iface) {
+
+	if ((iface == NULL) || (iface->txq == NULL)) {
+		return CSP_ERR_INVAL;
+	}
+
+	/* Disable queue, packets are sent directly from now on */
+	csp_iface_txq_t * txq = iface->txq;
+	iface->txq = NULL;
+
+	/* Stop the drain task, after the packet currently being transmitted */
+	txq->stop = true;
+	csp_bin_sem_post(&txq->wakeup);
+	csp_bin_sem_wait(&txq->stopped, CSP_MAX_TIMEOUT);
+
+	/* Release packets still queued */
+	csp_iface_txq_element_t element;
+	while (csp_iface_txq_pop(txq, &element)) {
+		csp_buffer_free(element.packet);
+	}
+
+	csp_bin_sem_remove(&txq->stopped);
+	csp_bin_sem_remove(&txq->wakeup);
+	csp_mutex_remove(&txq->lock);
+	for (unsigned int prio = 0; prio < CSP_PRIORITIES; prio++) {
+		csp_free(txq->ring[prio]);
+	}
+	csp_free(txq);
+
+	return CSP_ERR_NONE;
+
+}
+
+void csp_iface_txq_free_resources(void) {
+
+	for (csp_iface_t * iface = csp_iflist_get(); iface != NULL; iface = iface->next) {
+		if (iface->txq) {
+			csp_iface_txq_stop(iface);
+		}
+	}
+
+}
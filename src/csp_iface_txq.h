@@ -0,0 +1,47 @@
+/*
+Cubesat Space Protocol - A small network-layer protocol designed for Cubesats
+Copyright (C) 2012 Gomspace ApS (http://www.gomspace.com)
+Copyright (C) 2012 AAUSAT3 Project (http://aausat3.space.aau.dk)
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef _CSP_IFACE_TXQ_H_
+#define _CSP_IFACE_TXQ_H_
+
+#include <csp/csp.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+   Queue packet for transmission on the interface TX queue, see csp_iface_txq_start().
+   On success the TX queue takes ownership of the packet, on error the packet must be freed by the caller.
+   @param[in] ifroute route (interface and via).
+   @param[in] packet packet to send.
+   @return #CSP_ERR_NONE if queued, otherwise an error code.
+*/
+int csp_iface_txq_enqueue(const csp_route_t * ifroute, csp_packet_t * packet);
+
+/**
+   Stop TX queues on all interfaces, see csp_iface_txq_stop().
+*/
+void csp_iface_txq_free_resources(void);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -23,6 +23,9 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
 #include <csp/interfaces/csp_if_lo.h>
 #include <csp/arch/csp_time.h>
 #include "csp_conn.h"
+#include "csp_conn_cache.h"
+#include "csp_iface_txq.h"
+#include "csp_poll.h"
 #include "csp_qfifo.h"
 #include "csp_port.h"
 
@@ -49,11 +52,21 @@ int csp_init(const csp_conf_t * conf) {
 		return ret;
 	}
 
+	ret = csp_poll_init();
+	if (ret != CSP_ERR_NONE) {
+		return ret;
+	}
+
 	ret = csp_conn_init();
 	if (ret != CSP_ERR_NONE) {
 		return ret;
 	}
 
+	ret = csp_conn_cache_init();
+	if (ret != CSP_ERR_NONE) {
+		return ret;
+	}
+
 	ret = csp_port_init();
 	if (ret != CSP_ERR_NONE) {
 		return ret;
@@ -79,6 +92,9 @@ int csp_init(const csp_conf_t * conf) {
 
 void csp_free_resources(void) {
 
+	/* Cached connections are closed while routes still exist */
+	csp_conn_cache_free_resources();
+	csp_iface_txq_free_resources();
 	csp_rtable_free();
 	csp_qfifo_free_resources();
 	csp_port_free_resources();
@@ -39,8 +39,10 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
 #include "csp_init.h"
 #include "csp_port.h"
 #include "csp_conn.h"
+#include "csp_conn_cache.h"
 #include "csp_promisc.h"
 #include "csp_qfifo.h"
+#include "csp_iface_txq.h"
 #include "transport/csp_transport.h"
 
 #if (CSP_USE_PROMISC)
@@ -161,12 +163,68 @@ csp_packet_t * csp_read(csp_conn_t * conn, uint32_t timeout) {
 	}
 #endif
 
+	csp_buffer_set_owner(packet, CSP_BUFFER_OWNER_NONE);
 	return packet;
 
 }
 
+int csp_read_many(csp_conn_t * conn, csp_packet_t ** packets, unsigned int max, uint32_t timeout) {
+
+	if ((conn == NULL) || (packets == NULL) || (max == 0) || (conn->state != CONN_OPEN)) {
+		return 0;
+	}
+
+#if (CSP_USE_RDP)
+        // RDP: timeout can either be 0 (for no hang poll/check) or minimum the "connection timeout"
+        if (timeout && (conn->idin.flags & CSP_FRDP) && (timeout < conn->rdp.conn_timeout)) {
+            timeout = conn->rdp.conn_timeout;
+        }
+#endif
+
+	int count = 0;
+
+#if (CSP_USE_QOS)
+	/* Wait for the first event, the remaining events are consumed below - one per packet read */
+	int event;
+	if (csp_queue_dequeue(conn->rx_event, &event, timeout) != CSP_QUEUE_OK) {
+		return 0;
+	}
+
+	for (int prio = 0; (prio < CSP_RX_QUEUES) && ((unsigned int) count < max); prio++) {
+		count += csp_queue_dequeue_n(conn->rx_queue[prio], (void **) &packets[count], max - count, 0);
+	}
+
+	for (int i = 1; i < count; i++) {
+		csp_queue_dequeue(conn->rx_event, &event, 0);
+	}
+#else
+	count = csp_queue_dequeue_n(conn->rx_queue[0], (void **) packets, max, timeout);
+#endif
+
+	/* Remove NULL packets (used to wake up readers) */
+	int read = 0;
+	for (int i = 0; i < count; i++) {
+		if (packets[i]) {
+			csp_buffer_set_owner(packets[i], CSP_BUFFER_OWNER_NONE);
+			packets[read++] = packets[i];
+		}
+	}
+
+#if (CSP_USE_RDP)
+	/* Packets read could trigger ACK transmission */
+	if (read && (conn->idin.flags & CSP_FRDP) && conn->rdp.delayed_acks) {
+		csp_rdp_check_ack(conn);
+	}
+#endif
+
+	return read;
+
+}
+
 int csp_send_direct(csp_id_t idout, csp_packet_t * packet, const csp_route_t * ifroute, uint32_t timeout) {
 
+	csp_packet_t * txpacket = packet;
+
 	if (packet == NULL) {
 		csp_log_error("csp_send_direct called with NULL packet");
 		goto err;
@@ -182,14 +240,33 @@ int csp_send_direct(csp_id_t idout, csp_packet_t * packet, const csp_route_t * i
 	csp_log_packet("OUT: S %u, D %u, Dp %u, Sp %u, Pr %u, Fl 0x%02X, Sz %u VIA: %s (%u)",
                        idout.src, idout.dst, idout.dport, idout.sport, idout.pri, idout.flags, packet->length, ifout->name, (ifroute->via != CSP_NO_VIA_ADDRESS) ? ifroute->via : idout.dst);
 
+	/* The packet is modified below and by the interface, so send a copy if it is shared (e.g. RDP retransmit).
+	   The caller's reference is released on success only, as the caller frees the packet on failure. */
+	if (csp_buffer_is_shared(packet)) {
+		txpacket = csp_buffer_clone(packet);
+		if (txpacket == NULL) {
+			goto tx_err;
+		}
+	}
+
 	/* Copy identifier to packet (before crc, xtea and hmac) */
-	packet->id.ext = idout.ext;
+	txpacket->id.ext = idout.ext;
 
 #if (CSP_USE_PROMISC)
 	/* Loopback traffic is added to promisc queue by the router */
 	if (idout.dst != csp_get_address() && idout.src == csp_get_address()) {
-		packet->id.ext = idout.ext;
-		csp_promisc_add(packet);
+		csp_promisc_add(txpacket);
+		if (csp_buffer_is_shared(txpacket)) {
+			/* Leave the packet to the promiscuous queue, and continue with a copy */
+			csp_packet_t * copy = csp_buffer_clone(txpacket);
+			if (copy == NULL) {
+				goto tx_err;
+			}
+			if (txpacket != packet) {
+				csp_buffer_free(txpacket);
+			}
+			txpacket = copy;
+		}
 	}
 #endif
 
@@ -199,7 +276,7 @@ int csp_send_direct(csp_id_t idout, csp_packet_t * packet, const csp_route_t * i
 		if (idout.flags & CSP_FHMAC) {
 #if (CSP_USE_HMAC)
 			/* Calculate and add HMAC (does not include header for backwards compatability with csp1.x) */
-			if (csp_hmac_append(packet, false) != CSP_ERR_NONE) {
+			if (csp_hmac_append(txpacket, false) != CSP_ERR_NONE) {
 				/* HMAC append failed */
 				csp_log_warn("HMAC append failed!");
 				goto tx_err;
@@ -214,7 +291,7 @@ int csp_send_direct(csp_id_t idout, csp_packet_t * packet, const csp_route_t * i
 		if (idout.flags & CSP_FCRC32) {
 #if (CSP_USE_CRC32)
 			/* Calculate and add CRC32 (does not include header for backwards compatability with csp1.x) */
-			if (csp_crc32_append(packet, false) != CSP_ERR_NONE) {
+			if (csp_crc32_append(txpacket, false) != CSP_ERR_NONE) {
 				/* CRC32 append failed */
 				csp_log_warn("CRC32 append failed!");
 				goto tx_err;
@@ -228,7 +305,7 @@ int csp_send_direct(csp_id_t idout, csp_packet_t * packet, const csp_route_t * i
 		if (idout.flags & CSP_FXTEA) {
 #if (CSP_USE_XTEA)
 			/* Encrypt data */
-			if (csp_xtea_encrypt_packet(packet) != CSP_ERR_NONE) {
+			if (csp_xtea_encrypt_packet(txpacket) != CSP_ERR_NONE) {
 				/* Encryption failed */
 				csp_log_warn("XTEA Encryption failed!");
 				goto tx_err;
@@ -241,21 +318,46 @@ int csp_send_direct(csp_id_t idout, csp_packet_t * packet, const csp_route_t * i
 	}
 
 	/* Store length before passing to interface */
-	uint16_t bytes = packet->length;
+	uint16_t bytes = txpacket->length;
 	uint16_t mtu = ifout->mtu;
 
 	if (mtu > 0 && bytes > mtu)
 		goto tx_err;
 
-	if ((*ifout->nexthop)(ifroute, packet) != CSP_ERR_NONE)
+	if (ifout->txq) {
+		/* Transmitted (shaped and counted) by the interface TX queue task, a dropped packet is counted as txq_drop */
+		if (csp_iface_txq_enqueue(ifroute, txpacket) != CSP_ERR_NONE)
+			goto tx_drop;
+
+		if (txpacket != packet) {
+			csp_buffer_free(packet);
+		}
+		return CSP_ERR_NONE;
+	}
+
+	/* Rate limits - without a TX queue, packets exceeding the rate are dropped. Tokens are only taken, if both route and interface conform */
+	if (!csp_shaper_police_pair(ifroute->shaper, ifout->shaper, bytes)) {
+		csp_log_packet("Rate limit exceeded on %s, dropping packet", ifout->name);
+		goto tx_err;
+	}
+
+	if ((*ifout->nexthop)(ifroute, txpacket) != CSP_ERR_NONE)
 		goto tx_err;
 
-	ifout->tx++;
-	ifout->txbytes += bytes;
+	if (txpacket != packet) {
+		csp_buffer_free(packet);
+	}
+
+	csp_iface_stat_add(ifout, tx, 1);
+	csp_iface_stat_add(ifout, txbytes, bytes);
 	return CSP_ERR_NONE;
 
 tx_err:
-	ifout->tx_error++;
+	csp_iface_stat_add(ifout, tx_error, 1);
+tx_drop:
+	if ((txpacket != NULL) && (txpacket != packet)) {
+		csp_buffer_free(txpacket);
+	}
 err:
 	return CSP_ERR_TX;
 
@@ -282,6 +384,33 @@ int csp_send(csp_conn_t * conn, csp_packet_t * packet, uint32_t timeout) {
 
 }
 
+int csp_send_many(csp_conn_t * conn, csp_packet_t ** packets, unsigned int count, uint32_t timeout) {
+
+	if ((conn == NULL) || (packets == NULL) || (conn->state != CONN_OPEN)) {
+		csp_log_error("Invalid call to csp_send_many");
+		return 0;
+	}
+
+	const csp_route_t * ifroute = csp_rtable_find_route(conn->idout.dst);
+
+	unsigned int sent;
+	for (sent = 0; sent < count; sent++) {
+#if (CSP_USE_RDP)
+		if (conn->idout.flags & CSP_FRDP) {
+			if (csp_rdp_send(conn, packets[sent]) != CSP_ERR_NONE) {
+				break;
+			}
+		}
+#endif
+		if (csp_send_direct(conn->idout, packets[sent], ifroute, timeout) != CSP_ERR_NONE) {
+			break;
+		}
+	}
+
+	return sent;
+
+}
+
 int csp_send_prio(uint8_t prio, csp_conn_t * conn, csp_packet_t * packet, uint32_t timeout) {
 	conn->idout.pri = prio;
 	return csp_send(conn, packet, timeout);
@@ -327,13 +456,17 @@ int csp_transaction_persistent(csp_conn_t * conn, uint32_t timeout, void * outbu
 
 int csp_transaction_w_opts(uint8_t prio, uint8_t dest, uint8_t port, uint32_t timeout, void * outbuf, int outlen, void * inbuf, int inlen, uint32_t opts) {
 
-	csp_conn_t * conn = csp_connect(prio, dest, port, 0, opts);
-	if (conn == NULL)
-		return 0;
+	csp_conn_t * conn = csp_conn_cache_get(prio, dest, port, opts);
+	if (conn == NULL) {
+		conn = csp_connect(prio, dest, port, 0, opts);
+		if (conn == NULL)
+			return 0;
+	}
 
 	int status = csp_transaction_persistent(conn, timeout, outbuf, outlen, inbuf, inlen);
 
-	csp_close(conn);
+	/* Reuse connection, unless the transaction failed (a late reply could be read by the next transaction) */
+	csp_conn_cache_put(conn, (status != 0));
 
 	return status;
 
@@ -346,14 +479,30 @@ csp_packet_t * csp_recvfrom(csp_socket_t * socket, uint32_t timeout) {
 
 	csp_packet_t * packet = NULL;
 	csp_queue_dequeue(socket->socket, &packet, timeout);
+	csp_buffer_set_owner(packet, CSP_BUFFER_OWNER_NONE);
 
 	return packet;
 
 }
 
-int csp_sendto(uint8_t prio, uint8_t dest, uint8_t dport, uint8_t src_port, uint32_t opts, csp_packet_t * packet, uint32_t timeout) {
+int csp_recvfrom_many(csp_socket_t * socket, csp_packet_t ** packets, unsigned int max, uint32_t timeout) {
 
-	packet->id.flags = 0;
+	if ((socket == NULL) || (packets == NULL) || (max == 0) || (!(socket->opts & CSP_SO_CONN_LESS)))
+		return 0;
+
+	int count = csp_queue_dequeue_n(socket->socket, (void **) packets, max, timeout);
+	for (int i = 0; i < count; i++) {
+		csp_buffer_set_owner(packets[i], CSP_BUFFER_OWNER_NONE);
+	}
+
+	return count;
+
+}
+
+/* Build identifier for connection-less packet */
+static int csp_sendto_id(uint8_t prio, uint8_t dest, uint8_t dport, uint8_t src_port, uint32_t opts, csp_id_t * id) {
+
+	id->ext = 0;
 
 	if (opts & CSP_O_RDP) {
 		csp_log_error("Attempt to create RDP packet on connection-less socket");
@@ -362,7 +511,7 @@ int csp_sendto(uint8_t prio, uint8_t dest, uint8_t dport, uint8_t src_port, uint
 
 	if (opts & CSP_O_HMAC) {
 #if (CSP_USE_HMAC)
-		packet->id.flags |= CSP_FHMAC;
+		id->flags |= CSP_FHMAC;
 #else
 		csp_log_error("Attempt to create HMAC authenticated packet, but CSP was compiled without HMAC support");
 		return CSP_ERR_NOTSUP;
@@ -371,7 +520,7 @@ int csp_sendto(uint8_t prio, uint8_t dest, uint8_t dport, uint8_t src_port, uint
 
 	if (opts & CSP_O_XTEA) {
 #if (CSP_USE_XTEA)
-		packet->id.flags |= CSP_FXTEA;
+		id->flags |= CSP_FXTEA;
 #else
 		csp_log_error("Attempt to create XTEA encrypted packet, but CSP was compiled without XTEA support");
 		return CSP_ERR_NOTSUP;
@@ -380,18 +529,28 @@ int csp_sendto(uint8_t prio, uint8_t dest, uint8_t dport, uint8_t src_port, uint
 
 	if (opts & CSP_O_CRC32) {
 #if (CSP_USE_CRC32)
-		packet->id.flags |= CSP_FCRC32;
+		id->flags |= CSP_FCRC32;
 #else
 		csp_log_error("Attempt to create CRC32 validated packet, but CSP was compiled without CRC32 support");
 		return CSP_ERR_NOTSUP;
 #endif
 	}
 
-	packet->id.dst = dest;
-	packet->id.dport = dport;
-	packet->id.src = csp_conf.address;
-	packet->id.sport = src_port;
-	packet->id.pri = prio;
+	id->dst = dest;
+	id->dport = dport;
+	id->src = csp_conf.address;
+	id->sport = src_port;
+	id->pri = prio;
+
+	return CSP_ERR_NONE;
+
+}
+
+int csp_sendto(uint8_t prio, uint8_t dest, uint8_t dport, uint8_t src_port, uint32_t opts, csp_packet_t * packet, uint32_t timeout) {
+
+	int ret = csp_sendto_id(prio, dest, dport, src_port, opts, &packet->id);
+	if (ret != CSP_ERR_NONE)
+		return ret;
 
 	if (csp_send_direct(packet->id, packet, csp_rtable_find_route(dest), timeout) != CSP_ERR_NONE)
 		return CSP_ERR_NOTSUP;
@@ -400,6 +559,30 @@ int csp_sendto(uint8_t prio, uint8_t dest, uint8_t dport, uint8_t src_port, uint
 
 }
 
+int csp_sendto_many(uint8_t prio, uint8_t dest, uint8_t dport, uint8_t src_port, uint32_t opts, csp_packet_t ** packets, unsigned int count, uint32_t timeout) {
+
+	if (packets == NULL)
+		return CSP_ERR_INVAL;
+
+	csp_id_t id;
+	int ret = csp_sendto_id(prio, dest, dport, src_port, opts, &id);
+	if (ret != CSP_ERR_NONE)
+		return ret;
+
+	const csp_route_t * ifroute = csp_rtable_find_route(dest);
+
+	unsigned int sent;
+	for (sent = 0; sent < count; sent++) {
+		packets[sent]->id.ext = id.ext;
+		if (csp_send_direct(id, packets[sent], ifroute, timeout) != CSP_ERR_NONE) {
+			break;
+		}
+	}
+
+	return sent;
+
+}
+
 int csp_sendto_reply(const csp_packet_t * request_packet, csp_packet_t * reply_packet, uint32_t opts, uint32_t timeout) {
 	if (request_packet == NULL)
 		return CSP_ERR_INVAL;
@@ -0,0 +1,452 @@
+/*
+Cubesat Space Protocol - A small network-layer protocol designed for Cubesats
+Copyright (C) 2012 Gomspace ApS (http://www.gomspace.com)
+Copyright (C) 2012 AAUSAT3 Project (http://aausat3.space.aau.dk)
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "csp_poll.h"
+
+#include <csp/arch/csp_malloc.h>
+#include <csp/arch/csp_semaphore.h>
+#include <csp/arch/csp_time.h>
+#include "csp_conn.h"
+#include "transport/csp_transport.h"
+
+#if (CSP_POSIX) && defined(__linux__)
+#include <sys/eventfd.h>
+#include <unistd.h>
+#define CSP_POLL_USE_EVENTFD 1
+#else
+#define CSP_POLL_USE_EVENTFD 0
+#endif
+
+/**
+   Poll set.
+*/
+struct csp_poll_s {
+	csp_bin_sem_handle_t wakeup;	/**< Signalled when a member may have become ready */
+	csp_conn_t * members;		/**< Members, linked by csp_conn_poll_t.next/prev */
+	csp_conn_t * ready_head;	/**< Ready list, members to check in next csp_poll_wait() */
+	csp_conn_t * ready_tail;
+	unsigned int ready_count;
+	bool interrupted;		/**< Set by csp_poll_interrupt(), next csp_poll_wait() returns */
+	int fd;				/**< eventfd, -1 if not created, see csp_poll_get_fd() */
+};
+
+/* Lock for all poll sets and csp_conn_t.poll, a single lock allows signalling without a reference on the set */
+static csp_mutex_t poll_lock;
+
+int csp_poll_init(void) {
+
+	if (csp_mutex_create(&poll_lock) != CSP_MUTEX_OK) {
+		csp_log_error("csp_mutex_create(&poll_lock) failed");
+		return CSP_ERR_NOMEM;
+	}
+
+	return CSP_ERR_NONE;
+
+}
+
+/* Wake task waiting on the set and signal the eventfd - call with poll_lock held */
+static void csp_poll_notify(csp_poll_t * poll) {
+
+	csp_bin_sem_post(&poll->wakeup);
+
+#if (CSP_POLL_USE_EVENTFD)
+	if (poll->fd >= 0) {
+		const uint64_t one = 1;
+		if (write(poll->fd, &one, sizeof(one)) != sizeof(one)) {
+			/* Counter saturated, fd is readable anyway */
+		}
+	}
+#endif
+
+}
+
+/* Clear the eventfd before checking the ready list - call with poll_lock held */
+static void csp_poll_clear_fd(csp_poll_t * poll) {
+
+#if (CSP_POLL_USE_EVENTFD)
+	if (poll->fd >= 0) {
+		uint64_t value;
+		if (read(poll->fd, &value, sizeof(value)) != sizeof(value)) {
+			/* Not signalled */
+		}
+	}
+#else
+	(void) poll;
+#endif
+
+}
+
+/* Append to ready list - call with poll_lock held */
+static void csp_poll_ready_append(csp_poll_t * poll, csp_conn_t * conn) {
+
+	if (conn->poll.ready) {
+		return;
+	}
+
+	conn->poll.ready = true;
+	conn->poll.ready_next = NULL;
+	if (poll->ready_tail) {
+		poll->ready_tail->poll.ready_next = conn;
+	} else {
+		poll->ready_head = conn;
+	}
+	poll->ready_tail = conn;
+	poll->ready_count++;
+
+}
+
+/* Remove first connection from ready list - call with poll_lock held */
+static csp_conn_t * csp_poll_ready_pop(csp_poll_t * poll) {
+
+	csp_conn_t * conn = poll->ready_head;
+	if (conn) {
+		poll->ready_head = conn->poll.ready_next;
+		if (poll->ready_head == NULL) {
+			poll->ready_tail = NULL;
+		}
+		poll->ready_count--;
+		conn->poll.ready = false;
+	}
+
+	return conn;
+
+}
+
+/* Remove member from set - call with poll_lock held */
+static void csp_poll_unlink(csp_poll_t * poll, csp_conn_t * conn) {
+
+	if (conn->poll.ready) {
+		/* Rotate ready list once, dropping conn */
+		for (unsigned int n = poll->ready_count; n > 0; n--) {
+			csp_conn_t * ready = csp_poll_ready_pop(poll);
+			if (ready != conn) {
+				csp_poll_ready_append(poll, ready);
+			}
+		}
+	}
+
+	if (conn->poll.prev) {
+		conn->poll.prev->poll.next = conn->poll.next;
+	} else {
+		poll->members = conn->poll.next;
+	}
+	if (conn->poll.next) {
+		conn->poll.next->poll.prev = conn->poll.prev;
+	}
+
+	conn->poll.next = NULL;
+	conn->poll.prev = NULL;
+	__atomic_store_n(&conn->poll.set, NULL, __ATOMIC_SEQ_CST);
+
+}
+
+/* Current events of socket or connection */
+static uint8_t csp_poll_revents(csp_conn_t * conn) {
+
+	uint8_t revents = 0;
+
+	if (conn->state != CONN_OPEN) {
+		return CSP_POLLHUP;
+	}
+
+	if (conn->type == CONN_SERVER) {
+		/* Socket, queue holds new connections or connection-less packets */
+		if (conn->socket && (csp_queue_size(conn->socket) > 0)) {
+			revents |= CSP_POLLIN;
+		}
+		return revents;
+	}
+
+	for (int prio = 0; prio < CSP_RX_QUEUES; prio++) {
+		if (csp_queue_size(conn->rx_queue[prio]) > 0) {
+			revents |= CSP_POLLIN;
+			break;
+		}
+	}
+
+#if (CSP_USE_RDP)
+	if (conn->idin.flags & CSP_FRDP) {
+		if (csp_rdp_is_writable(conn)) {
+			revents |= CSP_POLLOUT;
+		} else if ((conn->rdp.state == RDP_CLOSE_WAIT) || (conn->rdp.state == RDP_CLOSED)) {
+			revents |= CSP_POLLHUP;
+		}
+		return revents;
+	}
+#endif
+
+	return revents | CSP_POLLOUT;
+
+}
+
+csp_poll_t * csp_poll_create(void) {
+
+	csp_poll_t * poll = csp_calloc(1, sizeof(*poll));
+	if (poll == NULL) {
+		return NULL;
+	}
+
+	if (csp_bin_sem_create(&poll->wakeup) != CSP_SEMAPHORE_OK) {
+		csp_free(poll);
+		return NULL;
+	}
+
+	/* Semaphore is created 'given' */
+	csp_bin_sem_wait(&poll->wakeup, 0);
+
+	poll->fd = -1;
+
+	return poll;
+
+}
+
+void csp_poll_destroy(csp_poll_t * poll) {
+
+	if (poll == NULL) {
+		return;
+	}
+
+	csp_mutex_lock(&poll_lock, CSP_MAX_TIMEOUT);
+	while (poll->members) {
+		csp_poll_unlink(poll, poll->members);
+	}
+	csp_mutex_unlock(&poll_lock);
+
+#if (CSP_POLL_USE_EVENTFD)
+	if (poll->fd >= 0) {
+		close(poll->fd);
+	}
+#endif
+
+	csp_bin_sem_remove(&poll->wakeup);
+	csp_free(poll);
+
+}
+
+int csp_poll_add(csp_poll_t * poll, csp_conn_t * conn, uint8_t events, void * context) {
+
+	if ((poll == NULL) || (conn == NULL) || (conn->state != CONN_OPEN)) {
+		return CSP_ERR_INVAL;
+	}
+
+	csp_mutex_lock(&poll_lock, CSP_MAX_TIMEOUT);
+
+	if (conn->poll.set) {
+		csp_mutex_unlock(&poll_lock);
+		return CSP_ERR_USED;
+	}
+
+	conn->poll.events = events;
+	conn->poll.context = context;
+	conn->poll.prev = NULL;
+	conn->poll.next = poll->members;
+	if (poll->members) {
+		poll->members->poll.prev = conn;
+	}
+	poll->members = conn;
+	__atomic_store_n(&conn->poll.set, poll, __ATOMIC_SEQ_CST);
+
+	/* Check current state in next wait, packets may already be queued */
+	csp_poll_ready_append(poll, conn);
+	csp_poll_notify(poll);
+
+	csp_mutex_unlock(&poll_lock);
+
+	return CSP_ERR_NONE;
+
+}
+
+int csp_poll_modify(csp_poll_t * poll, csp_conn_t * conn, uint8_t events, void * context) {
+
+	if ((poll == NULL) || (conn == NULL)) {
+		return CSP_ERR_INVAL;
+	}
+
+	csp_mutex_lock(&poll_lock, CSP_MAX_TIMEOUT);
+
+	if (conn->poll.set != poll) {
+		csp_mutex_unlock(&poll_lock);
+		return CSP_ERR_INVAL;
+	}
+
+	conn->poll.events = events;
+	conn->poll.context = context;
+	csp_poll_ready_append(poll, conn);
+	csp_poll_notify(poll);
+
+	csp_mutex_unlock(&poll_lock);
+
+	return CSP_ERR_NONE;
+
+}
+
+int csp_poll_remove(csp_poll_t * poll, csp_conn_t * conn) {
+
+	if ((poll == NULL) || (conn == NULL)) {
+		return CSP_ERR_INVAL;
+	}
+
+	csp_mutex_lock(&poll_lock, CSP_MAX_TIMEOUT);
+
+	if (conn->poll.set != poll) {
+		csp_mutex_unlock(&poll_lock);
+		return CSP_ERR_INVAL;
+	}
+
+	csp_poll_unlink(poll, conn);
+
+	csp_mutex_unlock(&poll_lock);
+
+	return CSP_ERR_NONE;
+
+}
+
+void csp_poll_conn_remove(csp_conn_t * conn) {
+
+	if (__atomic_load_n(&conn->poll.set, __ATOMIC_SEQ_CST) == NULL) {
+		return;
+	}
+
+	csp_mutex_lock(&poll_lock, CSP_MAX_TIMEOUT);
+	if (conn->poll.set) {
+		csp_poll_unlink(conn->poll.set, conn);
+	}
+	csp_mutex_unlock(&poll_lock);
+
+}
+
+void csp_poll_signal(csp_conn_t * conn) {
+
+	/* Fast path, not member of a set. The state change (enqueue) is done before, so csp_poll_add() will see it */
+	if ((conn == NULL) || (__atomic_load_n(&conn->poll.set, __ATOMIC_SEQ_CST) == NULL)) {
+		return;
+	}
+
+	csp_mutex_lock(&poll_lock, CSP_MAX_TIMEOUT);
+	csp_poll_t * poll = conn->poll.set;
+	if (poll) {
+		csp_poll_ready_append(poll, conn);
+		csp_poll_notify(poll);
+	}
+	csp_mutex_unlock(&poll_lock);
+
+}
+
+int csp_poll_wait(csp_poll_t * poll, csp_poll_event_t * events, unsigned int max, uint32_t timeout) {
+
+	if ((poll == NULL) || (events == NULL) || (max == 0)) {
+		return CSP_ERR_INVAL;
+	}
+
+	const uint32_t start = csp_get_ms();
+
+	for (;;) {
+
+		unsigned int count = 0;
+
+		csp_mutex_lock(&poll_lock, CSP_MAX_TIMEOUT);
+
+		csp_poll_clear_fd(poll);
+
+		const bool interrupted = poll->interrupted;
+		poll->interrupted = false;
+
+		/* Check each connection on the ready list once. Ready connections are put back on the list (level triggered),
+		 * so they are checked again in next wait. */
+		for (unsigned int n = poll->ready_count; (n > 0) && (count < max); n--) {
+			csp_conn_t * conn = csp_poll_ready_pop(poll);
+			const uint8_t revents = csp_poll_revents(conn) & (conn->poll.events | CSP_POLLHUP);
+			if (revents) {
+				events[count].conn = conn;
+				events[count].events = revents;
+				events[count].context = conn->poll.context;
+				count++;
+				csp_poll_ready_append(poll, conn);
+			}
+		}
+
+#if (CSP_POLL_USE_EVENTFD)
+		/* Keep the eventfd readable while there are connections left to check */
+		if ((poll->fd >= 0) && (poll->ready_count > 0)) {
+			csp_poll_notify(poll);
+		}
+#endif
+
+		csp_mutex_unlock(&poll_lock);
+
+		if (count || interrupted) {
+			return count;
+		}
+
+		uint32_t remaining = CSP_MAX_TIMEOUT;
+		if (timeout != CSP_MAX_TIMEOUT) {
+			const uint32_t elapsed = csp_get_ms() - start;
+			if (elapsed >= timeout) {
+				return 0;
+			}
+			remaining = timeout - elapsed;
+		}
+
+		csp_bin_sem_wait(&poll->wakeup, remaining);
+	}
+
+}
+
+void csp_poll_interrupt(csp_poll_t * poll) {
+
+	if (poll == NULL) {
+		return;
+	}
+
+	csp_mutex_lock(&poll_lock, CSP_MAX_TIMEOUT);
+	poll->interrupted = true;
+	csp_poll_notify(poll);
+	csp_mutex_unlock(&poll_lock);
+
+}
+
+int csp_poll_get_fd(csp_poll_t * poll) {
+
+	if (poll == NULL) {
+		return CSP_ERR_INVAL;
+	}
+
+#if (CSP_POLL_USE_EVENTFD)
+	csp_mutex_lock(&poll_lock, CSP_MAX_TIMEOUT);
+	if (poll->fd < 0) {
+		poll->fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if ((poll->fd >= 0) && (poll->ready_count > 0)) {
+			csp_poll_notify(poll);
+		}
+	}
+	const int fd = poll->fd;
+	csp_mutex_unlock(&poll_lock);
+
+	if (fd < 0) {
+		csp_log_error("eventfd() failed");
+		return CSP_ERR_NOMEM;
+	}
+
+	return fd;
+#else
+	return CSP_ERR_NOTSUP;
+#endif
+
+}
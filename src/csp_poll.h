@@ -0,0 +1,52 @@
+/*
+Cubesat Space Protocol - A small network-layer protocol designed for Cubesats
+Copyright (C) 2012 Gomspace ApS (http://www.gomspace.com)
+Copyright (C) 2012 AAUSAT3 Project (http://aausat3.space.aau.dk)
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef _CSP_POLL_INTERNAL_H_
+#define _CSP_POLL_INTERNAL_H_
+
+#include <csp/csp.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+   Init poll sets.
+   @return #CSP_ERR_NONE on success, otherwise an error code.
+*/
+int csp_poll_init(void);
+
+/**
+   Signal poll set, that a socket or connection may have changed readiness.
+   Does nothing if \a conn is NULL or not member of a poll set.
+   @param[in] conn socket or connection.
+*/
+void csp_poll_signal(csp_conn_t * conn);
+
+/**
+   Remove socket or connection from its poll set, if any.
+   @param[in] conn socket or connection.
+*/
+void csp_poll_conn_remove(csp_conn_t * conn);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
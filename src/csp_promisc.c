@@ -48,7 +48,18 @@ int csp_promisc_enable(unsigned int queue_size) {
 }
 
 void csp_promisc_disable(void) {
+
 	csp_promisc_enabled = 0;
+
+	/* Release queued packets, nobody is expected to read them */
+	if (csp_promisc_queue != NULL) {
+		void * packets[CSP_BUFFER_FREE_BATCH];
+		int count;
+		while ((count = csp_queue_dequeue_n(csp_promisc_queue, packets, CSP_BUFFER_FREE_BATCH, 0)) > 0) {
+			csp_buffer_free_n(packets, count);
+		}
+	}
+
 }
 
 csp_packet_t * csp_promisc_read(uint32_t timeout) {
@@ -63,18 +74,28 @@ csp_packet_t * csp_promisc_read(uint32_t timeout) {
 
 }
 
+int csp_promisc_read_n(csp_packet_t ** packets, int count, uint32_t timeout) {
+
+	if (csp_promisc_queue == NULL)
+		return 0;
+
+	return csp_queue_dequeue_n(csp_promisc_queue, (void **) packets, count, timeout);
+
+}
+
 void csp_promisc_add(csp_packet_t * packet) {
 
 	if (csp_promisc_enabled == 0)
 		return;
 
 	if (csp_promisc_queue != NULL) {
-		/* Make a copy of the message and queue it to the promiscuous task */
-		csp_packet_t *packet_copy = csp_buffer_clone(packet);
-		if (packet_copy != NULL) {
-			if (csp_queue_enqueue(csp_promisc_queue, &packet_copy, 0) != CSP_QUEUE_OK) {
+		/* Share the message with the promiscuous task, the stack copies it before modifying it (csp_buffer_unshare()) */
+		csp_packet_t *packet_ref = csp_buffer_ref(packet);
+		if (packet_ref != NULL) {
+			csp_buffer_set_owner(packet_ref, CSP_BUFFER_OWNER_PROMISC);
+			if (csp_queue_enqueue(csp_promisc_queue, &packet_ref, 0) != CSP_QUEUE_OK) {
 				csp_log_error("Promiscuous mode input queue full");
-				csp_buffer_free(packet_copy);
+				csp_buffer_free(packet_ref);
 			}
 		}
 	}
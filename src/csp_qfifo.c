@@ -20,31 +20,288 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
 
 #include "csp_qfifo.h"
 
+#include <string.h>
+
 #include <csp/arch/csp_queue.h>
 
 #include "csp_init.h"
 
-static csp_queue_handle_t qfifo[CSP_ROUTE_FIFOS];
+/**
+   Scheduler state (QoS), only used by the consumer.
+*/
+typedef struct {
+	uint8_t prio;				/* Priority currently being served (round-robin) */
+	int32_t credit[CSP_ROUTE_FIFOS];	/* Remaining packets (WRR) or bytes (DRR) for the priority in this round */
+} csp_qfifo_sched_t;
+
+#if (CSP_USE_QFIFO_RING)
+
+#include <csp/arch/csp_semaphore.h>
+#include <csp/arch/csp_malloc.h>
+
+/**
+   Slot in the router input ring.
+   The sequence number tells whether the slot is free for the producer (seq == pos) or holds an element for the consumer (seq == pos + 1).
+*/
+typedef struct {
+	size_t seq;
+	csp_qfifo_t element;
+} csp_qfifo_slot_t;
+
+/**
+   Bounded multi-producer/single-consumer ring.
+   Producers (interfaces) claim a slot by advancing tail with CAS, the single consumer (router worker) owns head.
+*/
+typedef struct {
+	size_t tail;
+	size_t head;
+	size_t mask;
+	csp_qfifo_slot_t * slots;
+} csp_qfifo_ring_t;
+
+/**
+   Incoming queues of a router worker.
+*/
+typedef struct {
+	csp_qfifo_ring_t fifo[CSP_ROUTE_FIFOS];
+	/* Set by the consumer before sleeping on wakeup, cleared by the producer that posts the wakeup */
+	int sleeping;
+	csp_bin_sem_handle_t wakeup;
+	bool wakeup_created;
+	csp_qfifo_sched_t sched;
+} csp_qfifo_shard_t;
+
+#else
+
+/**
+   Incoming queues of a router worker.
+*/
+typedef struct {
+	csp_queue_handle_t fifo[CSP_ROUTE_FIFOS];
 #if (CSP_USE_QOS)
-static csp_queue_handle_t qfifo_events;
+	csp_queue_handle_t events;
 #endif
+	csp_qfifo_sched_t sched;
+} csp_qfifo_shard_t;
 
-int csp_qfifo_init(void) {
+#endif // CSP_USE_QFIFO_RING
+
+static csp_qfifo_shard_t qfifo[CSP_ROUTE_WORKERS_MAX];
+
+/**
+   Scheduler: read next element from one of the priority fifos (without waiting).
+*/
+typedef bool (*csp_qfifo_sched_func_t)(csp_qfifo_shard_t * shard, csp_qfifo_t * input);
+
+static bool csp_qfifo_sched_strict(csp_qfifo_shard_t * shard, csp_qfifo_t * input);
+
+static csp_qfifo_sched_func_t csp_qfifo_sched = csp_qfifo_sched_strict;
+
+unsigned int csp_qfifo_shard_count(void) {
+
+	return (csp_conf.route_workers > 1) ? csp_conf.route_workers : 1;
+
+}
+
+unsigned int csp_qfifo_shard(csp_id_t id) {
+
+	const unsigned int shards = csp_qfifo_shard_count();
+	if (shards == 1) {
+		return 0;
+	}
+
+	/* Mix the connection tuple (source, destination and ports), so all packets on a connection ends in the same shard */
+	uint32_t key = id.ext & CSP_ID_CONN_MASK;
+	key ^= key >> 16;
+	key *= 0x45d9f3b;
+	key ^= key >> 16;
+
+	return key % shards;
+
+}
+
+#if (CSP_USE_QFIFO_RING)
+
+static int csp_qfifo_shard_init(csp_qfifo_shard_t * shard) {
+
+	/* Round the fifo length up to a power of two */
+	size_t size = 1;
+	while (size < csp_conf.fifo_length) {
+		size <<= 1;
+	}
 
 	/* Create router fifos for each priority */
 	for (int prio = 0; prio < CSP_ROUTE_FIFOS; prio++) {
-		if (qfifo[prio] == NULL) {
-			qfifo[prio] = csp_queue_create(csp_conf.fifo_length, sizeof(csp_qfifo_t));
-			if (!qfifo[prio])
+		csp_qfifo_ring_t * ring = &shard->fifo[prio];
+		if (ring->slots == NULL) {
+			ring->slots = csp_calloc(size, sizeof(*ring->slots));
+			if (ring->slots == NULL) {
+				return CSP_ERR_NOMEM;
+			}
+			for (size_t i = 0; i < size; i++) {
+				ring->slots[i].seq = i;
+			}
+			ring->mask = size - 1;
+			ring->head = 0;
+			ring->tail = 0;
+		}
+	}
+
+	if (!shard->wakeup_created) {
+		if (csp_bin_sem_create(&shard->wakeup) != CSP_SEMAPHORE_OK) {
+			return CSP_ERR_NOMEM;
+		}
+		/* Semaphore is created 'given' - take it, so the first wait blocks */
+		csp_bin_sem_wait(&shard->wakeup, 0);
+		shard->wakeup_created = true;
+	}
+	shard->sleeping = 0;
+
+	return CSP_ERR_NONE;
+
+}
+
+static void csp_qfifo_shard_free(csp_qfifo_shard_t * shard) {
+
+	for (int prio = 0; prio < CSP_ROUTE_FIFOS; prio++) {
+		if (shard->fifo[prio].slots) {
+			csp_free(shard->fifo[prio].slots);
+			shard->fifo[prio].slots = NULL;
+		}
+	}
+
+	if (shard->wakeup_created) {
+		csp_bin_sem_remove(&shard->wakeup);
+		shard->wakeup_created = false;
+	}
+
+}
+
+static bool csp_qfifo_ring_push(csp_qfifo_ring_t * ring, const csp_qfifo_t * element) {
+
+	csp_qfifo_slot_t * slot;
+	size_t pos = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+	for (;;) {
+		slot = &ring->slots[pos & ring->mask];
+		const size_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+		const intptr_t diff = (intptr_t) seq - (intptr_t) pos;
+		if (diff == 0) {
+			if (__atomic_compare_exchange_n(&ring->tail, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+				break;
+			}
+		} else if (diff < 0) {
+			/* Full */
+			return false;
+		} else {
+			pos = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+		}
+	}
+
+	slot->element = *element;
+	__atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+	return true;
+
+}
+
+static bool csp_qfifo_ring_pop(csp_qfifo_ring_t * ring, csp_qfifo_t * element) {
+
+	const size_t pos = ring->head;
+	csp_qfifo_slot_t * slot = &ring->slots[pos & ring->mask];
+	if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != (pos + 1)) {
+		/* Empty, or the producer has not finished writing the slot yet */
+		return false;
+	}
+
+	*element = slot->element;
+	__atomic_store_n(&slot->seq, pos + ring->mask + 1, __ATOMIC_RELEASE);
+	ring->head = pos + 1;
+	return true;
+
+}
+
+static inline bool csp_qfifo_pop_prio(csp_qfifo_shard_t * shard, int prio, csp_qfifo_t * input) {
+
+	return csp_qfifo_ring_pop(&shard->fifo[prio], input);
+
+}
+
+static inline bool csp_qfifo_pop(csp_qfifo_shard_t * shard, csp_qfifo_t * input) {
+
+	return csp_qfifo_sched(shard, input);
+
+}
+
+static bool csp_qfifo_shard_try_read(csp_qfifo_shard_t * shard, csp_qfifo_t * input) {
+
+	return csp_qfifo_pop(shard, input);
+
+}
+
+static int csp_qfifo_shard_read(csp_qfifo_shard_t * shard, csp_qfifo_t * input, uint32_t timeout) {
+
+	if (csp_qfifo_pop(shard, input)) {
+		return CSP_ERR_NONE;
+	}
+
+	/* Announce that we are going to sleep, and check again - a producer may have published just before the flag was set */
+	__atomic_store_n(&shard->sleeping, 1, __ATOMIC_SEQ_CST);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (csp_qfifo_pop(shard, input)) {
+		__atomic_store_n(&shard->sleeping, 0, __ATOMIC_RELAXED);
+		return CSP_ERR_NONE;
+	}
+
+	csp_bin_sem_wait(&shard->wakeup, timeout);
+	__atomic_store_n(&shard->sleeping, 0, __ATOMIC_RELAXED);
+
+	if (csp_qfifo_pop(shard, input)) {
+		return CSP_ERR_NONE;
+	}
+
+	return CSP_ERR_TIMEDOUT;
+
+}
+
+static int csp_qfifo_enqueue(csp_qfifo_shard_t * shard, int fifo, const csp_qfifo_t * element, CSP_BASE_TYPE * pxTaskWoken) {
+
+	if (!csp_qfifo_ring_push(&shard->fifo[fifo], element)) {
+		return CSP_QUEUE_FULL;
+	}
+
+	/* Only wake the consumer, if it is (about to go) sleeping */
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&shard->sleeping, __ATOMIC_RELAXED) && __atomic_exchange_n(&shard->sleeping, 0, __ATOMIC_ACQ_REL)) {
+		if (pxTaskWoken == NULL) {
+			csp_bin_sem_post(&shard->wakeup);
+		} else {
+			csp_bin_sem_post_isr(&shard->wakeup, pxTaskWoken);
+		}
+	}
+
+	return CSP_QUEUE_OK;
+
+}
+
+#else // CSP_USE_QFIFO_RING
+
+static int csp_qfifo_shard_init(csp_qfifo_shard_t * shard) {
+
+	/* Create router fifos for each priority */
+	for (int prio = 0; prio < CSP_ROUTE_FIFOS; prio++) {
+		if (shard->fifo[prio] == NULL) {
+			shard->fifo[prio] = csp_queue_create(csp_conf.fifo_length, sizeof(csp_qfifo_t));
+			if (!shard->fifo[prio])
 				return CSP_ERR_NOMEM;
 		}
 	}
 
 #if (CSP_USE_QOS)
-	/* Create QoS fifo notification queue */
-	qfifo_events = csp_queue_create(csp_conf.fifo_length, sizeof(int));
-	if (!qfifo_events) {
-		return CSP_ERR_NOMEM;
+	/* Create QoS fifo notification queue - room for an event per element in all fifos, a lost event would strand a packet */
+	if (shard->events == NULL) {
+		shard->events = csp_queue_create(csp_conf.fifo_length * CSP_ROUTE_FIFOS, sizeof(int));
+		if (!shard->events) {
+			return CSP_ERR_NOMEM;
+		}
 	}
 #endif
 
@@ -52,48 +309,46 @@ int csp_qfifo_init(void) {
 
 }
 
-void csp_qfifo_free_resources(void) {
+static void csp_qfifo_shard_free(csp_qfifo_shard_t * shard) {
 
 	for (int prio = 0; prio < CSP_ROUTE_FIFOS; prio++) {
-		if (qfifo[prio]) {
-			csp_queue_remove(qfifo[prio]);
-			qfifo[prio] = NULL;
+		if (shard->fifo[prio]) {
+			csp_queue_remove(shard->fifo[prio]);
+			shard->fifo[prio] = NULL;
 		}
 	}
 
 #if (CSP_USE_QOS)
-	if (qfifo_events) {
-		csp_queue_remove(qfifo_events);
-		qfifo_events = NULL;
+	if (shard->events) {
+		csp_queue_remove(shard->events);
+		shard->events = NULL;
 	}
 #endif
 
 }
 
-int csp_qfifo_read(csp_qfifo_t * input) {
+static inline bool csp_qfifo_pop_prio(csp_qfifo_shard_t * shard, int prio, csp_qfifo_t * input) {
+
+	return (csp_queue_dequeue(shard->fifo[prio], input, 0) == CSP_QUEUE_OK);
+
+}
+
+static int csp_qfifo_shard_read(csp_qfifo_shard_t * shard, csp_qfifo_t * input, uint32_t timeout) {
 
 #if (CSP_USE_QOS)
-	int prio, found, event;
+	int event;
 
 	/* Wait for packet in any queue */
-	if (csp_queue_dequeue(qfifo_events, &event, FIFO_TIMEOUT) != CSP_QUEUE_OK)
+	if (csp_queue_dequeue(shard->events, &event, timeout) != CSP_QUEUE_OK)
 		return CSP_ERR_TIMEDOUT;
 
-	/* Find packet with highest priority */
-	found = 0;
-	for (prio = 0; prio < CSP_ROUTE_FIFOS; prio++) {
-		if (csp_queue_dequeue(qfifo[prio], input, 0) == CSP_QUEUE_OK) {
-			found = 1;
-			break;
-		}
-	}
-
-	if (!found) {
+	/* Find packet according to scheduler */
+	if (!csp_qfifo_sched(shard, input)) {
 		csp_log_warn("Spurious wakeup: No packet found");
 		return CSP_ERR_TIMEDOUT;
 	}
 #else
-	if (csp_queue_dequeue(qfifo[0], input, FIFO_TIMEOUT) != CSP_QUEUE_OK)
+	if (csp_queue_dequeue(shard->fifo[0], input, timeout) != CSP_QUEUE_OK)
 		return CSP_ERR_TIMEDOUT;
 #endif
 
@@ -101,6 +356,177 @@ int csp_qfifo_read(csp_qfifo_t * input) {
 
 }
 
+static bool csp_qfifo_shard_try_read(csp_qfifo_shard_t * shard, csp_qfifo_t * input) {
+
+#if (CSP_USE_QOS)
+	/* Consume an event first, like csp_qfifo_shard_read(). The event is posted after the element is queued, so events
+	   and elements stay in step - an element queued without its event yet is read on the next event */
+	int event;
+	if (csp_queue_dequeue(shard->events, &event, 0) != CSP_QUEUE_OK) {
+		return false;
+	}
+	return csp_qfifo_sched(shard, input);
+#else
+	return (csp_queue_dequeue(shard->fifo[0], input, 0) == CSP_QUEUE_OK);
+#endif
+
+}
+
+static int csp_qfifo_enqueue(csp_qfifo_shard_t * shard, int fifo, const csp_qfifo_t * element, CSP_BASE_TYPE * pxTaskWoken) {
+
+	int result;
+
+	if (pxTaskWoken == NULL)
+		result = csp_queue_enqueue(shard->fifo[fifo], element, 0);
+	else
+		result = csp_queue_enqueue_isr(shard->fifo[fifo], element, pxTaskWoken);
+
+#if (CSP_USE_QOS)
+	static int event = 0;
+
+	if (result == CSP_QUEUE_OK) {
+		if (pxTaskWoken == NULL)
+			csp_queue_enqueue(shard->events, &event, 0);
+		else
+			csp_queue_enqueue_isr(shard->events, &event, pxTaskWoken);
+	}
+#endif
+
+	return result;
+
+}
+
+#endif // CSP_USE_QFIFO_RING
+
+static bool csp_qfifo_sched_strict(csp_qfifo_shard_t * shard, csp_qfifo_t * input) {
+
+	/* Highest priority first */
+	for (int prio = 0; prio < CSP_ROUTE_FIFOS; prio++) {
+		if (csp_qfifo_pop_prio(shard, prio, input)) {
+			return true;
+		}
+	}
+	return false;
+
+}
+
+#if (CSP_USE_QOS)
+
+/**
+   Credit added to a priority each round.
+   WRR: packets, DRR: bytes.
+*/
+static inline int32_t csp_qfifo_sched_quantum(int prio) {
+
+	const int32_t weight = (csp_conf.qos_weight[prio] > 0) ? csp_conf.qos_weight[prio] : 1;
+	return (csp_conf.qos_scheduler == CSP_QOS_SCHED_DRR) ? (weight * CSP_QOS_DRR_QUANTUM) : weight;
+
+}
+
+/**
+   Round-robin over the priorities, serving a priority while it has credit.
+   WRR charges 1 per packet, DRR charges the packet length. DRR lets the credit go negative (the overdraft is paid back in the next round),
+   as the packet size isn't known before the packet is removed from the fifo.
+   An empty priority forfeits its remaining credit.
+*/
+static bool csp_qfifo_sched_rr(csp_qfifo_shard_t * shard, csp_qfifo_t * input) {
+
+	csp_qfifo_sched_t * sched = &shard->sched;
+
+	for (int visits = 0; visits < (2 * CSP_ROUTE_FIFOS); visits++) {
+		const int prio = sched->prio;
+		if ((sched->credit[prio] > 0) && csp_qfifo_pop_prio(shard, prio, input)) {
+			if (csp_conf.qos_scheduler == CSP_QOS_SCHED_DRR) {
+				sched->credit[prio] -= (input->packet != NULL) ? input->packet->length : 0;
+			} else {
+				sched->credit[prio]--;
+			}
+			return true;
+		}
+
+		if (sched->credit[prio] > 0) {
+			/* Empty */
+			sched->credit[prio] = 0;
+		}
+
+		/* Next priority */
+		sched->prio = (prio + 1) % CSP_ROUTE_FIFOS;
+		sched->credit[sched->prio] += csp_qfifo_sched_quantum(sched->prio);
+	}
+
+	/* Only priorities with a large overdraft left - don't let the fifos stall */
+	return csp_qfifo_sched_strict(shard, input);
+
+}
+
+#endif // CSP_USE_QOS
+
+int csp_qfifo_init(void) {
+
+	if (csp_conf.route_workers > CSP_ROUTE_WORKERS_MAX) {
+		csp_log_error("Too many router workers: %u, max %u", csp_conf.route_workers, CSP_ROUTE_WORKERS_MAX);
+		return CSP_ERR_INVAL;
+	}
+
+	csp_qfifo_sched = csp_qfifo_sched_strict;
+#if (CSP_USE_QOS)
+	switch (csp_conf.qos_scheduler) {
+		case CSP_QOS_SCHED_STRICT:
+			break;
+		case CSP_QOS_SCHED_WRR:
+		case CSP_QOS_SCHED_DRR:
+			csp_qfifo_sched = csp_qfifo_sched_rr;
+			break;
+		default:
+			csp_log_error("Unknown QoS scheduler: %u", csp_conf.qos_scheduler);
+			return CSP_ERR_INVAL;
+	}
+#endif
+
+	for (unsigned int i = 0; i < csp_qfifo_shard_count(); i++) {
+		int ret = csp_qfifo_shard_init(&qfifo[i]);
+		if (ret != CSP_ERR_NONE) {
+			return ret;
+		}
+		memset(&qfifo[i].sched, 0, sizeof(qfifo[i].sched));
+#if (CSP_USE_QOS)
+		qfifo[i].sched.credit[0] = csp_qfifo_sched_quantum(0);
+#endif
+	}
+
+	return CSP_ERR_NONE;
+
+}
+
+void csp_qfifo_free_resources(void) {
+
+	for (unsigned int i = 0; i < CSP_ROUTE_WORKERS_MAX; i++) {
+		csp_qfifo_shard_free(&qfifo[i]);
+	}
+
+}
+
+int csp_qfifo_read(unsigned int shard, csp_qfifo_t * input) {
+
+	return csp_qfifo_shard_read(&qfifo[shard], input, FIFO_TIMEOUT);
+
+}
+
+unsigned int csp_qfifo_read_n(unsigned int shard, csp_qfifo_t * input, unsigned int max, uint32_t timeout) {
+
+	if ((max == 0) || (csp_qfifo_shard_read(&qfifo[shard], &input[0], timeout) != CSP_ERR_NONE)) {
+		return 0;
+	}
+
+	unsigned int count = 1;
+	while ((count < max) && csp_qfifo_shard_try_read(&qfifo[shard], &input[count])) {
+		++count;
+	}
+
+	return count;
+
+}
+
 void csp_qfifo_write(csp_packet_t * packet, csp_iface_t * iface, CSP_BASE_TYPE * pxTaskWoken) {
 
 	int result;
@@ -127,33 +553,21 @@ void csp_qfifo_write(csp_packet_t * packet, csp_iface_t * iface, CSP_BASE_TYPE *
 	queue_element.iface = iface;
 	queue_element.packet = packet;
 
+	csp_buffer_set_owner(packet, CSP_BUFFER_OWNER_QFIFO);
+
 #if (CSP_USE_QOS)
 	int fifo = packet->id.pri;
 #else
 	int fifo = 0;
 #endif
 
-	if (pxTaskWoken == NULL)
-		result = csp_queue_enqueue(qfifo[fifo], &queue_element, 0);
-	else
-		result = csp_queue_enqueue_isr(qfifo[fifo], &queue_element, pxTaskWoken);
-
-#if (CSP_USE_QOS)
-	static int event = 0;
-
-	if (result == CSP_QUEUE_OK) {
-		if (pxTaskWoken == NULL)
-			csp_queue_enqueue(qfifo_events, &event, 0);
-		else
-			csp_queue_enqueue_isr(qfifo_events, &event, pxTaskWoken);
-	}
-#endif
+	result = csp_qfifo_enqueue(&qfifo[csp_qfifo_shard(packet->id)], fifo, &queue_element, pxTaskWoken);
 
 	if (result != CSP_QUEUE_OK) {
 		if (pxTaskWoken == NULL) { // Only do logging in non-ISR context
 			csp_log_warn("ERROR: Routing input FIFO is FULL. Dropping packet.");
 		}
-		iface->drop++;
+		csp_iface_stat_add(iface, drop, 1);
 		if (pxTaskWoken == NULL)
 			csp_buffer_free(packet);
 		else
@@ -162,7 +576,13 @@ void csp_qfifo_write(csp_packet_t * packet, csp_iface_t * iface, CSP_BASE_TYPE *
 
 }
 
-void csp_qfifo_wake_up(void) {
+void csp_qfifo_wake_up_shard(unsigned int shard) {
 	const csp_qfifo_t queue_element = {.iface = NULL, .packet = NULL};
-	csp_queue_enqueue(qfifo[0], &queue_element, 0);
+	csp_qfifo_enqueue(&qfifo[shard], 0, &queue_element, NULL);
+}
+
+void csp_qfifo_wake_up(void) {
+	for (unsigned int i = 0; i < csp_qfifo_shard_count(); i++) {
+		csp_qfifo_wake_up_shard(i);
+	}
 }
@@ -23,11 +23,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
 
 #include <csp/csp_interface.h>
 
-#if (CSP_USE_RDP)
-#define FIFO_TIMEOUT 100			//! If RDP is enabled, the router needs to awake some times to check timeouts
-#else
-#define FIFO_TIMEOUT CSP_MAX_TIMEOUT		//! If no RDP, the router can sleep untill data arrives
-#endif
+#define FIFO_TIMEOUT 100			//! Timeout for csp_qfifo_read(), the router uses csp_qfifo_read_n() and sleeps until the next connection timeout
 
 /**
  * Init FIFO/QOS queues
@@ -42,12 +38,38 @@ typedef struct {
 	csp_packet_t * packet;
 } csp_qfifo_t;
 
+/**
+ * Number of router input shards (one per router worker)
+ * @return number of shards, at least 1
+ */
+unsigned int csp_qfifo_shard_count(void);
+
+/**
+ * Get router input shard for a packet/connection.
+ * All packets with the same source, destination and ports map to the same shard.
+ * @param id CSP identifier
+ * @return shard index
+ */
+unsigned int csp_qfifo_shard(csp_id_t id);
+
 /**
  * Read next packet from router input queue
+ * @param shard router input shard, see csp_qfifo_shard()
  * @param input pointer to router queue item element
  * @return CSP_ERR type
  */
-int csp_qfifo_read(csp_qfifo_t * input);
+int csp_qfifo_read(unsigned int shard, csp_qfifo_t * input);
+
+/**
+ * Read up to \a max packets from router input queue.
+ * Waits for the first packet, the remaining are only read if immediately available (highest priority first).
+ * @param shard router input shard, see csp_qfifo_shard()
+ * @param input array for at least \a max router queue item elements
+ * @param max max number of elements to read
+ * @param timeout timeout in mS to wait for the first element
+ * @return number of elements read, 0 on timeout
+ */
+unsigned int csp_qfifo_read_n(unsigned int shard, csp_qfifo_t * input, unsigned int max, uint32_t timeout);
 
 /**
  * Wake up any task (e.g. router) waiting on messages.
@@ -55,4 +77,10 @@ int csp_qfifo_read(csp_qfifo_t * input);
  */
 void csp_qfifo_wake_up(void);
 
+/**
+ * Wake up the router worker of a shard, e.g. to recalculate its timeout.
+ * @param shard router input shard, see csp_qfifo_shard()
+ */
+void csp_qfifo_wake_up_shard(unsigned int shard);
+
 #endif /* CSP_QFIFO_H_ */
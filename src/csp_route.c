@@ -21,11 +21,13 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
 #include <csp/csp.h>
 
 #include <stdlib.h>
+#include <string.h>
 
 #include <csp/csp_crc32.h>
 #include <csp/csp_endian.h>
 #include <csp/arch/csp_thread.h>
 #include <csp/arch/csp_queue.h>
+#include <csp/arch/csp_time.h>
 #include <csp/crypto/csp_hmac.h>
 #include <csp/crypto/csp_xtea.h>
 
@@ -36,8 +38,25 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
 #include "csp_promisc.h"
 #include "csp_qfifo.h"
 #include "csp_dedup.h"
+#include "csp_poll.h"
 #include "transport/csp_transport.h"
 
+#ifndef CSP_ROUTE_BATCH_MAX
+/**
+ * Max number of packets read from the router input queue per wakeup.
+ */
+#define CSP_ROUTE_BATCH_MAX	8
+#endif
+
+/**
+ * Router worker state, only updated by the worker itself.
+ */
+typedef struct {
+	csp_route_stats_t stats;
+} csp_route_worker_t;
+
+static csp_route_worker_t csp_route_workers[CSP_ROUTE_WORKERS_MAX];
+
 /**
  * Check supported packet options
  * @param iface pointer to incoming interface
@@ -50,7 +69,7 @@ static int csp_route_check_options(csp_iface_t *iface, csp_packet_t *packet)
 	/* Drop XTEA packets */
 	if (packet->id.flags & CSP_FXTEA) {
 		csp_log_error("Received XTEA encrypted packet, but CSP was compiled without XTEA support. Discarding packet");
-		iface->autherr++;
+		csp_iface_stat_add(iface, autherr, 1);
 		return CSP_ERR_NOTSUP;
 	}
 #endif
@@ -59,7 +78,7 @@ static int csp_route_check_options(csp_iface_t *iface, csp_packet_t *packet)
 	/* Drop HMAC packets */
 	if (packet->id.flags & CSP_FHMAC) {
 		csp_log_error("Received packet with HMAC, but CSP was compiled without HMAC support. Discarding packet");
-		iface->autherr++;
+		csp_iface_stat_add(iface, autherr, 1);
 		return CSP_ERR_NOTSUP;
 	}
 #endif
@@ -68,7 +87,7 @@ static int csp_route_check_options(csp_iface_t *iface, csp_packet_t *packet)
 	/* Drop RDP packets */
 	if (packet->id.flags & CSP_FRDP) {
 		csp_log_error("Received RDP packet, but CSP was compiled without RDP support. Discarding packet");
-		iface->rx_error++;
+		csp_iface_stat_add(iface, rx_error, 1);
 		return CSP_ERR_NOTSUP;
 	}
 #endif
@@ -90,12 +109,12 @@ static int csp_route_security_check(uint32_t security_opts, csp_iface_t * iface,
 		/* Decrypt data */
 		if (csp_xtea_decrypt_packet(packet) != CSP_ERR_NONE) {
 			csp_log_error("XTEA Decryption failed! Discarding packet");
-			iface->autherr++;
+			csp_iface_stat_add(iface, autherr, 1);
 			return CSP_ERR_XTEA;
 		}
 	} else if (security_opts & CSP_SO_XTEAREQ) {
 		csp_log_warn("Received packet without XTEA encryption. Discarding packet");
-		iface->autherr++;
+		csp_iface_stat_add(iface, autherr, 1);
 		return CSP_ERR_XTEA;
 	}
 #endif
@@ -106,17 +125,17 @@ static int csp_route_security_check(uint32_t security_opts, csp_iface_t * iface,
 		/* Verify CRC32 (does not include header for backwards compatability with csp1.x) */
 		if (csp_crc32_verify(packet, false) != CSP_ERR_NONE) {
 			csp_log_error("CRC32 verification error! Discarding packet");
-			iface->rx_error++;
+			csp_iface_stat_add(iface, rx_error, 1);
 			return CSP_ERR_CRC32;
 		}
 #else
 		/* No CRC32 validation - but size must be checked and adjusted */
 		if (packet->length < sizeof(uint32_t)) {
 			csp_log_error("CRC32 verification error! Discarding packet");
-			iface->rx_error++;
+			csp_iface_stat_add(iface, rx_error, 1);
 			return CSP_ERR_CRC32;
 		}
-		packet->length -= sizeof(uint32_t);
+		csp_buffer_trim(packet, sizeof(uint32_t));
 #endif
 	} else if (security_opts & CSP_SO_CRC32REQ) {
 		csp_log_warn("Received packet with CRC32, but CSP was compiled without CRC32 support. Accepting packet");
@@ -129,12 +148,12 @@ static int csp_route_security_check(uint32_t security_opts, csp_iface_t * iface,
 		if (csp_hmac_verify(packet, false) != CSP_ERR_NONE) {
 			/* HMAC failed */
 			csp_log_error("HMAC verification error! Discarding packet");
-			iface->autherr++;
+			csp_iface_stat_add(iface, autherr, 1);
 			return CSP_ERR_HMAC;
 		}
 	} else if (security_opts & CSP_SO_HMACREQ) {
 		csp_log_warn("Received packet without HMAC. Discarding packet");
-		iface->autherr++;
+		csp_iface_stat_add(iface, autherr, 1);
 		return CSP_ERR_HMAC;
 	}
 #endif
@@ -144,7 +163,7 @@ static int csp_route_security_check(uint32_t security_opts, csp_iface_t * iface,
 	if (!(packet->id.flags & CSP_FRDP)) {
 		if (security_opts & CSP_SO_RDPREQ) {
 			csp_log_warn("Received packet without RDP header. Discarding packet");
-			iface->rx_error++;
+			csp_iface_stat_add(iface, rx_error, 1);
 			return CSP_ERR_INVAL;
 		}
 	}
@@ -154,27 +173,24 @@ static int csp_route_security_check(uint32_t security_opts, csp_iface_t * iface,
 
 }
 
-int csp_route_work(uint32_t timeout) {
+/**
+ * Route packet from the incoming queue of a router worker.
+ * Packets are sharded by connection, so connection state is only touched by the worker owning the connection.
+ * @param shard router input shard (worker index)
+ * @param input packet and incoming interface
+ * @return #CSP_ERR_NONE on success, otherwise an error code.
+ */
+static int csp_route_input(unsigned int shard, csp_qfifo_t input) {
 
-	csp_qfifo_t input;
 	csp_packet_t * packet;
 	csp_conn_t * conn;
 	csp_socket_t * socket;
 
-#if (CSP_USE_RDP)
-	/* Check connection timeouts (currently only for RDP) */
-	csp_conn_check_timeouts();
-#endif
-
-	/* Get next packet to route */
-	if (csp_qfifo_read(&input) != CSP_ERR_NONE) {
-		return CSP_ERR_TIMEDOUT;
-	}
-
 	packet = input.packet;
 	if (packet == NULL) {
 		return CSP_ERR_TIMEDOUT;
 	}
+	csp_buffer_set_owner(packet, CSP_BUFFER_OWNER_NONE);
 
 	csp_log_packet("INP: S %u, D %u, Dp %u, Sp %u, Pr %u, Fl 0x%02X, Sz %"PRIu16" VIA: %s",
 			packet->id.src, packet->id.dst, packet->id.dport,
@@ -187,18 +203,20 @@ int csp_route_work(uint32_t timeout) {
 
 #if (CSP_USE_DEDUP)
 	/* Check for duplicates */
-	if (csp_dedup_is_duplicate(packet)) {
+	if (csp_dedup_is_duplicate(shard, packet)) {
 		/* Discard packet */
 		csp_log_packet("Duplicate packet discarded");
-		input.iface->drop++;
+		csp_iface_stat_add(input.iface, drop, 1);
 		csp_buffer_free(packet);
 		return CSP_ERR_NONE;
 	}
 #endif
 
 	/* Now we count the message (since its deduplicated) */
-	input.iface->rx++;
-	input.iface->rxbytes += packet->length;
+	csp_iface_stat_add(input.iface, rx, 1);
+	csp_iface_stat_add(input.iface, rxbytes, packet->length);
+	csp_route_workers[shard].stats.prio_packets[packet->id.pri]++;
+	csp_route_workers[shard].stats.prio_bytes[packet->id.pri] += packet->length;
 
 	/* If the message is not to me, route the message to the correct interface */
 	if ((packet->id.dst != csp_conf.address) && (packet->id.dst != CSP_BROADCAST_ADDR)) {
@@ -228,6 +246,15 @@ int csp_route_work(uint32_t timeout) {
 		return CSP_ERR_NONE;
 	}
 
+	/* Security checks, transport and application modify the packet - get a private copy, if shared with the promiscuous queue */
+	csp_packet_t * private_packet = csp_buffer_unshare(packet);
+	if (private_packet == NULL) {
+		csp_iface_stat_add(input.iface, drop, 1);
+		csp_buffer_free(packet);
+		return CSP_ERR_NONE;
+	}
+	packet = private_packet;
+
 	/* The message is to me, search for incoming socket */
 	socket = csp_port_get_socket(packet->id.dport);
 
@@ -237,11 +264,13 @@ int csp_route_work(uint32_t timeout) {
 			csp_buffer_free(packet);
 			return CSP_ERR_NONE;
 		}
+		csp_buffer_set_owner(packet, CSP_BUFFER_OWNER_CONN_RX);
 		if (csp_queue_enqueue(socket->socket, &packet, 0) != CSP_QUEUE_OK) {
 			csp_log_error("Conn-less socket queue full");
 			csp_buffer_free(packet);
 			return CSP_ERR_NONE;
 		}
+		csp_poll_signal(socket);
 		return CSP_ERR_NONE;
 	}
 
@@ -284,6 +313,7 @@ int csp_route_work(uint32_t timeout) {
 
 		/* Store the socket queue and options */
 		conn->socket = socket->socket;
+		conn->listener = socket;
 		conn->opts = socket->opts;
 
 	/* Packet to existing connection */
@@ -313,11 +343,101 @@ int csp_route_work(uint32_t timeout) {
 	return CSP_ERR_NONE;
 }
 
+static void csp_route_stats_batch(csp_route_stats_t * stats, unsigned int count) {
+
+	stats->batches++;
+	stats->packets += count;
+	if (count > stats->batch_max) {
+		stats->batch_max = count;
+	}
+
+	/* Buckets: 1, 2-3, 4-7, 8-15, ... */
+	unsigned int bucket = 0;
+	while ((count >>= 1) && (bucket < (CSP_ROUTE_STATS_BATCH_BUCKETS - 1))) {
+		++bucket;
+	}
+	stats->batch_size[bucket]++;
+
+}
+
+/**
+ * Route a batch of packets from the incoming queue of a router worker.
+ * Waits for the first packet until \a max_timeout, or until the next connection timer expires.
+ * @param shard router input shard (worker index)
+ * @param max_timeout max time in mS to wait for a packet
+ * @return #CSP_ERR_NONE if any packets were routed, #CSP_ERR_TIMEDOUT if none.
+ */
+static int csp_route_work_shard(unsigned int shard, uint32_t max_timeout) {
+
+	csp_route_worker_t * worker = &csp_route_workers[shard];
+
+	/* Handle expired connection timers (currently only RDP), and get the time until the next */
+	unsigned int expired;
+	uint32_t timeout = csp_conn_check_timeouts(shard, &expired);
+	if (timeout > max_timeout) {
+		timeout = max_timeout;
+	}
+	worker->stats.timeout_checks += expired;
+
+	/* Get next packets to route */
+	csp_qfifo_t input[CSP_ROUTE_BATCH_MAX];
+	const unsigned int count = csp_qfifo_read_n(shard, input, CSP_ROUTE_BATCH_MAX, timeout);
+
+	unsigned int routed = 0;
+	for (unsigned int i = 0; i < count; ++i) {
+		if (csp_route_input(shard, input[i]) == CSP_ERR_NONE) {
+			++routed;
+		}
+	}
+
+	if (routed == 0) {
+		return CSP_ERR_TIMEDOUT;
+	}
+
+	csp_route_stats_batch(&worker->stats, routed);
+
+	return CSP_ERR_NONE;
+
+}
+
+int csp_route_work(uint32_t timeout) {
+
+	/* Only the first worker's queue(s) are serviced */
+	if (csp_qfifo_shard_count() > 1) {
+		return CSP_ERR_INVAL;
+	}
+
+	return csp_route_work_shard(0, timeout);
+
+}
+
+int csp_route_get_stats(unsigned int worker, csp_route_stats_t * stats) {
+
+	if ((worker >= csp_qfifo_shard_count()) || (stats == NULL)) {
+		return CSP_ERR_INVAL;
+	}
+
+	*stats = csp_route_workers[worker].stats;
+
+	return CSP_ERR_NONE;
+
+}
+
+void csp_route_reset_stats(void) {
+
+	for (unsigned int i = 0; i < CSP_ROUTE_WORKERS_MAX; ++i) {
+		memset(&csp_route_workers[i].stats, 0, sizeof(csp_route_workers[i].stats));
+	}
+
+}
+
 static CSP_DEFINE_TASK(csp_task_router) {
 
+	const unsigned int shard = (uintptr_t) param;
+
 	/* Here there be routing */
 	while (1) {
-		csp_route_work(FIFO_TIMEOUT);
+		csp_route_work_shard(shard, CSP_MAX_TIMEOUT);
 	}
 
 	return CSP_TASK_RETURN;
@@ -326,10 +446,12 @@ static CSP_DEFINE_TASK(csp_task_router) {
 
 int csp_route_start_task(unsigned int task_stack_size, unsigned int task_priority) {
 
-	int ret = csp_thread_create(csp_task_router, "RTE", task_stack_size, NULL, task_priority, NULL);
-	if (ret != 0) {
-		csp_log_error("Failed to start router task, error: %d", ret);
-		return ret;
+	for (unsigned int shard = 0; shard < csp_qfifo_shard_count(); shard++) {
+		int ret = csp_thread_create(csp_task_router, "RTE", task_stack_size, (void *) (uintptr_t) shard, task_priority, NULL);
+		if (ret != 0) {
+			csp_log_error("Failed to start router task %u, error: %d", shard, ret);
+			return ret;
+		}
 	}
 
 	return CSP_ERR_NONE;
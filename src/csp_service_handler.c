@@ -165,6 +165,32 @@ static int do_cmp_clock(struct csp_cmp_message *cmp) {
 
 }
 
+static int do_cmp_buf_stats(struct csp_cmp_message *cmp) {
+
+	csp_buffer_stats_t stats;
+	int res = csp_buffer_get_stats(&stats, true);
+	if (res != CSP_ERR_NONE) {
+		return res;
+	}
+
+	memset(&cmp->buf_stats, 0, sizeof(cmp->buf_stats));
+	cmp->buf_stats.pool_count = (stats.pool_count < CSP_CMP_BUF_STATS_POOLS) ? stats.pool_count : CSP_CMP_BUF_STATS_POOLS;
+	for (unsigned int i = 0; i < cmp->buf_stats.pool_count; ++i) {
+		cmp->buf_stats.pool[i].data_size = csp_hton16(stats.pool[i].data_size);
+		cmp->buf_stats.pool[i].count =     csp_hton16(stats.pool[i].count);
+		cmp->buf_stats.pool[i].in_use =    csp_hton16(stats.pool[i].in_use);
+		cmp->buf_stats.pool[i].peak =      csp_hton16(stats.pool[i].peak);
+		cmp->buf_stats.pool[i].gets =      csp_hton32(stats.pool[i].gets);
+		cmp->buf_stats.pool[i].frees =     csp_hton32(stats.pool[i].frees);
+	}
+	cmp->buf_stats.failures = csp_hton32(stats.failures);
+	for (unsigned int i = 0; (i < CSP_BUFFER_OWNER_COUNT) && (i < CSP_CMP_BUF_STATS_OWNERS); ++i) {
+		cmp->buf_stats.owner[i] = csp_hton16(stats.owner[i]);
+	}
+
+	return CSP_ERR_NONE;
+}
+
 /* CSP Management Protocol handler */
 static int csp_cmp_handler(csp_conn_t * conn, csp_packet_t * packet) {
 
@@ -203,6 +229,11 @@ static int csp_cmp_handler(csp_conn_t * conn, csp_packet_t * packet) {
 			ret = do_cmp_clock(cmp);
 			break;
 
+		case CSP_CMP_BUF_STATS:
+			ret = do_cmp_buf_stats(cmp);
+			packet->length = CMP_SIZE(buf_stats);
+			break;
+
 		default:
 			ret = CSP_ERR_INVAL;
 			break;
@@ -218,6 +249,11 @@ void csp_service_handler(csp_conn_t * conn, csp_packet_t * packet) {
 	switch (csp_conn_dport(conn)) {
 
 	case CSP_CMP:
+		/* Room for the largest reply */
+		packet = csp_buffer_resize(packet, sizeof(struct csp_cmp_message));
+		if (packet == NULL) {
+			return;
+		}
 		/* Pass to CMP handler */
 		if (csp_cmp_handler(conn, packet) != CSP_ERR_NONE) {
 			csp_buffer_free(packet);
@@ -244,8 +280,13 @@ void csp_service_handler(csp_conn_t * conn, csp_packet_t * packet) {
 		char * pslist = csp_malloc(task_list_size);
 		/* Check for malloc fail */
 		if (pslist == NULL) {
+			static const char nomem[] = "Not enough memory";
+			packet = csp_buffer_resize(packet, sizeof(nomem));
+			if (packet == NULL) {
+				return;
+			}
 			/* Send out the data */
-			strcpy((char *)packet->data, "Not enough memory");
+			strcpy((char *)packet->data, nomem);
 			packet->length = strlen((char *)packet->data);
 			/* Break and let the default handling send packet */
 			break;
@@ -259,9 +300,11 @@ void csp_service_handler(csp_conn_t * conn, csp_packet_t * packet) {
 		int i = 0;
 		while(i < pslen) {
 
-			/* Allocate packet buffer, if need be */
+			/* Allocate packet buffer, if need be (the request buffer may be too small) */
 			if (packet == NULL)
 				packet = csp_buffer_get(CSP_RPS_MTU);
+			else
+				packet = csp_buffer_resize(packet, CSP_RPS_MTU);
 			if (packet == NULL)
 				break;
 
@@ -285,6 +328,11 @@ void csp_service_handler(csp_conn_t * conn, csp_packet_t * packet) {
 	case CSP_MEMFREE: {
 		uint32_t total = csp_sys_memfree();
 
+		packet = csp_buffer_resize(packet, sizeof(total));
+		if (packet == NULL) {
+			return;
+		}
+
 		total = csp_hton32(total);
 		memcpy(packet->data, &total, sizeof(total));
 		packet->length = sizeof(total);
@@ -311,6 +359,10 @@ void csp_service_handler(csp_conn_t * conn, csp_packet_t * packet) {
 
 	case CSP_BUF_FREE: {
 		uint32_t size = csp_buffer_remaining();
+		packet = csp_buffer_resize(packet, sizeof(size));
+		if (packet == NULL) {
+			return;
+		}
 		size = csp_hton32(size);
 		memcpy(packet->data, &size, sizeof(size));
 		packet->length = sizeof(size);
@@ -319,6 +371,10 @@ void csp_service_handler(csp_conn_t * conn, csp_packet_t * packet) {
 
 	case CSP_UPTIME: {
 		uint32_t time = csp_get_uptime_s();
+		packet = csp_buffer_resize(packet, sizeof(time));
+		if (packet == NULL) {
+			return;
+		}
 		time = csp_hton32(time);
 		memcpy(packet->data, &time, sizeof(time));
 		packet->length = sizeof(time);
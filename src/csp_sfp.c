@@ -39,9 +39,7 @@ typedef struct __attribute__((__packed__)) {
  */
 static inline sfp_header_t * csp_sfp_header_add(csp_packet_t * packet) {
 
-	sfp_header_t * header = (sfp_header_t *) &packet->data[packet->length];
-	packet->length += sizeof(*header);
-	return header;
+	return csp_buffer_put(packet, sizeof(sfp_header_t));
 }
 
 static inline sfp_header_t * csp_sfp_header_remove(csp_packet_t * packet) {
@@ -49,12 +47,10 @@ static inline sfp_header_t * csp_sfp_header_remove(csp_packet_t * packet) {
 	if ((packet->id.flags & CSP_FFRAG) == 0) {
 		return NULL;
 	}
-	sfp_header_t * header;
-	if (packet->length < sizeof(*header)) {
+	sfp_header_t * header = csp_buffer_trim(packet, sizeof(*header));
+	if (header == NULL) {
 		return NULL;
 	}
-        header = (sfp_header_t *) &packet->data[packet->length - sizeof(*header)];
-	packet->length -= sizeof(*header);
 
 	header->offset = csp_ntoh32(header->offset);
 	header->totalsize = csp_ntoh32(header->totalsize);
@@ -0,0 +1,199 @@
+/*
+Cubesat Space Protocol - A small network-layer protocol designed for Cubesats
+Copyright (C) 2012 Gomspace ApS (http://www.gomspace.com)
+Copyright (C) 2012 AAUSAT3 Project (http://aausat3.space.aau.dk)
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include <csp/csp_shaper.h>
+
+#include <string.h>
+
+#include <csp/csp.h>
+#include <csp/arch/csp_time.h>
+#include <csp/arch/csp_thread.h>
+
+int csp_shaper_init(csp_shaper_t * shaper, uint32_t rate_bytes, uint32_t rate_packets, uint32_t burst_bytes, uint32_t burst_packets) {
+
+	if (shaper == NULL) {
+		return CSP_ERR_INVAL;
+	}
+
+	memset(shaper, 0, sizeof(*shaper));
+	shaper->rate_bytes = rate_bytes;
+	shaper->rate_packets = rate_packets;
+	shaper->burst_bytes = (burst_bytes > 0) ? burst_bytes : rate_bytes;
+	shaper->burst_packets = (burst_packets > 0) ? burst_packets : rate_packets;
+	shaper->tokens_bytes = (int64_t) shaper->burst_bytes * 1000;
+	shaper->tokens_packets = (int64_t) shaper->burst_packets * 1000;
+	shaper->timestamp = csp_get_ms();
+
+	if (csp_mutex_create(&shaper->lock) != CSP_MUTEX_OK) {
+		return CSP_ERR_NOMEM;
+	}
+
+	return CSP_ERR_NONE;
+
+}
+
+/* Refill the buckets, tokens are stored as units * 1000 to get mS resolution. Call with lock held. */
+static void csp_shaper_refill(csp_shaper_t * shaper) {
+
+	const uint32_t now = csp_get_ms();
+	const uint32_t elapsed = now - shaper->timestamp;
+	if (elapsed == 0) {
+		return;
+	}
+	shaper->timestamp = now;
+
+	shaper->tokens_bytes += (int64_t) elapsed * shaper->rate_bytes;
+	if (shaper->tokens_bytes > ((int64_t) shaper->burst_bytes * 1000)) {
+		shaper->tokens_bytes = (int64_t) shaper->burst_bytes * 1000;
+	}
+
+	shaper->tokens_packets += (int64_t) elapsed * shaper->rate_packets;
+	if (shaper->tokens_packets > ((int64_t) shaper->burst_packets * 1000)) {
+		shaper->tokens_packets = (int64_t) shaper->burst_packets * 1000;
+	}
+
+}
+
+/* Time in mS until the bucket holds \a need tokens (units * 1000), at \a rate units per second */
+static uint32_t csp_shaper_bucket_wait(int64_t tokens, int64_t need, uint32_t rate) {
+
+	if ((rate == 0) || (tokens >= need)) {
+		return 0;
+	}
+	return (uint32_t) (((need - tokens) + rate - 1) / rate);
+
+}
+
+/* Time in mS until a packet of \a bytes conforms to the rate. Call with lock held. */
+static uint32_t csp_shaper_wait_time(csp_shaper_t * shaper, uint16_t bytes) {
+
+	csp_shaper_refill(shaper);
+
+	/* A packet larger than the burst size is allowed, when the bucket is full */
+	int64_t need_bytes = (int64_t) bytes * 1000;
+	if (need_bytes > ((int64_t) shaper->burst_bytes * 1000)) {
+		need_bytes = (int64_t) shaper->burst_bytes * 1000;
+	}
+	const uint32_t wait_bytes = csp_shaper_bucket_wait(shaper->tokens_bytes, need_bytes, shaper->rate_bytes);
+	const uint32_t wait_packets = csp_shaper_bucket_wait(shaper->tokens_packets, 1000, shaper->rate_packets);
+
+	return (wait_bytes > wait_packets) ? wait_bytes : wait_packets;
+
+}
+
+/* Take tokens for a packet of \a bytes. Call with lock held. */
+static void csp_shaper_take(csp_shaper_t * shaper, uint16_t bytes) {
+
+	if (shaper->rate_bytes) {
+		shaper->tokens_bytes -= (int64_t) bytes * 1000;
+	}
+	if (shaper->rate_packets) {
+		shaper->tokens_packets -= 1000;
+	}
+
+}
+
+bool csp_shaper_police(csp_shaper_t * shaper, uint16_t bytes) {
+
+	if (shaper == NULL) {
+		return true;
+	}
+
+	csp_mutex_lock(&shaper->lock, CSP_MAX_TIMEOUT);
+
+	const bool conform = (csp_shaper_wait_time(shaper, bytes) == 0);
+	if (conform) {
+		csp_shaper_take(shaper, bytes);
+	} else {
+		shaper->dropped++;
+	}
+
+	csp_mutex_unlock(&shaper->lock);
+
+	return conform;
+
+}
+
+bool csp_shaper_police_pair(csp_shaper_t * first, csp_shaper_t * second, uint16_t bytes) {
+
+	if ((second == NULL) || (second == first)) {
+		return csp_shaper_police(first, bytes);
+	}
+	if (first == NULL) {
+		return csp_shaper_police(second, bytes);
+	}
+
+	/* Lock in address order, so senders policing the same shapers in opposite order can't deadlock */
+	if ((uintptr_t) second < (uintptr_t) first) {
+		csp_shaper_t * tmp = first;
+		first = second;
+		second = tmp;
+	}
+
+	csp_mutex_lock(&first->lock, CSP_MAX_TIMEOUT);
+	csp_mutex_lock(&second->lock, CSP_MAX_TIMEOUT);
+
+	const bool first_conform = (csp_shaper_wait_time(first, bytes) == 0);
+	const bool second_conform = (csp_shaper_wait_time(second, bytes) == 0);
+	if (first_conform && second_conform) {
+		csp_shaper_take(first, bytes);
+		csp_shaper_take(second, bytes);
+	} else {
+		if (!first_conform) {
+			first->dropped++;
+		}
+		if (!second_conform) {
+			second->dropped++;
+		}
+	}
+
+	csp_mutex_unlock(&second->lock);
+	csp_mutex_unlock(&first->lock);
+
+	return (first_conform && second_conform);
+
+}
+
+void csp_shaper_wait(csp_shaper_t * shaper, uint16_t bytes) {
+
+	if (shaper == NULL) {
+		return;
+	}
+
+	bool shaped = false;
+
+	csp_mutex_lock(&shaper->lock, CSP_MAX_TIMEOUT);
+
+	uint32_t wait;
+	while ((wait = csp_shaper_wait_time(shaper, bytes)) > 0) {
+		shaped = true;
+		csp_mutex_unlock(&shaper->lock);
+		csp_sleep_ms(wait);
+		csp_mutex_lock(&shaper->lock, CSP_MAX_TIMEOUT);
+	}
+
+	csp_shaper_take(shaper, bytes);
+	if (shaped) {
+		shaper->shaped++;
+	}
+
+	csp_mutex_unlock(&shaper->lock);
+
+}
@@ -0,0 +1,187 @@
+/*
+Cubesat Space Protocol - A small network-layer protocol designed for Cubesats
+Copyright (C) 2012 Gomspace ApS (http://www.gomspace.com)
+Copyright (C) 2012 AAUSAT3 Project (http://aausat3.space.aau.dk)
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "csp_timer.h"
+
+#include <string.h>
+
+/* True if time a is after or equal to time b (wrap safe) */
+static inline bool csp_timer_after_eq(uint32_t a, uint32_t b) {
+	return ((int32_t)(a - b) >= 0);
+}
+
+static inline unsigned int csp_timer_slot(const csp_timer_wheel_t * wheel, uint32_t time) {
+	return (time / wheel->tick_ms) & (CSP_TIMER_WHEEL_SLOTS - 1);
+}
+
+static void csp_timer_link(csp_timer_t ** head, csp_timer_t * timer) {
+
+	timer->next = *head;
+	if (timer->next) {
+		timer->next->pprev = &timer->next;
+	}
+	timer->pprev = head;
+	*head = timer;
+
+}
+
+static void csp_timer_unlink(csp_timer_t * timer) {
+
+	*timer->pprev = timer->next;
+	if (timer->next) {
+		timer->next->pprev = timer->pprev;
+	}
+	timer->next = NULL;
+	timer->pprev = NULL;
+
+}
+
+void csp_timer_wheel_init(csp_timer_wheel_t * wheel, uint32_t tick_ms, uint32_t now) {
+
+	memset(wheel, 0, sizeof(*wheel));
+	wheel->tick_ms = (tick_ms > 0) ? tick_ms : 1;
+	wheel->last = now;
+
+}
+
+void csp_timer_init(csp_timer_t * timer, csp_timer_cb_t callback, void * context) {
+
+	timer->next = NULL;
+	timer->pprev = NULL;
+	timer->expires = 0;
+	timer->callback = callback;
+	timer->context = context;
+
+}
+
+void csp_timer_start(csp_timer_wheel_t * wheel, csp_timer_t * timer, uint32_t expires) {
+
+	csp_timer_stop(wheel, timer);
+
+	/* Timers that have already expired are handled in next run */
+	const uint32_t slot_time = csp_timer_after_eq(expires, wheel->last) ? expires : wheel->last;
+
+	timer->expires = expires;
+	csp_timer_link(&wheel->slots[csp_timer_slot(wheel, slot_time)], timer);
+	wheel->count++;
+
+}
+
+void csp_timer_stop(csp_timer_wheel_t * wheel, csp_timer_t * timer) {
+
+	if (timer->pprev) {
+		csp_timer_unlink(timer);
+		wheel->count--;
+	}
+
+}
+
+unsigned int csp_timer_wheel_run(csp_timer_wheel_t * wheel, uint32_t now) {
+
+	if (!csp_timer_after_eq(now, wheel->last)) {
+		return 0;
+	}
+
+	/* Visit the slots of all ticks since last run, including the current tick (at most one round) */
+	uint32_t ticks = (now / wheel->tick_ms) - (wheel->last / wheel->tick_ms) + 1;
+	if (ticks > CSP_TIMER_WHEEL_SLOTS) {
+		ticks = CSP_TIMER_WHEEL_SLOTS;
+	}
+
+	unsigned int slot = csp_timer_slot(wheel, wheel->last);
+	for (uint32_t i = 0; i < ticks; i++) {
+		csp_timer_t * timer = wheel->slots[slot];
+		while (timer) {
+			csp_timer_t * next = timer->next;
+			/* Timers in later rounds stay in the slot */
+			if (csp_timer_after_eq(now, timer->expires)) {
+				csp_timer_unlink(timer);
+				csp_timer_link(&wheel->expired, timer);
+			}
+			timer = next;
+		}
+		slot = (slot + 1) & (CSP_TIMER_WHEEL_SLOTS - 1);
+	}
+
+	wheel->last = now;
+
+	/* Callbacks may start/stop timers, including expired timers not yet called */
+	unsigned int expired = 0;
+	csp_timer_t * timer;
+	while ((timer = wheel->expired) != NULL) {
+		csp_timer_unlink(timer);
+		wheel->count--;
+		expired++;
+		if (timer->callback) {
+			timer->callback(timer, timer->context);
+		}
+	}
+
+	return expired;
+
+}
+
+uint32_t csp_timer_wheel_timeout(const csp_timer_wheel_t * wheel, uint32_t now) {
+
+	if (wheel->count == 0) {
+		return CSP_MAX_TIMEOUT;
+	}
+
+	return wheel->tick_ms - (now % wheel->tick_ms);
+
+}
+
+uint32_t csp_timer_wheel_next(const csp_timer_wheel_t * wheel, uint32_t now) {
+
+	if (wheel->count == 0) {
+		return CSP_MAX_TIMEOUT;
+	}
+
+	/* Visit the slots of the next round in order, the first slot holding a timer of this round has the first timer */
+	const uint32_t tick = wheel->last / wheel->tick_ms;
+	const csp_timer_t * first = NULL;
+	for (uint32_t i = 0; (i < CSP_TIMER_WHEEL_SLOTS) && (first == NULL); i++) {
+		/* Timers (also already expired) up to the end of this tick */
+		const uint32_t end = ((tick + i + 1) * wheel->tick_ms) - 1;
+		for (const csp_timer_t * timer = wheel->slots[(tick + i) & (CSP_TIMER_WHEEL_SLOTS - 1)]; timer; timer = timer->next) {
+			if (csp_timer_after_eq(end, timer->expires) && ((first == NULL) || !csp_timer_after_eq(timer->expires, first->expires))) {
+				first = timer;
+			}
+		}
+	}
+
+	/* All timers are in later rounds */
+	if (first == NULL) {
+		for (unsigned int slot = 0; slot < CSP_TIMER_WHEEL_SLOTS; slot++) {
+			for (const csp_timer_t * timer = wheel->slots[slot]; timer; timer = timer->next) {
+				if ((first == NULL) || !csp_timer_after_eq(timer->expires, first->expires)) {
+					first = timer;
+				}
+			}
+		}
+	}
+
+	if ((first == NULL) || csp_timer_after_eq(now, first->expires)) {
+		return 0;
+	}
+
+	return first->expires - now;
+
+}
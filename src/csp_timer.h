@@ -0,0 +1,143 @@
+/*
+Cubesat Space Protocol - A small network-layer protocol designed for Cubesats
+Copyright (C) 2012 Gomspace ApS (http://www.gomspace.com)
+Copyright (C) 2012 AAUSAT3 Project (http://aausat3.space.aau.dk)
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef _CSP_TIMER_H_
+#define _CSP_TIMER_H_
+
+/**
+   @file
+
+   Hashed timer wheel.
+
+   Timers are hashed into a fixed number of slots by their expiry tick, so starting and stopping a timer is O(1),
+   and running the wheel only visits the slots for the ticks that have passed.
+   The wheel is not thread safe, the owner must provide locking.
+*/
+
+#include <csp/csp_platform.h>
+#include <csp/csp_types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+   Number of slots in a timer wheel (power of 2).
+*/
+#define CSP_TIMER_WHEEL_SLOTS	64
+
+typedef struct csp_timer_s csp_timer_t;
+
+/**
+   Timer callback, called from csp_timer_wheel_run(). The callback may start/stop any timer on the wheel.
+*/
+typedef void (*csp_timer_cb_t)(csp_timer_t * timer, void * context);
+
+/**
+   Timer.
+*/
+struct csp_timer_s {
+	csp_timer_t * next;		/**< Next timer in slot */
+	csp_timer_t ** pprev;		/**< Reference to this timer in slot, NULL if not pending */
+	uint32_t expires;		/**< Expiry time (mS) */
+	csp_timer_cb_t callback;	/**< Callback */
+	void * context;			/**< Callback context */
+};
+
+/**
+   Timer wheel.
+*/
+typedef struct {
+	csp_timer_t * slots[CSP_TIMER_WHEEL_SLOTS]; /**< Timers hashed by expiry tick */
+	csp_timer_t * expired;		/**< Expired timers, waiting for their callback */
+	uint32_t tick_ms;		/**< Tick (slot) length in mS */
+	uint32_t last;			/**< Time of last run (mS) */
+	unsigned int count;		/**< Number of pending timers */
+} csp_timer_wheel_t;
+
+/**
+   Initialize timer wheel.
+   @param[in] wheel timer wheel.
+   @param[in] tick_ms tick length in mS, i.e. the resolution of the timers.
+   @param[in] now current time (mS).
+*/
+void csp_timer_wheel_init(csp_timer_wheel_t * wheel, uint32_t tick_ms, uint32_t now);
+
+/**
+   Initialize timer.
+   @param[in] timer timer.
+   @param[in] callback callback, called when the timer expires.
+   @param[in] context callback context.
+*/
+void csp_timer_init(csp_timer_t * timer, csp_timer_cb_t callback, void * context);
+
+/**
+   Start (or restart) timer.
+   @param[in] wheel timer wheel.
+   @param[in] timer timer.
+   @param[in] expires expiry time (mS).
+*/
+void csp_timer_start(csp_timer_wheel_t * wheel, csp_timer_t * timer, uint32_t expires);
+
+/**
+   Stop timer, does nothing if the timer is not pending.
+   @param[in] wheel timer wheel.
+   @param[in] timer timer.
+*/
+void csp_timer_stop(csp_timer_wheel_t * wheel, csp_timer_t * timer);
+
+/**
+   Return true if timer is pending.
+   @param[in] timer timer.
+*/
+static inline bool csp_timer_pending(const csp_timer_t * timer) {
+	return (timer->pprev != NULL);
+}
+
+/**
+   Run timer wheel, calling the callback of all expired timers.
+   @param[in] wheel timer wheel.
+   @param[in] now current time (mS).
+   @return number of expired timers.
+*/
+unsigned int csp_timer_wheel_run(csp_timer_wheel_t * wheel, uint32_t now);
+
+/**
+   Time until the wheel should be run again.
+   @param[in] wheel timer wheel.
+   @param[in] now current time (mS).
+   @return time in mS until next tick, or #CSP_MAX_TIMEOUT if no timers are pending.
+*/
+uint32_t csp_timer_wheel_timeout(const csp_timer_wheel_t * wheel, uint32_t now);
+
+/**
+   Time until the first pending timer expires.
+   Unlike csp_timer_wheel_timeout(), this allows the owner to sleep until the next timer, instead of the next tick.
+   Only the slots of the next round are visited, unless all timers expire later.
+   @param[in] wheel timer wheel.
+   @param[in] now current time (mS).
+   @return time in mS until the first timer expires (0 if expired), or #CSP_MAX_TIMEOUT if no timers are pending.
+*/
+uint32_t csp_timer_wheel_next(const csp_timer_wheel_t * wheel, uint32_t now);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
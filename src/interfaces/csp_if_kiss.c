@@ -108,7 +108,7 @@ void csp_kiss_rx(csp_iface_t * iface, const uint8_t * buf, size_t len, void * px
 
 			/* Try to allocate new buffer */
 			if (ifdata->rx_packet == NULL) {
-				ifdata->rx_packet = pxTaskWoken ? csp_buffer_get_isr(0) : csp_buffer_get(0); // CSP only supports one size
+				ifdata->rx_packet = pxTaskWoken ? csp_buffer_get_isr(csp_buffer_data_size()) : csp_buffer_get(csp_buffer_data_size()); // length unknown, get largest size
 			}
 
 			/* If no more memory, skip frame */
@@ -116,6 +116,7 @@ void csp_kiss_rx(csp_iface_t * iface, const uint8_t * buf, size_t len, void * px
 				ifdata->rx_mode = KISS_MODE_SKIP_FRAME;
 				break;
 			}
+			csp_buffer_set_owner(ifdata->rx_packet, CSP_BUFFER_OWNER_IF_RX);
 
 			/* Start transfer */
 			ifdata->rx_length = 0;
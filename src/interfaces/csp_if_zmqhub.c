@@ -59,8 +59,12 @@ int csp_zmqhub_tx(const csp_route_t * route, csp_packet_t * packet) {
 
 	const uint8_t dest = (route->via != CSP_NO_VIA_ADDRESS) ? route->via : packet->id.dst;
 
+	/* Frame: via + CSP header + data */
 	uint16_t length = packet->length;
-	uint8_t * destptr = ((uint8_t *) &packet->id) - sizeof(dest);
+	uint8_t * destptr = csp_buffer_push(packet, sizeof(dest));
+	if (destptr == NULL) {
+		return CSP_ERR_NOMEM;
+	}
 	memcpy(destptr, &dest, sizeof(dest));
 	csp_bin_sem_wait(&drv->tx_wait, 1000); /* Using ZMQ in thread safe manner*/
 	int result = zmq_send(drv->publisher, destptr, length + sizeof(packet->id) + sizeof(dest), 0);
@@ -104,6 +104,25 @@ int csp_rtable_set(uint8_t address, uint8_t netmask, csp_iface_t *ifc, uint8_t v
         return csp_rtable_set_internal(address, netmask, ifc, via);
 }
 
+int csp_rtable_set_shaper(uint8_t address, uint8_t netmask, csp_shaper_t * shaper) {
+
+	/* Legacy reference to default route (the old way) */
+	if (address == CSP_DEFAULT_ROUTE) {
+		netmask = 0;
+		address = 0;
+	}
+
+	csp_route_t * route = csp_rtable_find_exact(address, netmask);
+	if (route == NULL) {
+		csp_log_error("%s: no route: address %u, netmask %u", __FUNCTION__, address, netmask);
+		return CSP_ERR_INVAL;
+	}
+
+	route->shaper = shaper;
+
+	return CSP_ERR_NONE;
+}
+
 typedef struct {
     char * buffer;
     size_t len;
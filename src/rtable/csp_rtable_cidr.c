@@ -107,6 +107,7 @@ int csp_rtable_set_internal(uint8_t address, uint8_t netmask, csp_iface_t *ifc,
 		}
 
 		entry->next = NULL;
+		entry->route.shaper = NULL;
 		/* Add entry to linked-list */
 		if (rtable == NULL) {
 			/* This is the first interface to be added */
@@ -130,6 +131,13 @@ int csp_rtable_set_internal(uint8_t address, uint8_t netmask, csp_iface_t *ifc,
 	return CSP_ERR_NONE;
 }
 
+csp_route_t * csp_rtable_find_exact(uint8_t address, uint8_t netmask) {
+
+	csp_rtable_t * entry = csp_rtable_find(address, netmask, 1);
+	return entry ? &entry->route : NULL;
+
+}
+
 void csp_rtable_free(void) {
 	for (csp_rtable_t * i = rtable; (i);) {
 		void * freeme = i;
@@ -22,3 +22,6 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
 
 /* Internal set route - after common validation by csp_rtable_set(...) */
 int csp_rtable_set_internal(uint8_t address, uint8_t netmask, csp_iface_t *ifc, uint8_t via);
+
+/* Internal find route with exact match on address and netmask - after common validation */
+csp_route_t * csp_rtable_find_exact(uint8_t address, uint8_t netmask);
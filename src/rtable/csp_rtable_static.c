@@ -53,6 +53,17 @@ int csp_rtable_set_internal(uint8_t address, uint8_t netmask, csp_iface_t *ifc,
 	return CSP_ERR_NONE;
 }
 
+csp_route_t * csp_rtable_find_exact(uint8_t address, uint8_t netmask) {
+
+	if ((netmask != 0) && (netmask != CSP_ID_HOST_SIZE)) {
+		return NULL;
+	}
+
+	csp_route_t * route = &rtable[(netmask == 0) ? CSP_DEFAULT_ROUTE : address];
+	return (route->iface != NULL) ? route : NULL;
+
+}
+
 void csp_rtable_free(void) {
 
 	memset(rtable, 0, sizeof(rtable));
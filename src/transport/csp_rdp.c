@@ -40,6 +40,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
 
 #include "../csp_port.h"
 #include "../csp_conn.h"
+#include "../csp_poll.h"
 #include "../csp_io.h"
 #include "../csp_init.h"
 
@@ -50,6 +51,21 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
 
 #if (CSP_USE_RDP)
 
+#ifndef CSP_RDP_RTO_MIN_MS
+/**
+ * Lower bound of the retransmission timeout, and clock granularity in the RTO calculation.
+ * RDP timers run on the connection timer wheel with a resolution of CSP_CONN_TIMER_TICK_MS, so a lower RTO has no effect.
+ */
+#define CSP_RDP_RTO_MIN_MS	10
+#endif
+
+#ifndef CSP_RDP_CWND_INITIAL
+/**
+ * Initial congestion window (segments), see csp_conf_t.rdp_congestion_control.
+ */
+#define CSP_RDP_CWND_INITIAL	2
+#endif
+
 static uint32_t csp_rdp_window_size = 4;
 static uint32_t csp_rdp_conn_timeout = 10000;
 static uint32_t csp_rdp_packet_timeout = 1000;
@@ -57,24 +73,6 @@ static uint32_t csp_rdp_delayed_acks = 1;
 static uint32_t csp_rdp_ack_timeout = 1000 / 4;
 static uint32_t csp_rdp_ack_delay_count = 4 / 2;
 
-/* Used for queue calls */
-static CSP_BASE_TYPE pdTrue = 1;
-
-/* RDP header - on top of csp_packet_t */
-typedef struct {
-	uint32_t quarantine;	// EACK quarantine period (-> csp_packet_t.padding)
-	uint32_t timestamp;	// Time the message was sent (-> csp_packet_t.padding)
-	uint8_t padding[CSP_PADDING_BYTES - (2 * sizeof(uint32_t))];
-	uint16_t length;	// Overlay length member in csp_packet_t
-	csp_id_t id;		// Overlay id member in csp_packet_t
-	uint8_t data[];		// Overlay data member in csp_packet_t
-} rdp_packet_t;
-
-// Ensure certain fields in the rdp_packet_t matches the fields in the csp_packet_t
-CSP_STATIC_ASSERT(offsetof(rdp_packet_t, length) == offsetof(csp_packet_t, length), length_field_misaligned);
-CSP_STATIC_ASSERT(offsetof(rdp_packet_t, id) == offsetof(csp_packet_t, id), id_field_misaligned);
-CSP_STATIC_ASSERT(offsetof(rdp_packet_t, data) == offsetof(csp_packet_t, data), data_field_misaligned);
-
 typedef struct __attribute__((__packed__)) {
 	union __attribute__((__packed__)) {
 		uint8_t flags;
@@ -106,20 +104,16 @@ static int csp_rdp_close_internal(csp_conn_t * conn, uint8_t closed_by, bool sen
  * information that needs to be appended to all data packets.
  */
 static rdp_header_t * csp_rdp_header_add(csp_packet_t * packet) {
-	rdp_header_t * header;
-	if ((packet->length + sizeof(*header)) > csp_buffer_data_size()) {
+	rdp_header_t * header = csp_buffer_put(packet, sizeof(*header));
+	if (header == NULL) {
 		return NULL;
 	}
-	header = (rdp_header_t *) &packet->data[packet->length];
-	packet->length += sizeof(*header);
 	memset(header, 0, sizeof(*header));
 	return header;
 }
 
 static rdp_header_t * csp_rdp_header_remove(csp_packet_t * packet) {
-	rdp_header_t * header = (rdp_header_t *) &packet->data[packet->length - sizeof(*header)];
-	packet->length -= sizeof(*header);
-	return header;
+	return csp_buffer_trim(packet, sizeof(rdp_header_t));
 }
 
 static rdp_header_t * csp_rdp_header_ref(csp_packet_t * packet) {
@@ -159,6 +153,252 @@ static inline int csp_rdp_time_after(uint32_t time, uint32_t cmp) {
 	return csp_rdp_time_before(cmp, time);
 }
 
+/**
+ * TIMERS
+ * Each connection has a single timer, set to the first of its retransmission, delayed ACK, connection and close-wait timeouts.
+ * When the timer expires, csp_rdp_check_timeouts() is called, which sets the timer to the next timeout.
+ * In between, the timer is only started when a timeout earlier than the pending one is introduced.
+ */
+static inline void csp_rdp_timer_start(csp_conn_t * conn, uint32_t timeout) {
+	/* Timeouts are checked by csp_rdp_time_after(), so expire the mS after */
+	csp_conn_timer_start(conn, timeout + 1);
+}
+
+/**
+ * RETRANSMISSION TIMEOUT
+ * The RTO is calculated from the measured round trip time (Jacobson/Karels, RFC 6298).
+ * The RTO is never lower than the ACK delay of the receiver, and never higher than the connection timeout.
+ */
+static void csp_rdp_rto_reset(csp_conn_t * conn) {
+
+	conn->rdp.srtt = 0;
+	conn->rdp.rttvar = 0;
+	conn->rdp.rtt_valid = false;
+	conn->rdp.rto = conn->rdp.packet_timeout;
+
+}
+
+static uint32_t csp_rdp_rto_clamp(const csp_conn_t * conn, uint32_t rto) {
+
+	uint32_t rto_min = CSP_RDP_RTO_MIN_MS;
+	if (conn->rdp.delayed_acks && (conn->rdp.ack_timeout + CSP_RDP_RTO_MIN_MS > rto_min)) {
+		rto_min = conn->rdp.ack_timeout + CSP_RDP_RTO_MIN_MS;
+	}
+	if (rto < rto_min) {
+		rto = rto_min;
+	}
+	if (rto > conn->rdp.conn_timeout) {
+		rto = conn->rdp.conn_timeout;
+	}
+	return rto;
+
+}
+
+static void csp_rdp_rtt_sample(csp_conn_t * conn, uint32_t rtt) {
+
+	if (!conn->rdp.rtt_valid) {
+		conn->rdp.srtt = rtt;
+		conn->rdp.rttvar = rtt / 2;
+		conn->rdp.rtt_valid = true;
+	} else {
+		const uint32_t delta = (conn->rdp.srtt > rtt) ? (conn->rdp.srtt - rtt) : (rtt - conn->rdp.srtt);
+		conn->rdp.rttvar = (3 * conn->rdp.rttvar + delta) / 4;
+		conn->rdp.srtt = (7 * conn->rdp.srtt + rtt) / 8;
+	}
+
+	csp_log_protocol("RDP %p: RTT %"PRIu32", srtt %"PRIu32", rttvar %"PRIu32, conn, rtt, conn->rdp.srtt, conn->rdp.rttvar);
+
+}
+
+/* Calculate RTO from the RTT estimate, clearing any backoff */
+static void csp_rdp_rto_update(csp_conn_t * conn) {
+
+	if (conn->rdp.rtt_valid) {
+		const uint32_t var = 4 * conn->rdp.rttvar;
+		conn->rdp.rto = csp_rdp_rto_clamp(conn, conn->rdp.srtt + ((var > CSP_RDP_RTO_MIN_MS) ? var : CSP_RDP_RTO_MIN_MS));
+	} else {
+		conn->rdp.rto = conn->rdp.packet_timeout;
+	}
+
+}
+
+/* Exponential backoff, after a retransmission timeout */
+static void csp_rdp_rto_backoff(csp_conn_t * conn) {
+
+	conn->rdp.rto = csp_rdp_rto_clamp(conn, 2 * conn->rdp.rto);
+
+}
+
+/**
+ * CONGESTION CONTROL
+ * Congestion window counted in segments, only applied with csp_conf_t.rdp_congestion_control:
+ * slow start up to ssthresh, then one segment per window (AIMD). The window is halved when an
+ * EACK reports lost segments, and set to one segment on retransmission timeout.
+ */
+static inline uint16_t csp_rdp_window_max(const csp_conn_t * conn) {
+	return (conn->rdp.window_size < conn->rdp.tx_size) ? conn->rdp.window_size : conn->rdp.tx_size;
+}
+
+static void csp_rdp_cc_reset(csp_conn_t * conn) {
+
+	conn->rdp.cwnd = CSP_RDP_CWND_INITIAL;
+	conn->rdp.ssthresh = UINT16_MAX;
+	conn->rdp.cwnd_count = 0;
+	conn->rdp.recovery = false;
+	conn->rdp.retransmits = 0;
+	conn->rdp.fast_retransmits = 0;
+	conn->rdp.timeouts = 0;
+
+}
+
+/* Segments acknowledged, open the window - call with conn->rdp.lock held */
+static void csp_rdp_cc_ack(csp_conn_t * conn, uint16_t acked) {
+
+	if (conn->rdp.recovery && !csp_rdp_seq_before(conn->rdp.snd_una, conn->rdp.recover)) {
+		conn->rdp.recovery = false;
+	}
+
+	if (conn->rdp.cwnd < conn->rdp.ssthresh) {
+		/* Slow start */
+		conn->rdp.cwnd += acked;
+	} else {
+		/* Congestion avoidance */
+		conn->rdp.cwnd_count += acked;
+		if (conn->rdp.cwnd_count >= conn->rdp.cwnd) {
+			conn->rdp.cwnd_count -= conn->rdp.cwnd;
+			conn->rdp.cwnd++;
+		}
+	}
+
+	const uint16_t window = csp_rdp_window_max(conn);
+	if (conn->rdp.cwnd > window) {
+		conn->rdp.cwnd = (window > 0) ? window : 1;
+	}
+
+}
+
+/* Segments lost, reduce the window - call with conn->rdp.lock held */
+static void csp_rdp_cc_loss(csp_conn_t * conn, uint16_t outstanding, bool timeout) {
+
+	conn->rdp.ssthresh = (outstanding / 2 > 2) ? (outstanding / 2) : 2;
+	conn->rdp.cwnd = timeout ? 1 : conn->rdp.ssthresh;
+	conn->rdp.cwnd_count = 0;
+	conn->rdp.recovery = true;
+	conn->rdp.recover = conn->rdp.snd_nxt;
+	if (timeout) {
+		conn->rdp.timeouts++;
+	} else {
+		conn->rdp.fast_retransmits++;
+	}
+
+	csp_log_protocol("RDP %p: %s, cwnd %u, ssthresh %u", conn, timeout ? "Timeout" : "Lost segments", conn->rdp.cwnd, conn->rdp.ssthresh);
+
+}
+
+/**
+ * RETRANSMIT BUFFER
+ * Unacknowledged segments are stored in a ring indexed by their distance to snd_una,
+ * so ACK, EACK and timeout processing only visit the segments concerned.
+ * Call with conn->rdp.lock held.
+ */
+static inline csp_rdp_tx_slot_t * csp_rdp_tx_slot(csp_conn_t * conn, uint16_t offset) {
+	return &conn->rdp.tx_slot[(conn->rdp.tx_head + offset) % conn->rdp.tx_size];
+}
+
+/* Number of segments between snd_una and snd_nxt */
+static inline uint16_t csp_rdp_tx_outstanding(const csp_conn_t * conn) {
+	const uint16_t outstanding = conn->rdp.snd_nxt - conn->rdp.snd_una;
+	return (outstanding < conn->rdp.tx_size) ? outstanding : conn->rdp.tx_size;
+}
+
+/* Store a reference to a segment in the retransmit buffer */
+static int csp_rdp_tx_store(csp_conn_t * conn, csp_packet_t * packet, uint16_t seq_nr) {
+
+	const uint16_t offset = seq_nr - conn->rdp.snd_una;
+	if ((offset >= conn->rdp.tx_size) || csp_rdp_tx_slot(conn, offset)->packet) {
+		return CSP_ERR_NOBUFS;
+	}
+
+	/* Share packet with the retransmit buffer (csp_send_direct() copies shared packets) */
+	csp_packet_t * ref = csp_buffer_ref(packet);
+	if (ref == NULL) {
+		return CSP_ERR_NOMEM;
+	}
+	csp_buffer_set_owner(ref, CSP_BUFFER_OWNER_RDP_TX);
+
+	csp_rdp_tx_slot_t * slot = csp_rdp_tx_slot(conn, offset);
+	slot->packet = ref;
+	slot->timestamp = csp_get_ms();
+	slot->quarantine = 0;
+	slot->retransmits = 0;
+	slot->fast_retransmit = false;
+
+	/* Later segments time out after the oldest, which the timer is already set for */
+	if (offset == 0) {
+		csp_rdp_timer_start(conn, slot->timestamp + conn->rdp.rto);
+	}
+
+	return CSP_ERR_NONE;
+
+}
+
+/* Free segments acknowledged by ack_nr and advance snd_una (never backwards, or past snd_nxt) */
+static void csp_rdp_tx_ack(csp_conn_t * conn, uint16_t ack_nr) {
+
+	const uint32_t time_now = csp_get_ms();
+	bool freed = false;
+	bool sampled = false;
+	bool retransmitted = false;
+	uint32_t timestamp = 0;
+	uint16_t acked = 0;
+
+	csp_mutex_lock(&conn->rdp.lock, CSP_MAX_TIMEOUT);
+
+	const uint32_t rto = conn->rdp.rto;
+	while (csp_rdp_seq_before(conn->rdp.snd_una, ack_nr + 1) && csp_rdp_seq_before(conn->rdp.snd_una, conn->rdp.snd_nxt)) {
+		csp_rdp_tx_slot_t * slot = csp_rdp_tx_slot(conn, 0);
+		if (slot->packet) {
+			csp_log_protocol("RDP %p: TX Element Free, time %"PRIu32", seq %u", conn, slot->timestamp, conn->rdp.snd_una);
+			freed = true;
+			if (slot->retransmits) {
+				retransmitted = true;
+			} else if (!retransmitted) {
+				/* Newest segment sent once (Karn), and not held back by the receiver behind a retransmitted segment */
+				timestamp = slot->timestamp;
+				sampled = true;
+			}
+			csp_buffer_free(slot->packet);
+			slot->packet = NULL;
+		}
+		conn->rdp.tx_head = (conn->rdp.tx_head + 1) % conn->rdp.tx_size;
+		conn->rdp.snd_una++;
+		acked++;
+	}
+
+	if (acked) {
+		csp_rdp_cc_ack(conn, acked);
+	}
+
+	/* Measure RTT on the newest acknowledged segment, that was not retransmitted (RFC 6298) */
+	if (sampled) {
+		csp_rdp_rtt_sample(conn, time_now - timestamp);
+	}
+
+	/* The connection is making progress, clear backoff */
+	if (freed) {
+		csp_rdp_rto_update(conn);
+	}
+
+	/* The oldest segment times out earlier with a lower RTO */
+	const csp_rdp_tx_slot_t * oldest = csp_rdp_tx_slot(conn, 0);
+	if ((conn->rdp.rto < rto) && csp_rdp_tx_outstanding(conn) && oldest->packet) {
+		csp_rdp_timer_start(conn, oldest->timestamp + conn->rdp.rto);
+	}
+
+	csp_mutex_unlock(&conn->rdp.lock);
+
+}
+
 /**
  * CONTROL MESSAGES
  * The following function is used to send empty messages,
@@ -188,13 +428,11 @@ static int csp_rdp_send_cmp(csp_conn_t * conn, csp_packet_t * packet, int flags,
 	header->syn = (flags & RDP_SYN) ? 1 : 0;
 	header->rst = (flags & RDP_RST) ? 1 : 0;
 
-	/* Send copy to tx_queue, before sending packet to IF */
+	/* Store SYN in the retransmit buffer, before sending packet to IF */
 	if (flags & RDP_SYN) {
-		rdp_packet_t * rdp_packet = csp_buffer_clone(packet);
-		if (rdp_packet == NULL) return CSP_ERR_NOMEM;
-		rdp_packet->timestamp = csp_get_ms();
-		if (csp_queue_enqueue(conn->rdp.tx_queue, &rdp_packet, 0) != CSP_QUEUE_OK)
-			csp_buffer_free(rdp_packet);
+		csp_mutex_lock(&conn->rdp.lock, CSP_MAX_TIMEOUT);
+		csp_rdp_tx_store(conn, packet, seq_nr);
+		csp_mutex_unlock(&conn->rdp.lock);
 	}
 
 	/* Send control messages with high priority */
@@ -223,6 +461,15 @@ static int csp_rdp_send_cmp(csp_conn_t * conn, csp_packet_t * packet, int flags,
 
 }
 
+/**
+ * OUT-OF-ORDER RX BUFFER
+ * Segments received out of sequence are stored in a ring indexed by their
+ * distance to rcv_cur, so insert, duplicate check and in-order delivery are O(1).
+ */
+static inline bool csp_rdp_rx_slot_used(const csp_conn_t * conn, unsigned int slot) {
+	return (conn->rdp.rx_map[slot / 32] & (1UL << (slot % 32))) != 0;
+}
+
 /**
  * EXTENDED ACKNOWLEDGEMENTS
  * The following function sends an extended ACK packet
@@ -230,31 +477,36 @@ static int csp_rdp_send_cmp(csp_conn_t * conn, csp_packet_t * packet, int flags,
 static int csp_rdp_send_eack(csp_conn_t * conn) {
 
 	/* Allocate message */
-	csp_packet_t * packet_eack = csp_buffer_get(100);
+	size_t size = sizeof(rdp_header_t) + (conn->rdp.rx_count * sizeof(uint16_t));
+	if (size > csp_buffer_data_size()) {
+		size = csp_buffer_data_size();
+	}
+	csp_packet_t * packet_eack = csp_buffer_get(size);
 	if (packet_eack == NULL) return CSP_ERR_NOMEM;
 	packet_eack->length = 0;
 
-	/* Loop through RX queue */
-	int i, count;
-	csp_packet_t * packet;
-	count = csp_queue_size(conn->rdp.rx_queue);
-	for (i = 0; i < count; i++) {
+	/* Add seq nr of segments in the RX buffer, leaving room for the RDP header */
+	csp_mutex_lock(&conn->rdp.lock, CSP_MAX_TIMEOUT);
+	unsigned int found = 0;
+	for (unsigned int offset = 0; (offset < conn->rdp.rx_size) && (found < conn->rdp.rx_count); offset++) {
 
-		if (csp_queue_dequeue_isr(conn->rdp.rx_queue, &packet, &pdTrue) != CSP_QUEUE_OK) {
-			csp_log_error("RDP %p: Cannot dequeue from rx_queue in queue deliver", conn);
-			break;
+		const unsigned int slot = (conn->rdp.rx_head + offset) % conn->rdp.rx_size;
+		if (!csp_rdp_rx_slot_used(conn, slot)) {
+			continue;
 		}
+		found++;
 
-		/* Add seq nr to EACK packet */
-		rdp_header_t * header = csp_rdp_header_ref(packet);
-		packet_eack->data16[packet_eack->length/sizeof(uint16_t)] = csp_hton16(header->seq_nr);
-		packet_eack->length += sizeof(uint16_t);
-		csp_log_protocol("RDP %p: Added EACK nr %u", conn, header->seq_nr);
+		if (csp_buffer_tailroom(packet_eack) < (sizeof(rdp_header_t) + sizeof(uint16_t))) {
+			break;
+		}
 
-		/* Requeue */
-		csp_queue_enqueue_isr(conn->rdp.rx_queue, &packet, &pdTrue);
+		const uint16_t seq_nr = conn->rdp.rcv_cur + 1 + offset;
+		uint16_t * eack = csp_buffer_put(packet_eack, sizeof(uint16_t));
+		*eack = csp_hton16(seq_nr);
+		csp_log_protocol("RDP %p: Added EACK nr %u", conn, seq_nr);
 
 	}
+	csp_mutex_unlock(&conn->rdp.lock);
 
 	return csp_rdp_send_cmp(conn, packet_eack, RDP_ACK | RDP_EAK, conn->rdp.snd_nxt, conn->rdp.rcv_cur);
 
@@ -272,12 +524,12 @@ static int csp_rdp_send_syn(csp_conn_t * conn) {
 	if (packet == NULL) return CSP_ERR_NOMEM;
 
 	/* Generate contents */
-	packet->data32[0] = csp_hton32(csp_rdp_window_size);
-	packet->data32[1] = csp_hton32(csp_rdp_conn_timeout);
-	packet->data32[2] = csp_hton32(csp_rdp_packet_timeout);
-	packet->data32[3] = csp_hton32(csp_rdp_delayed_acks);
-	packet->data32[4] = csp_hton32(csp_rdp_ack_timeout);
-	packet->data32[5] = csp_hton32(csp_rdp_ack_delay_count);
+	packet->data32[0] = csp_hton32(conn->rdp.window_size);
+	packet->data32[1] = csp_hton32(conn->rdp.conn_timeout);
+	packet->data32[2] = csp_hton32(conn->rdp.packet_timeout);
+	packet->data32[3] = csp_hton32(conn->rdp.delayed_acks);
+	packet->data32[4] = csp_hton32(conn->rdp.ack_timeout);
+	packet->data32[5] = csp_hton32(conn->rdp.ack_delay_count);
 	packet->length = 6 * sizeof(uint32_t);
 
 	return csp_rdp_send_cmp(conn, packet, RDP_SYN, conn->rdp.snd_iss, 0);
@@ -299,122 +551,112 @@ static inline int csp_rdp_receive_data(csp_conn_t * conn, csp_packet_t * packet)
 
 }
 
-static inline void csp_rdp_rx_queue_flush(csp_conn_t * conn) {
+/* Advance rcv_cur by one, moving the head of the RX buffer along - call with conn->rdp.lock held */
+static inline void csp_rdp_rx_advance(csp_conn_t * conn) {
 
-	/* Loop through RX queue */
-	int i, count;
-	csp_packet_t * packet;
+	conn->rdp.rcv_cur++;
+	conn->rdp.rx_head = (conn->rdp.rx_head + 1) % conn->rdp.rx_size;
 
-front:
-	count = csp_queue_size(conn->rdp.rx_queue);
-	for (i = 0; i < count; i++) {
+}
 
-		if (csp_queue_dequeue_isr(conn->rdp.rx_queue, &packet, &pdTrue) != CSP_QUEUE_OK) {
-			csp_log_error("RDP %p: Cannot dequeue from rx_queue in queue deliver", conn);
-			break;
-		}
+/* Deliver segments from the RX buffer, which are now in sequence */
+static inline void csp_rdp_rx_queue_flush(csp_conn_t * conn) {
 
-		rdp_header_t * header = csp_rdp_header_ref(packet);
-		csp_log_protocol("RDP %p: RX Queue deliver matching Element, seq %u", conn, header->seq_nr);
+	csp_mutex_lock(&conn->rdp.lock, CSP_MAX_TIMEOUT);
 
-		/* If the matching packet was found: */
-		if (header->seq_nr == (uint16_t)(conn->rdp.rcv_cur + 1)) {
-			csp_log_protocol("RDP %p: Deliver seq %u", conn, header->seq_nr);
-			csp_rdp_receive_data(conn, packet);
-			conn->rdp.rcv_cur++;
-			/* Loop from first element again */
-			goto front;
+	while (conn->rdp.rx_count && csp_rdp_rx_slot_used(conn, conn->rdp.rx_head)) {
 
-		/* Otherwise, requeue */
-		} else {
-			csp_queue_enqueue_isr(conn->rdp.rx_queue, &packet, &pdTrue);
-		}
+		const unsigned int slot = conn->rdp.rx_head;
+		csp_packet_t * packet = conn->rdp.rx_slot[slot];
+		conn->rdp.rx_slot[slot] = NULL;
+		conn->rdp.rx_map[slot / 32] &= ~(1UL << (slot % 32));
+		conn->rdp.rx_count--;
 
-	}
+		csp_log_protocol("RDP %p: Deliver seq %u", conn, (uint16_t)(conn->rdp.rcv_cur + 1));
+		csp_rdp_receive_data(conn, packet);
+		csp_rdp_rx_advance(conn);
 
-}
+	}
 
-static inline bool csp_rdp_seq_in_rx_queue(csp_conn_t * conn, uint16_t seq_nr) {
+	csp_mutex_unlock(&conn->rdp.lock);
 
-	/* Loop through RX queue */
-	int i, count;
-	rdp_packet_t * packet;
-	count = csp_queue_size(conn->rdp.rx_queue);
-	for (i = 0; i < count; i++) {
+}
 
-		if (csp_queue_dequeue_isr(conn->rdp.rx_queue, &packet, &pdTrue) != CSP_QUEUE_OK) {
-			csp_log_error("RDP %p: Cannot dequeue from rx_queue in queue exists", conn);
-			break;
-		}
+/* Store an out-of-sequence segment in the RX buffer, fails if already stored or outside the buffer */
+static inline int csp_rdp_rx_queue_add(csp_conn_t * conn, csp_packet_t * packet, uint16_t seq_nr) {
 
-		csp_queue_enqueue_isr(conn->rdp.rx_queue, &packet, &pdTrue);
+	int ret = CSP_QUEUE_ERROR;
 
-		rdp_header_t * header = csp_rdp_header_ref((csp_packet_t *) packet);
-		csp_log_protocol("RDP %p: RX Queue exists matching Element, seq %u", conn, header->seq_nr);
+	csp_mutex_lock(&conn->rdp.lock, CSP_MAX_TIMEOUT);
 
-		/* If the matching packet was found, deliver */
-		if (header->seq_nr == seq_nr) {
-                    csp_log_protocol("RDP %p: We have a match", conn);
-			return true;
+	const uint16_t offset = seq_nr - conn->rdp.rcv_cur - 1;
+	if (offset < conn->rdp.rx_size) {
+		const unsigned int slot = (conn->rdp.rx_head + offset) % conn->rdp.rx_size;
+		if (!csp_rdp_rx_slot_used(conn, slot)) {
+			csp_buffer_set_owner(packet, CSP_BUFFER_OWNER_RDP_RX);
+			conn->rdp.rx_slot[slot] = packet;
+			conn->rdp.rx_map[slot / 32] |= (1UL << (slot % 32));
+			conn->rdp.rx_count++;
+			ret = CSP_QUEUE_OK;
 		}
-
 	}
 
-	return false;
-
-}
-
-static inline int csp_rdp_rx_queue_add(csp_conn_t * conn, csp_packet_t * packet, uint16_t seq_nr) {
+	csp_mutex_unlock(&conn->rdp.lock);
 
-	if (csp_rdp_seq_in_rx_queue(conn, seq_nr))
-		return CSP_QUEUE_ERROR;
-	return csp_queue_enqueue_isr(conn->rdp.rx_queue, &packet, &pdTrue);
+	return ret;
 
 }
 
 static void csp_rdp_flush_eack(csp_conn_t * conn, csp_packet_t * eack_packet) {
 
-	/* Loop through TX queue */
-	int i, j, count;
-	rdp_packet_t * packet;
-	count = csp_queue_size(conn->rdp.tx_queue);
-	for (i = 0; i < count; i++) {
+	const unsigned int count = (eack_packet->length - sizeof(rdp_header_t)) / sizeof(uint16_t);
+	const uint32_t time_now = csp_get_ms();
 
-		if (csp_queue_dequeue(conn->rdp.tx_queue, &packet, 0) != CSP_QUEUE_OK) {
-			csp_log_error("RDP %p: Cannot dequeue from tx_queue in flush EACK", conn);
-			break;
-		}
+	csp_mutex_lock(&conn->rdp.lock, CSP_MAX_TIMEOUT);
 
-		rdp_header_t * header = csp_rdp_header_ref((csp_packet_t *) packet);
-		csp_log_protocol("RDP %p: EACK compare element, time %"PRIu32", seq %u", conn, packet->timestamp, csp_ntoh16(header->seq_nr));
-
-		/* Look for this element in EACKs */
-		int match = 0;
-		for (j = 0; j < (int)((eack_packet->length - sizeof(rdp_header_t)) / sizeof(uint16_t)); j++) {
-			if (csp_ntoh16(eack_packet->data16[j]) == csp_ntoh16(header->seq_nr))
-				match = 1;
-
-			/* Enable this if you want EACK's to trigger retransmission */
-			if (csp_ntoh16(eack_packet->data16[j]) > csp_ntoh16(header->seq_nr)) {
-				uint32_t time_now = csp_get_ms();
-				if (csp_rdp_time_after(time_now, packet->quarantine)) {
-					packet->timestamp = time_now - conn->rdp.packet_timeout - 1;
-					packet->quarantine = time_now +	conn->rdp.packet_timeout / 2;
-				}
-			}
+	/* Free segments acknowledged by EACK, and find the highest one */
+	const uint16_t outstanding = csp_rdp_tx_outstanding(conn);
+	uint16_t highest = 0;
+	for (unsigned int i = 0; i < count; i++) {
+		const uint16_t seq_nr = csp_ntoh16(eack_packet->data16[i]);
+		const uint16_t offset = seq_nr - conn->rdp.snd_una;
+		if (offset >= outstanding) {
+			continue;
 		}
+		csp_rdp_tx_slot_t * slot = csp_rdp_tx_slot(conn, offset);
+		if (slot->packet) {
+			csp_log_protocol("RDP %p: TX Element %u freed", conn, seq_nr);
+			csp_buffer_free(slot->packet);
+			slot->packet = NULL;
+		}
+		if (offset >= highest) {
+			highest = offset + 1;
+		}
+	}
 
-		if (match == 0) {
-			/* If not found, put back on tx queue */
-			csp_queue_enqueue(conn->rdp.tx_queue, &packet, 0);
-		} else {
-			/* Found, free */
-			csp_log_protocol("RDP %p: TX Element %u freed", conn, csp_ntoh16(header->seq_nr));
-			csp_buffer_free(packet);
+	/* Segments before an EACK'ed segment are (probably) lost, retransmit from csp_rdp_check_timeouts() */
+	bool lost = false;
+	for (uint16_t offset = 0; offset < highest; offset++) {
+		csp_rdp_tx_slot_t * slot = csp_rdp_tx_slot(conn, offset);
+		if (slot->packet && csp_rdp_time_after(time_now, slot->quarantine)) {
+			slot->quarantine = time_now + conn->rdp.rto / 2;
+			slot->fast_retransmit = true;
+			lost = true;
 		}
+	}
+
+	/* Reduce window once per window of data */
+	if (lost && !conn->rdp.recovery) {
+		csp_rdp_cc_loss(conn, outstanding, false);
+	}
 
+	/* Retransmit now */
+	if (lost) {
+		csp_rdp_timer_start(conn, time_now);
 	}
 
+	csp_mutex_unlock(&conn->rdp.lock);
+
 }
 
 static inline bool csp_rdp_should_ack(csp_conn_t * conn) {
@@ -439,29 +681,36 @@ static inline bool csp_rdp_should_ack(csp_conn_t * conn) {
 
 void csp_rdp_flush_all(csp_conn_t * conn) {
 
-	if ((conn == NULL) || conn->rdp.tx_queue == NULL) {
+	if ((conn == NULL) || conn->rdp.tx_slot == NULL) {
 		csp_log_error("RDP %p: Null pointer passed to rdp flush all", conn);
 		return;
 	}
 
-	rdp_packet_t * packet;
+	csp_mutex_lock(&conn->rdp.lock, CSP_MAX_TIMEOUT);
 
-	/* Empty TX queue */
-	while (csp_queue_dequeue_isr(conn->rdp.tx_queue, &packet, &pdTrue) == CSP_QUEUE_OK) {
-		if (packet != NULL) {
-			csp_log_protocol("RDP %p: Flush TX Element, time %"PRIu32", seq %u", conn, packet->timestamp, csp_ntoh16(csp_rdp_header_ref((csp_packet_t *) packet)->seq_nr));
-			csp_buffer_free(packet);
+	/* Empty TX buffer */
+	for (unsigned int i = 0; i < conn->rdp.tx_size; i++) {
+		csp_rdp_tx_slot_t * slot = &conn->rdp.tx_slot[i];
+		if (slot->packet) {
+			csp_log_protocol("RDP %p: Flush TX Element, time %"PRIu32", seq %u", conn, slot->timestamp, csp_ntoh16(csp_rdp_header_ref(slot->packet)->seq_nr));
+			csp_buffer_free(slot->packet);
+			slot->packet = NULL;
 		}
 	}
 
-	/* Empty RX queue */
-	while (csp_queue_dequeue_isr(conn->rdp.rx_queue, &packet, &pdTrue) == CSP_QUEUE_OK) {
-		if (packet != NULL) {
-			csp_log_protocol("RDP %p: Flush RX Element, time %"PRIu32", seq %u", conn, packet->timestamp, csp_ntoh16(csp_rdp_header_ref((csp_packet_t *) packet)->seq_nr));
-			csp_buffer_free(packet);
+	/* Empty RX buffer */
+	for (unsigned int slot = 0; (slot < conn->rdp.rx_size) && conn->rdp.rx_count; slot++) {
+		if (csp_rdp_rx_slot_used(conn, slot)) {
+			csp_log_protocol("RDP %p: Flush RX Element, seq %u", conn, csp_rdp_header_ref(conn->rdp.rx_slot[slot])->seq_nr);
+			csp_buffer_free(conn->rdp.rx_slot[slot]);
+			conn->rdp.rx_slot[slot] = NULL;
+			conn->rdp.rx_map[slot / 32] &= ~(1UL << (slot % 32));
+			conn->rdp.rx_count--;
 		}
 	}
 
+	csp_mutex_unlock(&conn->rdp.lock);
+
 }
 
 
@@ -479,6 +728,8 @@ int csp_rdp_check_ack(csp_conn_t * conn) {
 	/* If more space available, only send after ack timeout or immediately if delay_acks is zero */
 	if (avail && csp_rdp_should_ack(conn)) {
 		csp_rdp_send_cmp(conn, NULL, RDP_ACK, conn->rdp.snd_nxt, conn->rdp.rcv_cur);
+	} else if (avail) {
+		csp_rdp_timer_start(conn, conn->rdp.ack_timestamp + conn->rdp.ack_timeout);
 	}
 
 	return CSP_ERR_NONE;
@@ -487,18 +738,86 @@ int csp_rdp_check_ack(csp_conn_t * conn) {
 
 static inline bool csp_rdp_is_conn_ready_for_tx(csp_conn_t * conn)
 {
-	// Check Tx window (messages waiting for acks)
-	if (csp_rdp_seq_after(conn->rdp.snd_nxt, conn->rdp.snd_una + conn->rdp.window_size - 1)) {
+	// Check Tx window (messages waiting for acks), limited by the size of the retransmit buffer and congestion window
+	uint16_t window = csp_rdp_window_max(conn);
+	if (csp_conf.rdp_congestion_control && (conn->rdp.cwnd < window)) {
+		window = conn->rdp.cwnd;
+	}
+	if (csp_rdp_seq_after(conn->rdp.snd_nxt, conn->rdp.snd_una + window - 1)) {
 		return false;
 	}
 	return true;
 }
 
+/* Keep the first of a number of timeouts */
+static inline void csp_rdp_timeout_first(bool * pending, uint32_t * first, uint32_t timeout) {
+	if (!*pending || csp_rdp_time_before(timeout, *first)) {
+		*first = timeout;
+		*pending = true;
+	}
+}
+
+/* Set the connection timer to the first pending timeout */
+static void csp_rdp_timer_schedule(csp_conn_t * conn) {
+
+	const uint32_t time_now = csp_get_ms();
+	bool pending = false;
+	uint32_t first = 0;
+
+	/* Connection timeout (not accepted yet) */
+	if (conn->socket != NULL) {
+		csp_rdp_timeout_first(&pending, &first, conn->timestamp + conn->rdp.conn_timeout);
+	}
+
+	if (conn->rdp.state == RDP_CLOSE_WAIT) {
+		/* Close-wait timeout, only once */
+		if ((conn->rdp.closed_by & CSP_RDP_CLOSED_BY_TIMEOUT) == 0) {
+			csp_rdp_timeout_first(&pending, &first, conn->timestamp + conn->rdp.conn_timeout);
+		}
+	} else {
+		/* Retransmission timeouts of the segments within the congestion window, see csp_rdp_check_timeouts() */
+		csp_mutex_lock(&conn->rdp.lock, CSP_MAX_TIMEOUT);
+		uint16_t unacked = 0;
+		const uint16_t outstanding = csp_rdp_tx_outstanding(conn);
+		for (uint16_t offset = 0; offset < outstanding; offset++) {
+			const csp_rdp_tx_slot_t * slot = csp_rdp_tx_slot(conn, offset);
+			if (slot->packet == NULL) {
+				continue;
+			}
+			if (csp_conf.rdp_congestion_control && (unacked >= conn->rdp.cwnd)) {
+				break;
+			}
+			unacked++;
+			csp_rdp_timeout_first(&pending, &first, slot->fast_retransmit ? time_now : (slot->timestamp + conn->rdp.rto));
+		}
+		csp_mutex_unlock(&conn->rdp.lock);
+
+		/* Delayed ACK of received segments */
+		if ((conn->rdp.state == RDP_OPEN) && conn->rdp.delayed_acks && (conn->rdp.rcv_cur != conn->rdp.rcv_lsa)) {
+			uint32_t timeout = conn->rdp.ack_timestamp + conn->rdp.ack_timeout;
+			/* Not sent because the RX queue is full - sent by csp_read(), retry later */
+			if (csp_rdp_time_after(time_now, timeout)) {
+				timeout = time_now + conn->rdp.ack_timeout;
+			}
+			csp_rdp_timeout_first(&pending, &first, timeout);
+		}
+	}
+
+	if (pending) {
+		/* Timeouts that could not be handled yet (e.g. segment still being sent), are retried later - not in a loop */
+		if (!csp_rdp_time_after(first, time_now)) {
+			first = time_now + CSP_RDP_RTO_MIN_MS;
+		}
+		csp_rdp_timer_start(conn, first);
+	}
+
+}
+
 /**
- * This function must be called with regular intervals for the
- * RDP protocol to work as expected. This takes care of closing
- * stale connections and retransmitting traffic. A good place to
- * call this function is from the CSP router task.
+ * Handle the timeouts of a connection: closing stale connections, retransmitting
+ * segments and sending delayed ACKs. Called from the CSP router task, when the
+ * connection timer expires (see csp_conn_check_timeouts()), and sets the timer
+ * to the next timeout.
  */
 void csp_rdp_check_timeouts(csp_conn_t * conn) {
 
@@ -524,6 +843,8 @@ void csp_rdp_check_timeouts(csp_conn_t * conn) {
 	if (conn->rdp.state == RDP_CLOSE_WAIT) {
 		if (csp_rdp_time_after(time_now, conn->timestamp + conn->rdp.conn_timeout)) {
 			csp_conn_close(conn, CSP_RDP_CLOSED_BY_PROTOCOL | CSP_RDP_CLOSED_BY_TIMEOUT);
+		} else {
+			csp_rdp_timer_schedule(conn);
 		}
 		return;
 	}
@@ -532,35 +853,52 @@ void csp_rdp_check_timeouts(csp_conn_t * conn) {
 	 * MESSAGE TIMEOUT:
 	 * Check each outgoing message for TX timeout
 	 */
-	int count = csp_queue_size(conn->rdp.tx_queue);
-	for (int i = 0; i < count; i++) {
+	csp_mutex_lock(&conn->rdp.lock, CSP_MAX_TIMEOUT);
+	const uint32_t rto = conn->rdp.rto;
+	bool oldest = true;
+	bool timed_out = false;
+	uint16_t unacked = 0;
+	const uint16_t outstanding = csp_rdp_tx_outstanding(conn);
+	for (uint16_t offset = 0; offset < outstanding; offset++) {
+
+		/* Skip segments acknowledged by EACK */
+		csp_rdp_tx_slot_t * slot = csp_rdp_tx_slot(conn, offset);
+		if (slot->packet == NULL) {
+			continue;
+		}
+		const bool first = oldest;
+		oldest = false;
 
-		rdp_packet_t * packet;
-		if ((csp_queue_dequeue_isr(conn->rdp.tx_queue, &packet, &pdTrue) != CSP_QUEUE_OK) || packet == NULL) {
-			csp_log_warn("RDP %p: Cannot dequeue from tx_queue in check timeout", conn);
+		/* Only retransmit within the congestion window */
+		if (csp_conf.rdp_congestion_control && (unacked >= conn->rdp.cwnd)) {
 			break;
 		}
+		unacked++;
 
-		/* Get header */
-		rdp_header_t * header = csp_rdp_header_ref((csp_packet_t *) packet);
+		/* Check timestamp and retransmit if needed (not while the initial send still holds a reference) */
+		if ((slot->fast_retransmit || csp_rdp_time_after(time_now, slot->timestamp + rto)) && !csp_buffer_is_shared(slot->packet)) {
 
-		/* If acked, do not retransmit */
-		if (csp_rdp_seq_before(csp_ntoh16(header->seq_nr), conn->rdp.snd_una)) {
-			csp_log_protocol("RDP %p: TX Element Free, time %"PRIu32", seq %u, una %u", conn, packet->timestamp, csp_ntoh16(header->seq_nr), conn->rdp.snd_una);
-			csp_buffer_free(packet);
-			continue;
-		}
-
-		/* Check timestamp and retransmit if needed */
-		if (csp_rdp_time_after(time_now, packet->timestamp + conn->rdp.packet_timeout)) {
+			/* Get header */
+			rdp_header_t * header = csp_rdp_header_ref(slot->packet);
 			csp_log_protocol("RDP %p: TX Element timed out, retransmitting seq %u", conn, csp_ntoh16(header->seq_nr));
 
 			/* Update to latest outgoing ACK */
 			header->ack_nr = csp_hton16(conn->rdp.rcv_cur);
 
-			/* Send copy to tx_queue */
-			packet->timestamp = csp_get_ms();
-			csp_packet_t * new_packet = csp_buffer_clone(packet);
+			/* Back off when the oldest segment times out (not if retransmitted because of an EACK) */
+			if (first && !slot->fast_retransmit) {
+				timed_out = true;
+				csp_rdp_cc_loss(conn, outstanding, true);
+			}
+			slot->fast_retransmit = false;
+			conn->rdp.retransmits++;
+			if (slot->retransmits < UINT8_MAX) {
+				slot->retransmits++;
+			}
+
+			/* Send shared reference, the retransmit buffer keeps the packet */
+			slot->timestamp = csp_get_ms();
+			csp_packet_t * new_packet = csp_buffer_ref(slot->packet);
 			if (csp_send_direct(conn->idout, new_packet, csp_rtable_find_route(conn->idout.dst), 0) != CSP_ERR_NONE) {
 				csp_log_warn("RDP %p: Retransmission failed", conn);
 				csp_buffer_free(new_packet);
@@ -568,10 +906,11 @@ void csp_rdp_check_timeouts(csp_conn_t * conn) {
 
 		}
 
-		/* Requeue the TX element */
-		csp_queue_enqueue_isr(conn->rdp.tx_queue, &packet, &pdTrue);
-
 	}
+	if (timed_out) {
+		csp_rdp_rto_backoff(conn);
+	}
+	csp_mutex_unlock(&conn->rdp.lock);
 
 	if (conn->rdp.state == RDP_OPEN) {
 
@@ -584,8 +923,11 @@ void csp_rdp_check_timeouts(csp_conn_t * conn) {
 		if (csp_rdp_is_conn_ready_for_tx(conn)) {
 			csp_log_protocol("RDP %p: Wake Tx task (check timeouts)", conn);
 			csp_bin_sem_post(&conn->rdp.tx_wait);
+			csp_poll_signal(conn);
 		}
 	}
+
+	csp_rdp_timer_schedule(conn);
 }
 
 bool csp_rdp_new_packet(csp_conn_t * conn, csp_packet_t * packet) {
@@ -610,7 +952,7 @@ bool csp_rdp_new_packet(csp_conn_t * conn, csp_packet_t * packet) {
 
 		if (rx_header->ack) {
 			/* Store current ack'ed sequence number */
-			conn->rdp.snd_una = rx_header->ack_nr + 1;
+			csp_rdp_tx_ack(conn, rx_header->ack_nr);
 		}
 
 		if (conn->rdp.state == RDP_CLOSED) {
@@ -677,6 +1019,14 @@ bool csp_rdp_new_packet(csp_conn_t * conn, csp_packet_t * packet) {
 		conn->rdp.delayed_acks 		= csp_ntoh32(packet->data32[3]);
 		conn->rdp.ack_timeout 		= csp_ntoh32(packet->data32[4]);
 		conn->rdp.ack_delay_count 	= csp_ntoh32(packet->data32[5]);
+
+		/* Timeouts are local, so the server side may use its own (the rest must match the client) */
+		if (conn->listener && conn->listener->rdp.socket_opt) {
+			conn->rdp.conn_timeout = conn->listener->rdp.conn_timeout;
+			conn->rdp.packet_timeout = conn->listener->rdp.packet_timeout;
+		}
+		csp_rdp_rto_reset(conn);
+		csp_rdp_cc_reset(conn);
 		csp_log_protocol("RDP %p: window size %"PRIu32", conn timeout %"PRIu32", packet timeout %"PRIu32", delayed acks: %"PRIu32", ack timeout %"PRIu32", ack each %"PRIu32" packet",
 				conn, conn->rdp.window_size, conn->rdp.conn_timeout, conn->rdp.packet_timeout,
 				conn->rdp.delayed_acks, conn->rdp.ack_timeout, conn->rdp.ack_delay_count);
@@ -703,7 +1053,7 @@ bool csp_rdp_new_packet(csp_conn_t * conn, csp_packet_t * packet) {
 			conn->rdp.rcv_cur = rx_header->seq_nr;
 			conn->rdp.rcv_irs = rx_header->seq_nr;
 			conn->rdp.rcv_lsa = rx_header->seq_nr - 1;
-			conn->rdp.snd_una = rx_header->ack_nr + 1;
+			csp_rdp_tx_ack(conn, rx_header->ack_nr);
 			conn->rdp.ack_timestamp = csp_get_ms();
 			conn->rdp.state = RDP_OPEN;
 
@@ -715,6 +1065,7 @@ bool csp_rdp_new_packet(csp_conn_t * conn, csp_packet_t * packet) {
 			/* Wake TX task */
 			csp_log_protocol("RDP %p: Wake Tx task (ack)", conn);
 			csp_bin_sem_post(&conn->rdp.tx_wait);
+			csp_poll_signal(conn);
 
 			goto discard_open;
 		}
@@ -799,6 +1150,7 @@ bool csp_rdp_new_packet(csp_conn_t * conn, csp_packet_t * packet) {
 					csp_log_error("RDP %p: ERROR socket cannot accept more connections", conn);
 					goto discard_close;
 				}
+				csp_poll_signal(conn->listener);
 
 				/* Ensure that this connection will not be posted to this socket again
 				 * and remember that the connection handle has been passed to userspace
@@ -808,8 +1160,14 @@ bool csp_rdp_new_packet(csp_conn_t * conn, csp_packet_t * packet) {
 
 		}
 
-		/* Store current ack'ed sequence number */
-		conn->rdp.snd_una = rx_header->ack_nr + 1;
+		/* Store current ack'ed sequence number and free acknowledged segments */
+		csp_rdp_tx_ack(conn, rx_header->ack_nr);
+
+		/* Wake user task if additional Tx can be done */
+		if (csp_rdp_is_conn_ready_for_tx(conn)) {
+			csp_bin_sem_post(&conn->rdp.tx_wait);
+			csp_poll_signal(conn);
+		}
 
 		/* We have an EACK */
 		if (rx_header->eak) {
@@ -833,15 +1191,14 @@ bool csp_rdp_new_packet(csp_conn_t * conn, csp_packet_t * packet) {
 			goto accepted_open;
 		}
 
-		/* Store sequence number before stripping RDP header */
-		uint16_t seq_nr = rx_header->seq_nr;
-
 		/* Receive data */
 		if (csp_rdp_receive_data(conn, packet) != CSP_ERR_NONE)
 			goto discard_open;
 
 		/* Update last received packet */
-		conn->rdp.rcv_cur = seq_nr;
+		csp_mutex_lock(&conn->rdp.lock, CSP_MAX_TIMEOUT);
+		csp_rdp_rx_advance(conn);
+		csp_mutex_unlock(&conn->rdp.lock);
 
 		/* Only ACK the message if there is room for a full window in the RX buffer.
 		 * Unacknowledged segments are ACKed by csp_rdp_check_timeouts when the buffer is
@@ -872,7 +1229,7 @@ bool csp_rdp_new_packet(csp_conn_t * conn, csp_packet_t * packet) {
 		}
 
 		/* Store current ack'ed sequence number */
-		conn->rdp.snd_una = rx_header->ack_nr + 1;
+		csp_rdp_tx_ack(conn, rx_header->ack_nr);
 
 		/* Send back a reset */
 		csp_rdp_send_cmp(conn, NULL, RDP_ACK | RDP_RST, conn->rdp.snd_nxt, conn->rdp.rcv_cur);
@@ -902,17 +1259,25 @@ accepted_open:
 
 }
 
-int csp_rdp_connect(csp_conn_t * conn) {
+int csp_rdp_connect(csp_conn_t * conn, const csp_rdp_opt_t * opt) {
 
 	int retry = 1;
 
-	conn->rdp.window_size     = csp_rdp_window_size;
-	conn->rdp.conn_timeout    = csp_rdp_conn_timeout;
-	conn->rdp.packet_timeout  = csp_rdp_packet_timeout;
-	conn->rdp.delayed_acks    = csp_rdp_delayed_acks;
-	conn->rdp.ack_timeout     = csp_rdp_ack_timeout;
-	conn->rdp.ack_delay_count = csp_rdp_ack_delay_count;
+	csp_rdp_opt_t dfl_opt;
+	if (opt == NULL) {
+		csp_rdp_get_default_opt(&dfl_opt);
+		opt = &dfl_opt;
+	}
+
+	conn->rdp.window_size     = opt->window_size;
+	conn->rdp.conn_timeout    = opt->conn_timeout_ms;
+	conn->rdp.packet_timeout  = opt->packet_timeout_ms;
+	conn->rdp.delayed_acks    = opt->delayed_acks;
+	conn->rdp.ack_timeout     = opt->ack_timeout;
+	conn->rdp.ack_delay_count = opt->ack_delay_count;
 	conn->rdp.ack_timestamp   = csp_get_ms();
+	csp_rdp_rto_reset(conn);
+	csp_rdp_cc_reset(conn);
 
 retry:
 	csp_log_protocol("RDP %p: Active connect, conn state %u", conn, conn->rdp.state);
@@ -965,6 +1330,12 @@ error:
 
 }
 
+bool csp_rdp_is_writable(csp_conn_t * conn) {
+
+	return (conn->rdp.state == RDP_OPEN) && csp_rdp_is_conn_ready_for_tx(conn);
+
+}
+
 int csp_rdp_send(csp_conn_t * conn, csp_packet_t * packet) {
 
 	if (conn->rdp.state != RDP_OPEN) {
@@ -995,19 +1366,17 @@ int csp_rdp_send(csp_conn_t * conn, csp_packet_t * packet) {
 	tx_header->seq_nr = csp_hton16(conn->rdp.snd_nxt);
 	tx_header->ack = 1;
 
-	/* Send copy to tx_queue */
-	rdp_packet_t * rdp_packet = csp_buffer_clone(packet);
-	if (rdp_packet == NULL) {
-		csp_log_error("RDP %p: Failed to allocate packet buffer", conn);
-		return CSP_ERR_NOMEM;
+	/* Store in retransmit buffer */
+	csp_mutex_lock(&conn->rdp.lock, CSP_MAX_TIMEOUT);
+	int ret = csp_rdp_tx_store(conn, packet, conn->rdp.snd_nxt);
+	if (ret == CSP_ERR_NONE) {
+		conn->rdp.snd_nxt++;
 	}
-
-	rdp_packet->timestamp = csp_get_ms();
-	rdp_packet->quarantine = 0;
-	if (csp_queue_enqueue(conn->rdp.tx_queue, &rdp_packet, 0) != CSP_QUEUE_OK) {
+	csp_mutex_unlock(&conn->rdp.lock);
+	if (ret != CSP_ERR_NONE) {
 		csp_log_error("RDP %p: No more space in RDP retransmit queue", conn);
-		csp_buffer_free(rdp_packet);
-		return CSP_ERR_NOBUFS;
+		csp_buffer_trim(packet, sizeof(rdp_header_t));
+		return ret;
 	}
 
 	csp_log_protocol("RDP %p: Sending  in S %u: syn %u, ack %u, eack %u, "
@@ -1016,19 +1385,20 @@ int csp_rdp_send(csp_conn_t * conn, csp_packet_t * packet) {
 				tx_header->rst, csp_ntoh16(tx_header->seq_nr), csp_ntoh16(tx_header->ack_nr),
 				packet->length, (unsigned int)(packet->length - sizeof(rdp_header_t)));
 
-	conn->rdp.snd_nxt++;
 	return CSP_ERR_NONE;
 
 }
 
 int csp_rdp_init(csp_conn_t * conn) {
 
-	csp_log_protocol("RDP %p: Creating RDP queues", conn);
+	csp_log_protocol("RDP %p: Creating RDP buffers", conn);
 
 	/* Set initial state */
 	conn->rdp.state = RDP_CLOSED;
 	conn->rdp.conn_timeout = csp_rdp_conn_timeout;
 	conn->rdp.packet_timeout = csp_rdp_packet_timeout;
+	csp_rdp_rto_reset(conn);
+	csp_rdp_cc_reset(conn);
 
 	/* Create a binary semaphore to wait on for tasks */
 	if (csp_bin_sem_create(&conn->rdp.tx_wait) != CSP_SEMAPHORE_OK) {
@@ -1036,23 +1406,25 @@ int csp_rdp_init(csp_conn_t * conn) {
 		return CSP_ERR_NOMEM;
 	}
 
-	/* Create TX queue */
-	conn->rdp.tx_queue = csp_queue_create(csp_conf.rdp_max_window, sizeof(csp_packet_t *));
-	if (conn->rdp.tx_queue == NULL) {
-		csp_log_error("RDP %p: Failed to create TX queue for conn", conn);
+	/* Create TX and RX buffers */
+	conn->rdp.tx_size = csp_conf.rdp_max_window;
+	conn->rdp.tx_head = 0;
+	conn->rdp.tx_slot = csp_calloc(conn->rdp.tx_size, sizeof(*conn->rdp.tx_slot));
+	conn->rdp.rx_size = csp_conf.rdp_max_window * 2;
+	conn->rdp.rx_head = 0;
+	conn->rdp.rx_count = 0;
+	conn->rdp.rx_slot = csp_calloc(conn->rdp.rx_size, sizeof(*conn->rdp.rx_slot));
+	conn->rdp.rx_map = csp_calloc((conn->rdp.rx_size + 31) / 32, sizeof(*conn->rdp.rx_map));
+	if ((conn->rdp.tx_slot == NULL) || (conn->rdp.rx_slot == NULL) || (conn->rdp.rx_map == NULL) || (csp_mutex_create(&conn->rdp.lock) != CSP_MUTEX_OK)) {
+		csp_log_error("RDP %p: Failed to create TX/RX buffers for conn", conn);
+		csp_free(conn->rdp.tx_slot);
+		csp_free(conn->rdp.rx_slot);
+		csp_free(conn->rdp.rx_map);
+		conn->rdp.tx_slot = NULL;
 		csp_bin_sem_remove(&conn->rdp.tx_wait);
 		return CSP_ERR_NOMEM;
 	}
 
-	/* Create RX queue */
-	conn->rdp.rx_queue = csp_queue_create(csp_conf.rdp_max_window * 2, sizeof(csp_packet_t *));
-	if (conn->rdp.rx_queue == NULL) {
-		csp_log_error("RDP %p: Failed to create RX queue for conn", conn);
-		csp_bin_sem_remove(&conn->rdp.tx_wait);
-		csp_queue_remove(conn->rdp.tx_queue);
-		return CSP_ERR_NOMEM;
-	}
-
 	return CSP_ERR_NONE;
 
 }
@@ -1060,8 +1432,10 @@ int csp_rdp_init(csp_conn_t * conn) {
 void csp_rdp_free_resources(csp_conn_t * conn) {
 
 	csp_bin_sem_remove(&conn->rdp.tx_wait);
-	csp_queue_remove(conn->rdp.tx_queue);
-	csp_queue_remove(conn->rdp.rx_queue);
+	csp_mutex_remove(&conn->rdp.lock);
+	csp_free(conn->rdp.tx_slot);
+	csp_free(conn->rdp.rx_slot);
+	csp_free(conn->rdp.rx_map);
 }
 
 /**
@@ -1089,9 +1463,13 @@ static int csp_rdp_close_internal(csp_conn_t * conn, uint8_t closed_by, bool sen
 		}
 		csp_log_protocol("RDP %p: csp_rdp_close(0x%x)%s -> CLOSE_WAIT", conn, closed_by, send_rst ? ", sent RST" : "");
 		csp_bin_sem_post(&conn->rdp.tx_wait); // wake up any pendng Tx
+		csp_poll_signal(conn);
 	}
 
 	if (conn->rdp.closed_by != CSP_RDP_CLOSED_BY_ALL) {
+		if ((conn->rdp.closed_by & CSP_RDP_CLOSED_BY_TIMEOUT) == 0) {
+			csp_rdp_timer_start(conn, conn->timestamp + conn->rdp.conn_timeout);
+		}
 		csp_log_protocol("RDP %p: csp_rdp_close(0x%x), waiting for:%s%s%s",
 			conn, closed_by,
 			(conn->rdp.closed_by & CSP_RDP_CLOSED_BY_USERSPACE) ? "" : " userspace",
@@ -1142,14 +1520,90 @@ void csp_rdp_get_opt(unsigned int * window_size, unsigned int * conn_timeout_ms,
 		*ack_delay_count = csp_rdp_ack_delay_count;
 }
 
+void csp_rdp_get_default_opt(csp_rdp_opt_t * opt) {
+
+	opt->window_size = csp_rdp_window_size;
+	opt->conn_timeout_ms = csp_rdp_conn_timeout;
+	opt->packet_timeout_ms = csp_rdp_packet_timeout;
+	opt->delayed_acks = csp_rdp_delayed_acks;
+	opt->ack_timeout = csp_rdp_ack_timeout;
+	opt->ack_delay_count = csp_rdp_ack_delay_count;
+
+}
+
+int csp_rdp_check_opt(const csp_rdp_opt_t * opt) {
+
+	if ((opt->window_size == 0) || (opt->conn_timeout_ms == 0) || (opt->packet_timeout_ms == 0)) {
+		csp_log_error("Invalid RDP options, window size %"PRIu32", conn timeout %"PRIu32", packet timeout %"PRIu32,
+				opt->window_size, opt->conn_timeout_ms, opt->packet_timeout_ms);
+		return CSP_ERR_INVAL;
+	}
+
+	if (opt->window_size > csp_conf.rdp_max_window) {
+		csp_log_warn("RDP window size %"PRIu32" exceeds rdp_max_window %u, window is limited", opt->window_size, csp_conf.rdp_max_window);
+	}
+
+	return CSP_ERR_NONE;
+
+}
+
+int csp_socket_set_rdp_opt(csp_socket_t * socket, const csp_rdp_opt_t * opt) {
+
+	if ((socket == NULL) || (socket->type != CONN_SERVER)) {
+		return CSP_ERR_INVAL;
+	}
+
+	if (opt == NULL) {
+		socket->rdp.socket_opt = false;
+		return CSP_ERR_NONE;
+	}
+
+	if (csp_rdp_check_opt(opt) != CSP_ERR_NONE) {
+		return CSP_ERR_INVAL;
+	}
+
+	socket->rdp.window_size = opt->window_size;
+	socket->rdp.conn_timeout = opt->conn_timeout_ms;
+	socket->rdp.packet_timeout = opt->packet_timeout_ms;
+	socket->rdp.delayed_acks = opt->delayed_acks;
+	socket->rdp.ack_timeout = opt->ack_timeout;
+	socket->rdp.ack_delay_count = opt->ack_delay_count;
+	socket->rdp.socket_opt = true;
+
+	return CSP_ERR_NONE;
+
+}
+
+int csp_rdp_get_conn_stats(const csp_conn_t * conn, csp_rdp_conn_stats_t * stats) {
+
+	if ((conn == NULL) || (stats == NULL) || ((conn->idin.flags & CSP_FRDP) == 0)) {
+		return CSP_ERR_INVAL;
+	}
+
+	stats->window_size = conn->rdp.window_size;
+	stats->cwnd = conn->rdp.cwnd;
+	stats->ssthresh = conn->rdp.ssthresh;
+	stats->outstanding = csp_rdp_tx_outstanding(conn);
+	stats->rto = conn->rdp.rto;
+	stats->srtt = conn->rdp.srtt;
+	stats->rttvar = conn->rdp.rttvar;
+	stats->retransmits = conn->rdp.retransmits;
+	stats->fast_retransmits = conn->rdp.fast_retransmits;
+	stats->timeouts = conn->rdp.timeouts;
+
+	return CSP_ERR_NONE;
+
+}
+
 #if (CSP_DEBUG)
 void csp_rdp_conn_print(csp_conn_t * conn) {
 
 	if (conn == NULL)
 		return;
 
-	printf("\tRDP: S:%d (closed by 0x%x), rcv %u, snd %u, win %"PRIu32"\r\n",
-		conn->rdp.state, conn->rdp.closed_by, conn->rdp.rcv_cur, conn->rdp.snd_una, conn->rdp.window_size);
+	printf("\tRDP: S:%d (closed by 0x%x), rcv %u, snd %u, win %"PRIu32", rto %"PRIu32" (srtt %"PRIu32", rttvar %"PRIu32"), cwnd %u, ssthresh %u, retransmits %"PRIu32"\r\n",
+		conn->rdp.state, conn->rdp.closed_by, conn->rdp.rcv_cur, conn->rdp.snd_una, conn->rdp.window_size,
+		conn->rdp.rto, conn->rdp.srtt, conn->rdp.rttvar, conn->rdp.cwnd, conn->rdp.ssthresh, conn->rdp.retransmits);
 
 }
 #endif // CSP_DEBUG
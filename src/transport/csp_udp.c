@@ -24,6 +24,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
 #include <csp/arch/csp_queue.h>
 
 #include "../csp_conn.h"
+#include "../csp_poll.h"
 
 void csp_udp_new_packet(csp_conn_t * conn, csp_packet_t * packet) {
 
@@ -41,6 +42,7 @@ void csp_udp_new_packet(csp_conn_t * conn, csp_packet_t * packet) {
 			csp_close(conn);
 			return;
 		}
+		csp_poll_signal(conn->listener);
 
 		/* Ensure that this connection will not be posted to this socket again */
 		conn->socket = NULL;